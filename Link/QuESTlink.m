@@ -53,7 +53,7 @@ BeginPackage["QuEST`"]
     
     ApplyCircuit::usage = "ApplyCircuit[qureg, circuit] modifies qureg by applying the circuit. Returns any measurement outcomes and the probabilities encountered by projectors, ordered and grouped by the appearance of M and P in the circuit.
 ApplyCircuit[inQureg, circuit, outQureg] leaves inQureg unchanged, but modifies outQureg to be the result of applying the circuit to inQureg.
-Accepts optional arguments WithBackup and ShowProgress."
+Accepts optional arguments WithBackup, ShowProgress and Asynchronous."
     ApplyCircuit::error = "`1`"
     
     ApplyCircuitDerivs::usage = "ApplyCircuitDerivs[inQureg, circuit, varVals, outQuregs] modifies outQuregs to be the result of applying the derivatives (with respect to variables in varVals) of the given symbolic circuit to inQureg (which remains unmodified).
@@ -77,7 +77,8 @@ CalcExpecPauliStringDerivs[inQureg, circuit, varVals, pauliStringOrQureg, workQu
     \[Bullet] For density-matrices and noisy channels, this function returns the Hilbert-Schmidt derivative metric, which well approximates the quantum Fisher information matrix, though is a more experimentally relevant minimisation metric (https://arxiv.org/abs/1912.08660).
     \[Bullet] Variable repetition, multi-parameter gates, variable-dependent element-wise matrices, variable-dependent channels, and operators whose parameters are (numerically evaluable) functions of variables are all permitted. 
     \[Bullet] All operators must be invertible, trace-preserving and deterministic, else an error is thrown. 
-    \[Bullet] This function runs asymptotically faster than ApplyCircuitDerivs[] and requires only a fixed memory overhead."
+    \[Bullet] This function runs asymptotically faster than ApplyCircuitDerivs[] and requires only a fixed memory overhead.
+Accepts optional argument Asynchronous."
     CalcMetricTensor::error = "`1`"
     
     CalcInnerProducts::usage = "CalcInnerProducts[quregIds] returns a Hermitian matrix with i-th j-th element CalcInnerProduct[quregIds[i], quregIds[j]].
@@ -98,6 +99,21 @@ For unnormalised density matrices, the tensors may contain complex scalars."
 
     CalcExpecPauliString::usage = "CalcExpecPauliString[qureg, pauliString, workspace] evaluates the expected value of a weighted sum of Pauli tensors, of a normalised qureg. workspace must be a qureg of equal dimensions to qureg. qureg is unchanged, and workspace is modified."
     CalcExpecPauliString::error = "`1`"
+    
+    CalcReducedDensityMatrix::usage = "CalcReducedDensityMatrix[qureg, qubits] returns the reduced density matrix of the given qubits (assumed least significant first), tracing out all others, of a state-vector or density-matrix qureg.
+\[Bullet] The partial trace is performed natively, so that only the 4^Length[qubits] elements of the result are transferred.
+See CreateReducedDensityQureg[] to instead store the result in a new density qureg."
+    CalcReducedDensityMatrix::error = "`1`"
+    
+    CreateReducedDensityQureg::usage = "CreateReducedDensityQureg[qureg, qubits] returns a new density qureg of Length[qubits] qubits, populated with the reduced density matrix of the given qubits of qureg (as per CalcReducedDensityMatrix[]), without transferring any amplitudes to Mathematica."
+    CreateReducedDensityQureg::error = "`1`"
+    
+    CalcExpecPauliStringFromShots::usage = "CalcExpecPauliStringFromShots[qureg, pauliString, numShots] estimates the expected value of pauliString from numShots simulated measurements per group of qubit-wise commuting terms, returning {estimate, variance}. qureg is unchanged.
+CalcExpecPauliStringFromShots[qureg, pauliString, numShots, workspace] uses the given persistent working register (of equal dimensions to qureg) to avoid its internal creation and destruction.
+\[Bullet] The terms are greedily grouped (in order of decreasing coefficient magnitude) into sets measurable in a common basis. A copy of qureg is rotated into each group's basis once, and every shot of the group is drawn from its marginal outcome distribution.
+\[Bullet] Identity terms are added exactly. The variance is that of the estimate, summed over the independently sampled groups.
+\[Bullet] Option \"ShotAllocation\" -> \"Weighted\" instead divides the same total number of shots between the groups proportional to the sum of their coefficient magnitudes (with at least 2 per group). The default is \"Uniform\"."
+    CalcExpecPauliStringFromShots::error = "`1`"
 
     ApplyPauliString::usage = "ApplyPauliString[inQureg, pauliString, outQureg] modifies outQureg to be the result of applying the weighted sum of Pauli tensors to inQureg."
     ApplyPauliString::error = "`1`"
@@ -144,9 +160,42 @@ CalcPauliExpressionMatrix[expr, numQb] overrides the assumed number of qubits."
 CalcPauliStringMinEigVal[pauliString, MaxIterations -> n] specifies to use at most n iterations in the invoked Arnaldi/Lanczos's method"
     CalcPauliStringMinEigVal::error = "`1`"
 
-    DestroyQureg::usage = "DestroyQureg[qureg] destroys the qureg associated with the given ID. If qureg is a Symbol, it will additionally be cleared."
+    DestroyQureg::usage = "DestroyQureg[qureg] destroys the qureg associated with the given ID. If qureg is a Symbol, it will additionally be cleared. The qureg's memory may be retained for reuse by new quregs; see SetQuregPoolCapacity[]."
     DestroyQureg::error = "`1`"
     
+    SaveQureg::usage = "SaveQureg[qureg, path] writes the state-vector or density matrix qureg to a binary checkpoint file at the given path (overwriting any existing file), returning the qureg.
+The file is written natively by the backend (in parallel), avoiding the transfer of the state to Mathematica, and can be restored with LoadQureg[]."
+    SaveQureg::error = "`1`"
+    
+    LoadQureg::usage = "LoadQureg[path] returns a new qureg (a state-vector or density matrix) populated from the binary checkpoint file at the given path, as written by SaveQureg[].
+The file must have been saved by a QuESTlink of the same precision."
+    LoadQureg::error = "`1`"
+    
+    JobStatus::usage = "JobStatus[job] returns an Association of the \"Status\" (one of \"Queued\", \"Running\", \"Succeeded\", \"Failed\" or \"Cancelled\") and the fractional \"Progress\" of the job, as returned by a function evaluated with option Asynchronous -> True.
+Jobs are evaluated one at a time (in submission order) by the backend, while Mathematica continues evaluating."
+    JobStatus::error = "`1`"
+    
+    JobResult::usage = "JobResult[job] waits for the job to finish, then returns its result (or reports its error) as would the function which submitted it with option Asynchronous -> True.
+The job's quregs, which cannot be otherwise used while the job is pending, are then released. The result of each job can be collected only once. Aborting while waiting leaves the job running."
+    JobResult::error = "`1`"
+    
+    CancelJob::usage = "CancelJob[job] requests that the job be cancelled; a queued job is cancelled immediately, and a running job at its next opportunity. The job's quregs are released only once JobResult[job] is called, which reports the cancellation. A cancelled ApplyCircuit job restores its qureg as per option WithBackup."
+    CancelJob::error = "`1`"
+    
+    SetQuregPoolCapacity::usage = "SetQuregPoolCapacity[numBytes] sets the maximum total memory of destroyed quregs which are retained by the backend, so that their memory can be reused by new quregs (including internal temporary quregs) of the same size and type. This avoids the cost of repeated allocation and page faulting. Pooled quregs exceeding the new capacity are freed immediately. The default capacity is 1 GiB, and 0 disables pooling.
+See TrimQuregPool[] and GetQuregPoolUsage[]."
+    SetQuregPoolCapacity::error = "`1`"
+    
+    GetQuregPoolUsage::usage = "GetQuregPoolUsage[] returns an Association of the memory (in bytes) occupied by destroyed quregs retained for reuse (\"NumBytes\"), and the maximum permitted (\"Capacity\"). See SetQuregPoolCapacity[]."
+    GetQuregPoolUsage::error = "`1`"
+    
+    GetQuESTMemoryUsage::usage = "GetQuESTMemoryUsage[] returns an Association of the memory (in bytes) presently allocated by the backend to quregs (\"Quregs\"), to destroyed quregs retained for reuse (\"Pool\"), to temporary buffers of in-progress operations (\"Temporary\"), their \"Total\", and the \"Budget\" set by SetQuESTMemoryBudget[]."
+    GetQuESTMemoryUsage::error = "`1`"
+    
+    SetQuESTMemoryBudget::usage = "SetQuESTMemoryBudget[numBytes] limits the total memory (in bytes) of quregs, pooled quregs and temporary buffers allocated by the backend. Operations which would exceed the budget (such as creating a qureg, or a function which internally clones a qureg) fail with an error reporting the memory required, rather than exhausting the machine's memory. Pooled quregs are freed to satisfy the budget where necessary.
+SetQuESTMemoryBudget[Infinity] removes the budget, which is the default. See GetQuESTMemoryUsage[]."
+    SetQuESTMemoryBudget::error = "`1`"
+    
     GetAmp::usage = "GetAmp[qureg, index] returns the complex amplitude of the state-vector qureg at the given index, indexing from 0.
 GetAmp[qureg, row, col] returns the complex amplitude of the density-matrix qureg at index [row, col], indexing from [0,0]."
     GetAmp::error = "`1`"
@@ -154,11 +203,29 @@ GetAmp[qureg, row, col] returns the complex amplitude of the density-matrix qure
     SetAmp::usage = "SetAmp[qureg, index, amp] modifies the indexed amplitude of the state-vector qureg to complex number amp.
 SetAmp[qureg, row, col, amp] modifies the indexed (row, col) amplitude of the density-matrix qureg to complex number amp"
     SetAmp::error = "`1`"
+    
+    GetAmps::usage = "GetAmps[qureg, indices] returns the complex amplitudes of the state-vector qureg at the given list of indices, indexing from 0.
+GetAmps[qureg, {{row, col}, ...}] returns the complex amplitudes of the density-matrix qureg at the given list of [row, col] indices, indexing from [0,0].
+The amplitudes are gathered in parallel, and only they (rather than the whole state, as per GetQuregState[]) are copied from the GPU."
+    GetAmps::error = "`1`"
+    
+    SetAmps::usage = "SetAmps[qureg, indices, amps] modifies the indexed amplitudes of the state-vector qureg to the given list of complex numbers amps.
+SetAmps[qureg, {{row, col}, ...}, amps] modifies the indexed (row, col) amplitudes of the density-matrix qureg to the given list of complex numbers amps.
+Each run of consecutive indices (where density matrices are contiguous down columns) is set at once. Repeated indices are set to their last given amplitude."
+    SetAmps::error = "`1`"
+    
+    GetTopAmplitudes::usage = "GetTopAmplitudes[qureg, k] returns the k most probable basis states of the state-vector qureg, as a list of {index, amplitude} pairs in order of decreasing probability (with ties ordered by index).
+GetTopAmplitudes[qureg, k, minProb] returns only those with a probability of at least minProb. Use k=All to return every such basis state.
+For density-matrix quregs, the diagonal is considered, and {index, rho[index, index]} pairs are returned.
+The selection is performed in parallel by the backend, so that only the returned amplitudes (rather than the whole state, as per GetQuregState[]) are sent to Mathematica."
+    GetTopAmplitudes::error = "`1`"
 
     GetQuregState::usage = "GetQuregState[qureg, form] returns the state-vector or density matrix amplitudes associated with the given qureg, in the specified form. Options for form are:
 \[Bullet] \"ZBasisMatrix\" (default) returns the amplitudes in the standard Z-basis, as a complex vector or matrix.
 \[Bullet] \"ZBasisKets\" returns a sum of complex weighted kets (or ket-bra projectors) of qubits in the standard Z-basis.
-It is often convenient to pass the returned structure to Chop[] in order to remove negligible terms and numerical artefacts."
+It is often convenient to pass the returned structure to Chop[] in order to remove negligible terms and numerical artefacts.
+GetQuregState[qureg, start ;; end] returns only the given (inclusive, from 0) range of the flat amplitudes, where density matrices are flattened column-wise.
+The amplitudes are streamed from the backend in chunks (of at most option \"ChunkSize\" amplitudes) directly into a preallocated array, which bounds memory, and permits aborting. Accepts optional argument ShowProgress."
     GetQuregState::error = "`1`"
     
     SetQuregMatrix::usage = "SetQuregMatrix[qureg, matr] modifies qureg, overwriting its statevector or density matrix with that passed."
@@ -179,7 +246,13 @@ All combinations of optional arguments are possible."
     CreateRemoteQuESTEnv::error = "`1`"
     
     CreateLocalQuESTEnv::usage = "CreateLocalQuESTEnv[fn] connects to a local 'quest_link' executable, located at fn, running single-CPU QuEST. This should be called once. The QuEST function defintions can be cleared with DestroyQuESTEnv[link].
-CreateLocalQuESTEnv[] connects to a 'quest_link' executable in the working directory."
+CreateLocalQuESTEnv[] connects to a 'quest_link' executable in the working directory.
+CreateLocalQuESTEnv accepts optional argument \"QuregAllocation\" which sets how the memory of quregs is allocated by the launched executable, as one of
+\"default\" to use QuEST's allocation,
+\"first-touch\" so that each thread first touches the amplitudes it will later process, placing them on its NUMA node (benefiting multi-socket machines),
+\"transparent-huge-pages\" to additionally request transparent huge pages, reducing TLB misses,
+\"huge-pages\" to use explicit huge pages (which must be reserved by the administrator), falling back to transparent huge pages.
+This is passed through environment variable QUESTLINK_QUREG_ALLOC, which can be set before launching a remote server. It defaults to Automatic, which inherits any existing value of the variable."
     CreateLocalQuESTEnv::error = "`1`"
     
     CreateDownloadedQuESTEnv::usage = "CreateDownloadedQuESTEnv[] downloads a precompiled single-CPU QuESTlink binary (specific to your operating system) directly from Github, then locally connects to it. This should be called once, before using the QuESTlink API.
@@ -196,6 +269,7 @@ SetWeightedQureg[fac, qOut] modifies qureg qOut to be fac qOut; that is, qOut is
     SetWeightedQureg::error = "`1`"
     
     SimplifyPaulis::usage = "SimplifyPaulis[expr] freezes commutation and analytically simplifies the given expression of Pauli operators, and expands it in the Pauli basis. The input expression can include sums, products, non-commuting products, and powers (with nonzero integer exponents) of (subscripted) Id, X, Y and Z operators and other Mathematica symbols (including variables defined as Pauli expressions, and functions thereof). 
+Numerical expressions, which contain approximate (non-exact) scalars and no symbols, are simplified by a much faster native Pauli algebra in the backend, and produce Pauli strings with approximate coefficients where any identity term targets the lowest input qubit.
 Be careful of performing algebra with Pauli operators outside of SimplifyPaulis[], since Mathematica may erroneously automatically commute them."
     SimplifyPaulis::error = "`1`"
 
@@ -311,17 +385,36 @@ See SampleExpecPauliString[] to sample such circuits in order to efficiently app
 SampleExpecPauliString[initQureg, channel, pauliString, All] deterministically samples each channel decomposition once.
 SampleExpecPauliString[initQureg, channel, pauliString, numSamples, {workQureg1, workQureg2}] uses the given persistent working registers to avoid their internal creation and destruction.
 To get a sense of the circuits being sampled, see GetCircuitsFromChannel[]. 
-Use option ShowProgress to monitor the progress of sampling."
+Use option ShowProgress to monitor the progress of sampling, and option Asynchronous to sample in the background."
     SampleExpecPauliString::error = "`1`"
     
+    SampleQuregOutcomes::usage = "SampleQuregOutcomes[qureg, qubits, numShots] returns the outcomes of numShots simulated measurements of the given qubits, without modifying qureg. Each outcome is an integer whose binary digits are the measured bits, with the first given qubit least significant (as per CalcProbOfAllOutcomes[]).
+\[Bullet] The marginal distribution of the qubits is computed natively once, and all shots drawn from it, so only the shots are transferred.
+\[Bullet] Density-matrix quregs are sampled via their diagonal.
+\[Bullet] Option \"Counts\" -> True instead returns an Association from each observed outcome to its number of shots."
+    SampleQuregOutcomes::error = "`1`"
+    
     SampleClassicalShadow::usage = "SampleClassicalShadow[qureg, numSamples] returns a sequence of pseudorandom measurement bases (X, Y and Z) and their outcomes (as bits) when performed on all qubits of the given input state.
 \[Bullet] The output has structure { {bases, outcomes}, ...} where bases is a list of Pauli bases (encoded as 1=X, 2=Y, 3=Z) specified per-qubit, and outcomes are the corresponding classical qubit outcomes (0 or 1).
 \[Bullet] Both lists are ordered with least significant qubit (index 0) first.
-\[Bullet] The output shadow is useful for efficient experimental estimation of quantum state properties, as per Nat. Phys. 16, 1050–1057 (2020)."
+\[Bullet] The output shadow is useful for efficient experimental estimation of quantum state properties, as per Nat. Phys. 16, 1050–1057 (2020).
+SampleClassicalShadow[qureg, numSamples, shadowId] appends the samples directly to the persistent shadow of the given id (see CreateClassicalShadow[]), without returning them, and returns shadowId."
     SampleClassicalShadow::error = "`1`"
     
+    CreateClassicalShadow::usage = "CreateClassicalShadow[shadow] validates and encodes the given classical shadow (e.g. output from SampleClassicalShadow[]) and stores it persistently in the backend, returning an id which can be passed to CalcExpecPauliProdsFromClassicalShadow[] in lieu of the shadow, avoiding its repeated transfer and validation.
+CreateClassicalShadow[numQubits] creates an empty persistent shadow of the given number of qubits, which can be populated by SampleClassicalShadow[qureg, numSamples, shadowId].
+\[Bullet] The shadow persists until DestroyClassicalShadow[] is called. Its samples can be retrieved with GetClassicalShadow[]."
+    CreateClassicalShadow::error = "`1`"
+    
+    GetClassicalShadow::usage = "GetClassicalShadow[shadowId] returns the persistent classical shadow of the given id (see CreateClassicalShadow[]), in the format output by SampleClassicalShadow[]."
+    GetClassicalShadow::error = "`1`"
+    
+    DestroyClassicalShadow::usage = "DestroyClassicalShadow[shadowId] frees the persistent classical shadow of the given id (see CreateClassicalShadow[]). If shadowId is a Symbol, it will additionally be cleared."
+    DestroyClassicalShadow::error = "`1`"
+    
     CalcExpecPauliProdsFromClassicalShadow::usage = "CalcExpecPauliProdsFromClassicalShadow[shadow, prods] returns a list of expected values of each Pauli product, as prescribed by the given classical shadow (e.g. output from SampleClassicalShadow[]).
 CalcExpecPauliProdsFromClassicalShadow[shadow, prods, numBatches] divides the shadow into batches, computes the expected values of each, then returns their medians. This may suppress measurement errors. The default numBatches is 10. 
+CalcExpecPauliProdsFromClassicalShadow[shadowId, prods] uses the persistent classical shadow of the given id (see CreateClassicalShadow[]), which is far faster when querying the same shadow many times.
 This is the procedure outlined in Nat. Phys. 16, 1050–1057 (2020)."
     CalcExpecPauliProdsFromClassicalShadow::error = "`1`"
 
@@ -390,6 +483,10 @@ This method uses automatic caching to avoid needless re-computation of an operat
 \[Bullet] \"CacheMaps\" -> \"UntilCallEnd\" (default) caches all computed PTMaps but clears the cache when ApplyPauliTransferMap[] returns.
 \[Bullet] \"CacheMaps\" -> \"Forever\" maintains the cache even between multiple calls to ApplyPauliTransferMap[].
 \[Bullet] \"CacheMaps\" -> \"Never\" disables caching (and clears the existing cache before computation), re-computing each operqtors' PTMap when encountered in the circuit.
+\[Bullet] \"CacheMaps\" -> \"Native\" caches the numerical PTMaps of numerical gates within the QuESTlink backend, keyed by each gate's type, parameters and number of qubits, so that they are reused between calls and circuits. The cache is bounded and discards its least recently used maps. The Pauli string is then propagated natively, producing a numerical result. Circuits containing PTMs, PTMaps or symbolic gates are instead treated as per \"UntilCallEnd\".
+When the Pauli string and all PTMaps are numerical and contain approximate (non-exact) scalars, they are propagated by a much faster native backend, which further supports truncation of the evolving Pauli string through options:
+\[Bullet] \"MinCoefficient\" -> c (default 0) discards Pauli products with coefficients of magnitude c or smaller after each map.
+\[Bullet] \"MaxPauliWeight\" -> w (default Infinity) discards Pauli products with more than w non-identity Pauli operators.
 ApplyPauliTransferMap also accepts all options of CalcPauliTransferMap, like AssertValidChannels. See ?AssertValidChannels."
     ApplyPauliTransferMap::error = "`1`"
 
@@ -416,6 +513,7 @@ CalcPauliTransferEval accepts the below options:
 \[Bullet] \"OutputForm\" -> \"Simple\" (default) or \"Detailed\", as explained above.
 \[Bullet] \"CombineStrings\" -> False which disables combining incident Pauli strings, so that the result is an acyclic tree, and each node has a single parent.
 \[Bullet] \"CacheMaps\" which controls the automatic caching of generated PTMaps (see ?ApplyPauliTransferMap).
+\[Bullet] \"MinCoefficient\" and \"MaxPauliWeight\" which prune nodes of negligible coefficient or large weight from each layer, when the Pauli string and maps are numerical (see ?ApplyPauliTransferMap). Numerical evaluations are performed by the backend, and pruned nodes have no children.
 \[Bullet] AssertValidChannels -> False which disables the simplification of symbolic Pauli string coefficients (see ?AssertValidChannels)."
     CalcPauliTransferEval::error = "`1`"
 
@@ -440,7 +538,8 @@ GetPauliString[address] opens or downloads the file at address (a string, of a f
 GetPauliString[..., numPaulis] forces the output to contain the given number of Pauli operators, introducing additional Id operators upon un-targeted qubits (unless explicitly removed with \"RemoveIds\"->True).
 GetPauliString[..., {targets}] specifies a list of qubits which the returned Pauli string should target (in the given order), instead of the default targets {0, 1, 2, ...}. Targeted Ids are retained.
 GetPauliString[..., {targets}, numPaulis] (in either order) specifies the targets, and thereafter pads the output with Ids to achieve the specified number of Pauli operators.
-GetPauliString accepts optional argument \"RemoveIds\" -> True or False (default Automatic) which when True, retains otherwise removed Id operators."
+GetPauliString accepts optional argument \"RemoveIds\" -> True or False (default Automatic) which when True, retains otherwise removed Id operators.
+GetPauliString accepts optional argument \"MinCoefficient\" -> c (default 0) which discards Pauli tensors with coefficients of magnitude c or smaller when decomposing a numerical matrix. Matrices containing approximate (non-exact) numbers are decomposed by a fast, multithreaded backend in O(n 4^n) time."
     GetPauliString::error = "`1`"
 
     GetPauliStringRetargeted::usage = "GetPauliStringRetargeted[string, rules] returns the given Pauli string but with its target qubits modified as per the given rules. The rules can be anything accepted by ReplaceAll.
@@ -467,9 +566,11 @@ GetPauliStringReformatted[..., numQubits] expands the \"Digits\", \"Kronecker\"
      
     BeginPackage["`Option`"]
 
-    WithBackup::usage = "Optional argument to ApplyCircuit, indicating whether to create a backup during circuit evaluation to restore the input state in case of a circuit error. This incurs additional memory (default True). If the circuit contains no error, this option has no effect besides wasting memory."
+    WithBackup::usage = "Optional argument to ApplyCircuit, indicating whether to restore the input state in case of a circuit error (default True). If the circuit is invertible (contains no measurements, projectors, or maximally or near-maximally mixing channels), this is achieved by undoing the applied gates upon error, which incurs no additional memory and no cost when the circuit succeeds. Otherwise, a backup of the input state is made beforehand, which incurs additional memory (reusing destroyed quregs retained by SetQuregPoolCapacity[] when possible), but has no effect when the circuit succeeds."
     
-    ShowProgress::usage = "Optional argument to ApplyCircuit and SampleExpecPauliString, indicating whether to show a progress bar during circuit evaluation (default False). This slows evaluation slightly."
+    ShowProgress::usage = "Optional argument to ApplyCircuit, SampleExpecPauliString and GetQuregState, indicating whether to show a progress bar during circuit evaluation or state retrieval (default False). This slows evaluation slightly."
+    
+    Asynchronous::usage = "Optional argument to ApplyCircuit, SampleExpecPauliString and CalcMetricTensor, indicating whether to instead immediately return the id of a job which evaluates the function in the background (default False). The job can be monitored with JobStatus[], cancelled with CancelJob[], and its result collected with JobResult[]. Its quregs cannot be otherwise used until its result is collected, but other quregs can be used meanwhile."
     
     PlotComponent::Usage = "Optional argument to PlotDensityMatrix, to plot the \"Real\", \"Imaginary\" component of the matrix, or its \"Magnitude\" (default)."
     
@@ -773,6 +874,11 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
             Message[func::error, "Invalid arguments. See ?" <> ToString[func]];
             $Failed)
                
+        (* the backend sends complex arrays as packed real arrays with a trailing dimension of {re, im}, 
+         * though an empty array arrives without it *)
+        unpackComplexArray[{}] := {}
+        unpackComplexArray[arr_] := arr . {1., I}
+        
         (* opcodes which correlate with the global IDs in circuits.hpp *)
         getOpCode[gate_] :=
             gate /. {H->0,X->1,Y->2,Z->3,Rx->4,Ry->5,Rz->6,R->7,S->8,T->9,U->10,Deph->11,Depol->12,Damp->13,SWAP->14,M->15,P->16,Kraus->17,G->18,Id->19,Ph->20,KrausNonTP->21,Matr->22,UNonNorm->23,Fac->24,_->-1}
@@ -937,13 +1043,53 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         isCircuitFormat[circ_?isGateFormat] := True
         isCircuitFormat[___] := False
         
-        unpackEncodedCircuit[codes_List] :=
-            Sequence[
-                codes[[1]], 
-                Flatten @ codes[[2]], Length /@ codes[[2]], 
-                Flatten @ codes[[3]], Length /@ codes[[3]],
-                Flatten[N /@ codes[[4]]], Length /@ codes[[4]]
-            ]
+        (* packing codified gates into a single flat list (decoded by Circuit::loadFromMMA() in one pass):
+         * {numGates, (opcode, numCtrls, numTargs, numParams, ctrls..., targs..., params...) for each gate} *)
+        packCodifiedCircuit[codes_List] :=
+            Prepend[
+                Flatten @ MapThread[{#1, Length[#2], Length[#3], Length[#4], #2, #3, #4}&, codes],
+                Length @ First @ codes]
+        
+        (* a circuit's skeleton replaces its (non-integer) numerical parameters with 
+         * indexed placeholders, so that circuits differing only in their parameters 
+         * (like in variational algorithms) share a skeleton, and thus an encoder *)
+        SetAttributes[circParamSlot, NHoldAll]
+        isCircuitParam[x_] := NumericQ[x] && Not @ IntegerQ[x]
+        getCircuitSkeleton[circuit_] := Module[
+            {numParams = 0, skeleton, params},
+            {skeleton, params} = Reap[
+                circuit /. p_?isCircuitParam :> (Sow[p]; circParamSlot[++numParams])];
+            {skeleton, Join @@ params}]
+        
+        (* an encoder is a function of the parameters returning the packed circuit, or the 
+         * (uncached) index of the first unrecognised gate in the skeleton *)
+        circuitEncoderCache = <||>;
+        maxNumCachedCircuitEncoders = 32;
+        getCircuitEncoder[skeleton_List] := Module[
+            {codes = codifyCircuit[skeleton]},
+            If[MemberQ[codes[[1]], -1], 
+                Return @ Position[codes[[1]], -1][[1,1]]];
+            Function @@ {packCodifiedCircuit[codes] /. circParamSlot[i_] :> Slot[i]}]
+        getCachedCircuitEncoder[skeleton_List] := 
+            Lookup[circuitEncoderCache, Key[skeleton], 
+                With[{encoder = getCircuitEncoder[skeleton]},
+                    If[Head[encoder] === Function,
+                        If[Length[circuitEncoderCache] >= maxNumCachedCircuitEncoders, 
+                            circuitEncoderCache = <||>];
+                        circuitEncoderCache[skeleton] = encoder];
+                    encoder]]
+        
+        (* converting a circuit into a packed list of reals for the backend, else an error string *)
+        encodeCircuit[circuit_List, nonRealMsg_String:"Circuit contains non-numerical or non-real parameters!"] := Module[
+            {skeleton, params, encoder, encoding},
+            {skeleton, params} = getCircuitSkeleton[circuit];
+            encoder = getCachedCircuitEncoder[skeleton];
+            If[IntegerQ[encoder], 
+                Return["Circuit contained an unrecognised gate: " <> ToString@StandardForm@circuit[[encoder]]]];
+            encoding = Developer`ToPackedArray[N[encoder @@ params], Real];
+            If[Developer`PackedArrayQ[encoding, Real], encoding, nonRealMsg]]
+        encodeCircuit[circuit_, args___] :=
+            encodeCircuit[{circuit}, args]
 
         circContainsDecoherence[circuit_List] :=
             MemberQ[
@@ -959,40 +1105,42 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         (* declaring optional args to ApplyCircuit *)
         Options[ApplyCircuit] = {
             WithBackup -> True,
-            ShowProgress -> False
+            ShowProgress -> False,
+            Asynchronous -> False
         };
         
         (* applying a sequence of symoblic gates to a qureg. ApplyCircuitInternal provided by WSTP *)
-        applyCircuitInner[qureg_, withBackup_, showProgress:0, circCodes__] :=
-            ApplyCircuitInternal[qureg, withBackup, showProgress, circCodes]
-        applyCircuitInner[qureg_, withBackup_, showProgress:1, circCodes__] :=
+        applyCircuitInner[qureg_, withBackup_, showProgress:0, async_, encoding_] :=
+            ApplyCircuitInternal[qureg, withBackup, showProgress, async, encoding]
+        applyCircuitInner[qureg_, withBackup_, showProgress:1, async_, encoding_] :=
             Monitor[
                 (* local private variable, updated by backend *)
                 calcProgressVar = 0;
-                ApplyCircuitInternal[qureg, withBackup, showProgress, circCodes],
+                ApplyCircuitInternal[qureg, withBackup, showProgress, async, encoding],
                 ProgressIndicator[calcProgressVar]
             ]
         ApplyCircuit[qureg_Integer, {}, OptionsPattern[ApplyCircuit]] :=
             {}
         ApplyCircuit[qureg_Integer, circuit_?isCircuitFormat, OptionsPattern[ApplyCircuit]] :=
             With[
-                {codes = codifyCircuit[circuit]},
+                {encoding = encodeCircuit[circuit]},
                 Which[
-                    MemberQ[codes[[1]], -1],
-                    Message[ApplyCircuit::error, "Circuit contained an unrecognised gate: " <> ToString@StandardForm@
-                        circuit[[ Position[codes[[1]], -1][[1,1]] ]]]; $Failed,
-                    Not @ AllTrue[codes[[4]], Internal`RealValuedNumericQ, 2],
-                    Message[ApplyCircuit::error, "Circuit contains non-numerical or non-real parameters!"]; $Failed,
+                    StringQ[encoding],
+                    Message[ApplyCircuit::error, encoding]; $Failed,
                     Not @ Or[OptionValue[WithBackup] === True, OptionValue[WithBackup] === False],
                     Message[ApplyCircuit::error, "Option WithBackup must be True or False."]; $Failed,
                     Not @ Or[OptionValue[ShowProgress] === True, OptionValue[ShowProgress] === False],
                     Message[ApplyCircuit::error, "Option ShowProgress must be True or False."]; $Failed,
+                    Not @ Or[OptionValue[Asynchronous] === True, OptionValue[Asynchronous] === False],
+                    Message[ApplyCircuit::error, "Option Asynchronous must be True or False."]; $Failed,
                     True,
+                    (* a job's progress is instead reported by JobStatus[] *)
                     applyCircuitInner[
                         qureg, 
                         If[OptionValue[WithBackup]===True,1,0], 
-                        If[OptionValue[ShowProgress]===True,1,0],
-                        unpackEncodedCircuit[codes]
+                        If[OptionValue[ShowProgress]===True && OptionValue[Asynchronous]===False,1,0],
+                        If[OptionValue[Asynchronous]===True,1,0],
+                        encoding
                     ]
                 ]
             ]
@@ -1050,17 +1198,12 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
             gateInds = gateInds[[order]];
             varInds = varInds[[order]];
             
-            (* encode the circuit for the backend *)
-            encodedCirc = codifyCircuit[(circuit /. varVals)];
-            
-            (* validate that all gates were recognised *)
-            If[MemberQ[encodedCirc[[1]], -1],
-                Throw["Circuit contained an unrecognised gate: " <> ToString@StandardForm@
-                    circuit[[ Position[encodedCirc[[1]], -1][[1,1]] ]]]];
-            
-            (* validate the circuit contains no unspecified variables *)
-            If[Not @ AllTrue[encodedCirc[[4]], Internal`RealValuedNumericQ, 2],
-                Throw @ "The circuit contained variables which were not assigned real values."];
+            (* encode the circuit for the backend, validating all gates were recognised, 
+             * and that the circuit contains no unspecified variables *)
+            encodedCirc = encodeCircuit[(circuit /. varVals), 
+                "The circuit contained variables which were not assigned real values."];
+            If[StringQ[encodedCirc],
+                Throw @ encodedCirc];
 
             (* differentiate gate args, and pack for backend (without yet making numerical) *)
             derivParams = MapThread[encodeDerivParams, 
@@ -1079,10 +1222,15 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 Throw @ "The circuit contained gate derivatives with parameters which could not be numerically evaluated."];
             
             (* return *)
-            {encodedCirc, {gateInds, varInds, derivParams}}]
-            
-        unpackEncodedDerivCircTerms[{gateInds_, varInds_, derivParams_}] :=
-            Sequence[gateInds-1, varInds-1, Flatten @ derivParams, Length /@ Flatten /@ derivParams]
+            {encodedCirc, encodeDerivCircTerms[gateInds, varInds, derivParams]}]
+        
+        (* packing derivative terms into a single flat list (decoded by DerivCircuit::loadFromMMA()), 
+         * mapping Mathematica indices to C++ indices:
+         * {numTerms, (gateInd, varInd, numDerivParams, derivParams...) for each term} *)
+        encodeDerivCircTerms[gateInds_, varInds_, derivParams_] :=
+            Developer`ToPackedArray @ N @ Prepend[
+                Flatten @ MapThread[{#1-1, #2-1, Length @ Flatten @ #3, #3}&, {gateInds, varInds, derivParams}],
+                Length @ gateInds]
             
             
             
@@ -1104,8 +1252,8 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 {encodedCirc, encodedDerivTerms} = ret;
                 ApplyCircuitDerivsInternal[
                     inQureg, First@{Sequence@@workQuregs}, outQuregs, 
-                    unpackEncodedCircuit @ encodedCirc, 
-                    unpackEncodedDerivCircTerms @ encodedDerivTerms]]
+                    encodedCirc, 
+                    encodedDerivTerms]]
                     
         ApplyCircuitDerivs[___] := invalidArgError[ApplyCircuitDerivs]  
         
@@ -1116,12 +1264,12 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 ret = Catch @ encodeDerivCirc[circuit, varVals];
                 If[Head@ret === String,
                     Message[CalcExpecPauliStringDerivs::error, ret]; Return @ $Failed];
-                (* send to backend, mapping Mathematica indices to C++ indices *)
+                (* send to backend *)
                 {encodedCirc, encodedDerivTerms} = ret;
                 CalcExpecPauliStringDerivsInternal[
                     initQureg, workQuregs,
-                    unpackEncodedCircuit @ encodedCirc, 
-                    unpackEncodedDerivCircTerms @ encodedDerivTerms,
+                    encodedCirc, 
+                    encodedDerivTerms,
                     Sequence @@ getEncodedNumericPauliString[paulis]]]
 
         CalcExpecPauliStringDerivs[initQureg_Integer, circuit_?isCircuitFormat, varVals:{(_ -> _?Internal`RealValuedNumericQ) ..}, hamilQureg_Integer, workQuregs:{___Integer}:{}] :=
@@ -1131,32 +1279,37 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 ret = Catch @ encodeDerivCirc[circuit, varVals];
                 If[Head@ret === String,
                     Message[CalcExpecPauliStringDerivs::error, ret]; Return @ $Failed];
-                (* send to backend, mapping Mathematica indices to C++ indices *)
+                (* send to backend *)
                 {encodedCirc, encodedDerivTerms} = ret;
                 CalcExpecPauliStringDerivsDenseHamilInternal[
                     initQureg, hamilQureg, workQuregs,
-                    unpackEncodedCircuit @ encodedCirc, 
-                    unpackEncodedDerivCircTerms @ encodedDerivTerms]]
+                    encodedCirc, 
+                    encodedDerivTerms]]
             
         CalcExpecPauliStringDerivs[___] := invalidArgError[CalcExpecPauliStringDerivs]
         
-        CalcMetricTensor[initQureg_Integer, circuit_?isCircuitFormat, varVals:{(_ -> _?Internal`RealValuedNumericQ) ..}, workQuregs:{___Integer}:{}] :=
+        Options[CalcMetricTensor] = {
+            Asynchronous -> False
+        };
+        
+        CalcMetricTensor[initQureg_Integer, circuit_?isCircuitFormat, varVals:{(_ -> _?Internal`RealValuedNumericQ) ..}, workQuregs:{___Integer}:{}, OptionsPattern[CalcMetricTensor]] :=
             Module[
-                {ret, encodedCirc, encodedDerivTerms, retArrs},
+                {ret, encodedCirc, encodedDerivTerms, async = TrueQ @ OptionValue[Asynchronous]},
                 (* encode deriv circuit for backend, throwing any parsing errors *)
                 ret = Catch @ encodeDerivCirc[circuit, varVals];
                 If[Head@ret === String,
                     Message[CalcMetricTensor::error, ret]; Return @ $Failed];
-                (* send to backend, mapping Mathematica indices to C++ indices *)
+                (* send to backend *)
                 {encodedCirc, encodedDerivTerms} = ret;
                 data = CalcMetricTensorInternal[
-                    initQureg, workQuregs,
-                    unpackEncodedCircuit @ encodedCirc, 
-                    unpackEncodedDerivCircTerms @ encodedDerivTerms];
-                (* reformat output to complex matrix *)
-                If[data === $Failed, data, ArrayReshape[
-                    MapThread[Complex, {data[[1]], data[[2]]}], 
-                    Length[varVals] {1,1}]]]
+                    initQureg, Boole[async], workQuregs,
+                    encodedCirc, 
+                    encodedDerivTerms];
+                (* reformat output to complex matrix, deferred to JobResult[] for jobs *)
+                Which[
+                    data === $Failed, data,
+                    async, jobResultFormatters[data] = unpackComplexArray; data,
+                    True, unpackComplexArray[data]]]
                     
         CalcMetricTensor[__] := invalidArgError[CalcMetricTensor]
         
@@ -1169,38 +1322,51 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         (* compute a matrix of inner products; this can be used in tandem with ApplyCircuitDerivs to populate the Li matrix *)
         CalcInnerProducts[quregIds:{__Integer}] := 
             With[
-                {data=CalcInnerProductsMatrixInternal[quregIds],
-                len=Length[quregIds]},
-                ArrayReshape[
-                    MapThread[Complex, {data[[1]], data[[2]]}], 
-                    {len, len}
-                ]
+                {data=CalcInnerProductsMatrixInternal[quregIds]},
+                If[data === $Failed, data, unpackComplexArray[data]]
             ]
         (* computes a vector of inner products <braId|ketIds[i]> *)
         CalcInnerProducts[braId_Integer, ketIds:{__Integer}] := 
             With[
                 {data=CalcInnerProductsVectorInternal[braId, ketIds]},
-                MapThread[Complex, {data[[1]], data[[2]]}] 
+                If[data === $Failed, data, unpackComplexArray[data]]
             ]
         (* error for bad args *)
         CalcInnerProducts[___] := invalidArgError[CalcInnerProducts]
             
         (* compute a real symmetric matrix of density inner products *)
         CalcDensityInnerProducts[quregIds:{__Integer}] :=
-            ArrayReshape[
-                MapThread[
-                    Complex,
-                    CalcDensityInnerProductsMatrixInternal[quregIds]],
-                {Length @ quregIds, Length @ quregIds}
+            With[
+                {data=CalcDensityInnerProductsMatrixInternal[quregIds]},
+                If[data === $Failed, data, unpackComplexArray[data]]
             ]
         (* compute a real vector of density innere products *)
         CalcDensityInnerProducts[rhoId_Integer, omegaIds:{__Integer}] :=
-            MapThread[
-                Complex,
-                CalcDensityInnerProductsVectorInternal[rhoId, omegaIds]]
+            With[
+                {data=CalcDensityInnerProductsVectorInternal[rhoId, omegaIds]},
+                If[data === $Failed, data, unpackComplexArray[data]]
+            ]
         (* error for bad args *)
         CalcDensityInnerProducts[___] := invalidArgError[CalcDensityInnerProducts]
         
+        (* the partial trace is performed natively, returning only the small reduced matrix *)
+        CalcReducedDensityMatrix[qureg_Integer, qubits:{__Integer}] :=
+            With[{data = CalcReducedDensityMatrixInternal[qureg, 0, qubits]},
+                If[data === $Failed, data,
+                    Transpose @ unpackComplexArray @ data[[2]]]]
+        CalcReducedDensityMatrix[___] := invalidArgError[CalcReducedDensityMatrix]
+        
+        CreateReducedDensityQureg[qureg_Integer, qubits:{__Integer}] :=
+            CalcReducedDensityMatrixInternal[qureg, 1, qubits]
+        CreateReducedDensityQureg[___] := invalidArgError[CreateReducedDensityQureg]
+        
+        (* the marginal distributions of many subsets of qubits, computed in a single pass. Empty 
+         * subsets are permitted by the pattern, to be reported by the backend's validation *)
+        CalcProbOfAllOutcomes[qureg_Integer, subsets:{{___Integer}..}] :=
+            With[
+                {probs = CalcProbOfAllOutcomesOfSubsetsInternal[qureg, Flatten[subsets], Length /@ subsets]},
+                If[probs === $Failed, probs, TakeList[probs, 2^(Length /@ subsets)]]]
+        
         
         
         (* 
@@ -1216,28 +1382,125 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         DestroyQureg[qureg_] :=
             DestroyQuregInternal @ ReleaseHold @ qureg
         DestroyQureg[___] := invalidArgError[DestroyQureg]
-
-        (* get a local matrix representation of the qureg. GetQuregMatrixInternal provided by WSTP *)
-        GetQuregState[qureg_Integer, "ZBasisMatrix"] :=
-            With[{data = GetQuregMatrixInternal[qureg]},
-                Which[
-                    (* if failed, return failure type *)
-                    Or[data === $Failed, data === $Aborted],
-                        data,
-                    (* if state-vector, stitch the real and imag components into a complex array *)
-                    data[[2]] === 0,
-                        MapThread[#1 + I #2 &, {data[[3]], data[[4]]}],
-                    (* if density-matrix, stitch the real and imag components into a complex matrix *)
-                    data[[2]] === 1,
-                        Transpose @ ArrayReshape[
-                            MapThread[#1 + I #2 &, {data[[3]], data[[4]]}], 
-                            {2^data[[1]],2^data[[1]]}]
+        
+        (* relative paths are resolved against the front-end's working directory, rather than the backend's *)
+        SaveQureg[qureg_Integer, path_String] :=
+            SaveQuregInternal[qureg, ExpandFileName[path]]
+        SaveQureg[___] := invalidArgError[SaveQureg]
+        
+        LoadQureg[path_String] :=
+            LoadQuregInternal[ExpandFileName[path]]
+        LoadQureg[___] := invalidArgError[LoadQureg]
+        
+        (* functions which reformat the backend output of their jobs, keyed by job id *)
+        jobResultFormatters = <||>;
+        
+        JobStatus[job_Integer] :=
+            With[{status = JobStatusInternal[job]},
+                If[status === $Failed, status, <|
+                    "Status" -> {"Queued", "Running", "Succeeded", "Failed", "Cancelled"}[[1 + status[[1]]]],
+                    "Progress" -> status[[2]] |>]]
+        JobStatus[___] := invalidArgError[JobStatus]
+        
+        JobResult[job_Integer] :=
+            With[{result = JobResultInternal[job], formatter = Lookup[jobResultFormatters, job, Identity]},
+                jobResultFormatters = KeyDrop[jobResultFormatters, job];
+                If[result === $Failed, result, formatter[result]]]
+        JobResult[___] := invalidArgError[JobResult]
+        
+        CancelJob[job_Integer] :=
+            CancelJobInternal[job]
+        CancelJob[___] := invalidArgError[CancelJob]
+        
+        SetQuregPoolCapacity[numBytes_Integer] :=
+            SetQuregPoolCapacityInternal[Min[numBytes, 2^63 - 1]]
+        SetQuregPoolCapacity[___] := invalidArgError[SetQuregPoolCapacity]
+        
+        GetQuregPoolUsage[] :=
+            With[{usage = GetQuregPoolUsageInternal[]},
+                If[usage === $Failed, $Failed,
+                    <| "NumBytes" -> usage[[1]], "Capacity" -> usage[[2]] |>]]
+        GetQuregPoolUsage[___] := invalidArgError[GetQuregPoolUsage]
+        
+        SetQuESTMemoryBudget[Infinity] :=
+            SetQuESTMemoryBudgetInternal[-1]
+        SetQuESTMemoryBudget[numBytes_Integer] :=
+            SetQuESTMemoryBudgetInternal[Min[numBytes, 2^63 - 1]]
+        SetQuESTMemoryBudget[___] := invalidArgError[SetQuESTMemoryBudget]
+        
+        GetQuESTMemoryUsage[] :=
+            With[{usage = GetQuESTMemoryUsageInternal[]},
+                If[usage === $Failed, $Failed,
+                    <|  "Quregs" -> usage[[1]], "Pool" -> usage[[2]], "Temporary" -> usage[[3]],
+                        "Total" -> Total @ usage[[1;;3]], 
+                        "Budget" -> If[usage[[4]] === -1, Infinity, usage[[4]]] |>]]
+        GetQuESTMemoryUsage[___] := invalidArgError[GetQuESTMemoryUsage]
+
+        (* the backend streams the amplitudes in chunks into a preallocated packed array, local to getQuregStateInChunks *)
+        initQuregStateBuffer[numAmps_] := (
+            quregStateBuffer = ConstantArray[0. + 0. I, numAmps];)
+        receiveQuregStateChunk[offset_, amps_] := (
+            quregStateBuffer[[offset + 1 ;; offset + Length[amps]]] = unpackComplexArray[amps];
+            calcProgressVar = N[(offset + Length[amps]) / Length[quregStateBuffer]];)
+        
+        getQuregStateInChunks[qureg_, startInd_, numAmps_, chunkSize_, showProgress_] :=
+            Block[{quregStateBuffer, data},
+                data = If[showProgress,
+                    Monitor[
+                        (* local private variable, updated by receiveQuregStateChunk *)
+                        calcProgressVar = 0;
+                        GetQuregStateInChunksInternal[qureg, startInd, numAmps, chunkSize],
+                        ProgressIndicator[calcProgressVar]],
+                    GetQuregStateInChunksInternal[qureg, startInd, numAmps, chunkSize]];
+                If[Or[data === $Failed, data === $Aborted],
+                    data,
+                    Append[data, quregStateBuffer]]]
+        
+        Options[GetQuregState] = {
+            ShowProgress -> False,
+            "ChunkSize" -> 2^20
+        };
+        
+        getQuregStateOptionsAreValid[opts___] := Which[
+            Not @ Or[OptionValue[GetQuregState, {opts}, ShowProgress] === True, OptionValue[GetQuregState, {opts}, ShowProgress] === False],
+                Message[GetQuregState::error, "Option ShowProgress must be True or False."]; False,
+            Not @ MatchQ[OptionValue[GetQuregState, {opts}, "ChunkSize"], n_Integer /; n > 0],
+                Message[GetQuregState::error, "Option \"ChunkSize\" must be a positive integer."]; False,
+            True,
+                True]
+        
+        (* get a local matrix representation of the qureg. GetQuregStateInChunksInternal provided by WSTP *)
+        GetQuregState[qureg_Integer, "ZBasisMatrix", opts:OptionsPattern[]] :=
+            If[Not @ getQuregStateOptionsAreValid[opts], $Failed,
+                With[{data = getQuregStateInChunks[qureg, 0, -1, OptionValue["ChunkSize"], OptionValue[ShowProgress]]},
+                    Which[
+                        (* if failed, return failure type *)
+                        Or[data === $Failed, data === $Aborted],
+                            data,
+                        (* if state-vector, the amplitudes were already stitched into a complex array *)
+                        data[[2]] === 0,
+                            data[[3]],
+                        (* if density-matrix, reshape the column-major amplitudes into a complex matrix *)
+                        data[[2]] === 1,
+                            Transpose @ ArrayReshape[data[[3]], {2^data[[1]],2^data[[1]]}]
+                    ]
                 ]
             ]
+        
+        GetQuregState[qureg_Integer, Span[start_Integer, end_Integer], opts:OptionsPattern[]] :=
+            Which[
+                Not @ getQuregStateOptionsAreValid[opts], 
+                    $Failed,
+                Or[start < 0, end < start - 1, end >= 2^63],
+                    Message[GetQuregState::error, "The range of amplitude indices is invalid."]; $Failed,
+                True,
+                    With[{data = getQuregStateInChunks[qureg, start, end - start + 1, OptionValue["ChunkSize"], OptionValue[ShowProgress]]},
+                        If[Or[data === $Failed, data === $Aborted], data, data[[3]]]]
+            ]
 
-        GetQuregState[qureg_Integer, "ZBasisKets"] := 
+        GetQuregState[qureg_Integer, "ZBasisKets", opts:OptionsPattern[]] := 
             With[
-                {matr = GetQuregState[qureg, "ZBasisMatrix"]},
+                {matr = GetQuregState[qureg, "ZBasisMatrix", opts]},
                 {nQb = Log2 @ Length @ matr},
                 Which[
                     (* if failed, return failure type *)
@@ -1261,8 +1524,8 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                     }
             ]
 
-        GetQuregState[qureg_Integer] :=
-            GetQuregState[qureg, "ZBasisMatrix"]
+        GetQuregState[qureg_Integer, opts:OptionsPattern[]] :=
+            GetQuregState[qureg, "ZBasisMatrix", opts]
 
         GetQuregState[___] := invalidArgError[GetQuregState]
 
@@ -1305,6 +1568,27 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         CalcExpecPauliString[_Integer, Verbatim[Plus][_?NumericQ, ___], _Integer] := 
             invalidPauliScalarError[CalcExpecPauliString]
         CalcExpecPauliString[___] := invalidArgError[CalcExpecPauliString]
+        
+        Options[CalcExpecPauliStringFromShots] = {
+            "ShotAllocation" -> "Uniform"
+        };
+        
+        CalcExpecPauliStringFromShots[qureg_Integer, paulis_?isValidNumericPauliString, numShots_Integer, workspace_Integer:-1, OptionsPattern[]] :=
+            Which[
+                numShots >= 2^63,
+                    Message[CalcExpecPauliStringFromShots::error, "The requested number of shots is too large, and exceeds the maximum C long integer (2^63)."]; 
+                    $Failed,
+                Not @ MemberQ[{"Uniform", "Weighted"}, OptionValue["ShotAllocation"]],
+                    Message[CalcExpecPauliStringFromShots::error, "Option \"ShotAllocation\" must be \"Uniform\" or \"Weighted\"."]; 
+                    $Failed,
+                True,
+                    CalcExpecPauliStringFromShotsInternal[
+                        qureg, workspace, Boole[OptionValue["ShotAllocation"] === "Weighted"], numShots, 
+                        Sequence @@ getEncodedNumericPauliString[paulis]]
+            ]
+        CalcExpecPauliStringFromShots[_Integer, Verbatim[Plus][_?NumericQ, ___], ___] := 
+            invalidPauliScalarError[CalcExpecPauliStringFromShots]
+        CalcExpecPauliStringFromShots[___] := invalidArgError[CalcExpecPauliStringFromShots]
 
 
         ApplyPauliString[inQureg_Integer, paulis_?isValidNumericPauliString, outQureg_Integer] :=
@@ -1326,7 +1610,7 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
             {pauliCodes = getEncodedNumericPauliString[paulis]},
             {elems = CalcPauliStringMatrixInternal[1+Max@pauliCodes[[3]], Sequence @@ pauliCodes]},
             If[elems === $Failed, elems, 
-                (#[[1]] + I #[[2]])& /@ Partition[elems,2] // Transpose]]
+                Transpose @ unpackComplexArray @ Developer`ToPackedArray @ elems]]
         CalcPauliStringMatrix[Verbatim[Plus][_?NumericQ, ___]] :=
             invalidPauliScalarError[CalcPauliStringMatrix]
         CalcPauliStringMatrix[___] := invalidArgError[CalcPauliStringMatrix]
@@ -1494,20 +1778,30 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         isPowerOfTwoSquareMatrix[m_] := 
             And[SquareMatrixQ @ m, BitAnd[Length@m, Length@m - 1] === 0]
 
-        getPauliStringFromMatrix[m_?isPowerOfTwoSquareMatrix, removeIds_:True] := 
-            getPauliStringFromMatrix[m, Log2 @ Length @ m, removeIds]
+        getPauliStringFromMatrix[m_?isPowerOfTwoSquareMatrix, removeIds_:True, minCoeff_:0] := 
+            getPauliStringFromMatrix[m, Log2 @ Length @ m, removeIds, minCoeff]
 
-        getPauliStringFromMatrix[m_?isPowerOfTwoSquareMatrix, nQbOut_Integer, removeIds_:True] := Module[
-            {nQbMatr, coeffs},
+        getPauliStringFromMatrix[m_?isPowerOfTwoSquareMatrix, nQbOut_Integer, removeIds_:True, minCoeff_:0] := Module[
+            {nQbMatr, coeffs, out},
             nQbMatr = Log2 @ Length @ m;
             If[nQbOut < nQbMatr,
                 Message[GetPauliString::error, 
                     "The specified number of qubits (" <> ToString[nQbOut] <> ") was fewer than that " <>
                     "suggested (" <> ToString[nQbMatr] <> ") by the matrix's dimension."];
                 Return @ $Failed];
+                
+            (* approximate numerical matrices are decomposed by the backend in O(n 4^n) time *)
+            If[ MatrixQ[m, NumericQ] && Precision[m] =!= Infinity,
+                out = GetPauliStringFromMatrixInternal[nQbMatr, N @ minCoeff, Flatten @ Re @ N @ m, Flatten @ Im @ N @ m];
+                If[ out === $Failed, Return @ $Failed];
+                Return[
+                    MapThread[If[#2 == 0, #1, #1 + I #2]&, Most @ out] . 
+                    (getNthPauliTensorSymbols[#, nQbOut, removeIds]& /@ Last @ out)]];
+                
             coeffs =  1/2^nQbMatr Table[
                 Tr[getNthPauliTensorMatrix[i,nQbMatr] . m],  
                 {i, 0, 4^nQbMatr - 1}];
+            coeffs = If[NumericQ[#] && Abs[#] <= minCoeff, 0, #]& /@ coeffs;
             coeffs . Table[getNthPauliTensorSymbols[n,nQbOut,removeIds], {n, 0, 4^nQbMatr-1}]]
 
         getPauliStringFromMatrix[___] := (
@@ -1546,7 +1840,8 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
 
 
         Options[GetPauliString] = {
-            "RemoveIds" -> Automatic
+            "RemoveIds" -> Automatic,
+            "MinCoefficient" -> 0
         }
 
         (* decide whether to automatically remove Ids from returned product (i.e. whether numPaulis was specified) *)
@@ -1564,8 +1859,11 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         GetPauliString[address_String, numPaulis:optionalNumQbPatt, opts:OptionsPattern[]] :=
             getPauliStringFromAddress[address, numPaulis, shouldRemovePauliStringIds[numPaulis, opts]]
 
-        GetPauliString[matrix_?MatrixQ, numPaulis:optionalNumQbPatt, opts:OptionsPattern[]] :=
-            getPauliStringFromMatrix[matrix, numPaulis, shouldRemovePauliStringIds[numPaulis, opts]]
+        GetPauliString[matrix_?MatrixQ, numPaulis:optionalNumQbPatt, opts:OptionsPattern[]] := (
+            If[ Not @ MatchQ[OptionValue @ "MinCoefficient", _?(Internal`RealValuedNumericQ[#] && NonNegative[#] &)],
+                Message[GetPauliString::error, "Option \"MinCoefficient\" must be a non-negative real number."];
+                Return @ $Failed];
+            getPauliStringFromMatrix[matrix, numPaulis, shouldRemovePauliStringIds[numPaulis, opts], OptionValue @ "MinCoefficient"])
 
         GetPauliString[index_Integer, numPaulis:optionalNumQbPatt, opts:OptionsPattern[]] :=
             getPauliStringFromIndex[index, numPaulis, shouldRemovePauliStringIds[numPaulis, opts]]
@@ -1590,7 +1888,7 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                     Return @ $Failed];
 
                 (* produce Pauli string with indices from 0, every term is Length[targs]-operators. *)
-                pauliStr = Check[GetPauliString[obj, Length[targs], "RemoveIds"->False], Return @ $Failed];
+                pauliStr = Check[GetPauliString[obj, Length[targs], "RemoveIds"->False, Sequence @@ FilterRules[{opts}, "MinCoefficient"]], Return @ $Failed];
 
                 (* modify the Pauli string to the users target qubits; may contain Ids, but is NOT necessarily full-length. E.g. X7 Id5 Z3 *)
                 map = MapThread[Rule, {Range @ Length @ targs -1, targs}];
@@ -1792,29 +2090,32 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         
 
         Options[SampleExpecPauliString] = {
-            ShowProgress -> False
+            ShowProgress -> False,
+            Asynchronous -> False
         };
         
-        sampleExpecPauliStringInner[True, args__] :=
+        (* a job's progress is instead reported by JobStatus[] *)
+        sampleExpecPauliStringInner[True, False, args__] :=
             Monitor[
                 (* local private variable, updated by backend *)
                 calcProgressVar = 0;
-                SampleExpecPauliStringInternal[1, args],
+                SampleExpecPauliStringInternal[1, 0, args],
                 ProgressIndicator[calcProgressVar]]
-        sampleExpecPauliStringInner[False, args__] :=
-            SampleExpecPauliStringInternal[0, args]
+        sampleExpecPauliStringInner[_, async_, args__] :=
+            SampleExpecPauliStringInternal[0, Boole[async], args]
          
         SampleExpecPauliString[qureg_Integer, channel_?isCircuitFormat, paulis_?isValidNumericPauliString, numSamples:(_Integer|All), {work1_Integer, work2_Integer}, OptionsPattern[]] /; (work1 === work2 === -1 || And[work1 =!= -1, work2 =!= -1]) :=
             If[numSamples =!= All && numSamples >= 2^63, 
                 Message[SampleExpecPauliString::error, "The requested number of samples is too large, and exceeds the maximum C long integer (2^63)."]; $Failed,
-                With[{codes = codifyCircuit[channel]},
+                With[{encoding = encodeCircuit[channel]},
                     If[
-                        Not @ AllTrue[codes[[4]], Internal`RealValuedNumericQ, 2],
-                        Message[SampleExpecPauliString::error, "Circuit contains non-numerical or non-real parameters!"]; $Failed,
+                        StringQ[encoding],
+                        Message[SampleExpecPauliString::error, encoding]; $Failed,
                         sampleExpecPauliStringInner[
-                            OptionValue[ShowProgress],
+                            TrueQ @ OptionValue[ShowProgress],
+                            TrueQ @ OptionValue[Asynchronous],
                             qureg, work1, work2, numSamples /. (All -> -1),
-                            unpackEncodedCircuit[codes],
+                            encoding,
                             Sequence @@ getEncodedNumericPauliString[paulis]]]]]
         
         SampleExpecPauliString[qureg_Integer, channel_?isCircuitFormat, paulis_?isValidNumericPauliString, numSamples:(_Integer|All), opts:OptionsPattern[]] :=
@@ -1823,36 +2124,95 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         SampleExpecPauliString[___] := invalidArgError[SampleExpecPauliString]
 
 
-        SampleClassicalShadow[qureg_Integer, numSamples_Integer] /; (numSamples >= 2^63) := (
+        Options[SampleQuregOutcomes] = {
+            "Counts" -> False
+        };
+        
+        SampleQuregOutcomes[qureg_Integer, qubits:{___Integer}, numShots_Integer, OptionsPattern[]] :=
+            Which[
+                numShots >= 2^63,
+                    Message[SampleQuregOutcomes::error, "The requested number of shots is too large, and exceeds the maximum C long integer (2^63)."]; 
+                    $Failed,
+                Not @ BooleanQ @ OptionValue["Counts"],
+                    Message[SampleQuregOutcomes::error, "Option \"Counts\" must be True or False."]; 
+                    $Failed,
+                OptionValue["Counts"],
+                    With[
+                        {data = SampleQuregOutcomesInternal[qureg, 1, qubits, numShots]},
+                        If[data === $Failed, data, AssociationThread @@ data]],
+                True,
+                    SampleQuregOutcomesInternal[qureg, 0, qubits, numShots]
+            ]
+        SampleQuregOutcomes[___] := invalidArgError[SampleQuregOutcomes]
+
+
+        SampleClassicalShadow[qureg_Integer, numSamples_Integer, shadowId_Integer:-1] /; (numSamples >= 2^63) := (
             Message[SampleClassicalShadow::error, "The requested number of samples is too large, and exceeds the maximum C long integer (2^63)."];
             $Failed)
         SampleClassicalShadow[qureg_Integer, numSamples_Integer] := 
-            With[
-                {data = SampleClassicalShadowStateInternal[qureg, numSamples]},
-                If[data === $Failed, data, 
-                    Transpose[{
-                        Partition[ data[[2]], data[[1]]],
-                        Partition[ data[[3]], data[[1]]]}]]]
+            unpackClassicalShadow @ SampleClassicalShadowStateInternal[qureg, -1, numSamples]
+        SampleClassicalShadow[qureg_Integer, numSamples_Integer, shadowId_Integer] := 
+            SampleClassicalShadowStateInternal[qureg, shadowId, numSamples]
         SampleClassicalShadow[___] := invalidArgError[SampleClassicalShadow]
-
-
+        
+        (* partitions the flat {numQb, bases, outcomes} backend shadow format into {{bases,outcomes}, ...} *)
+        unpackClassicalShadow[data_] :=
+            If[data === $Failed, data, 
+                Transpose[{
+                    Partition[ data[[2]], data[[1]]],
+                    Partition[ data[[3]], data[[1]]]}]]
+        
+        isValidClassicalShadow[shadow_List] := MatchQ[Dimensions[shadow], {nSamps_, 2, nQb_}]
+        invalidClassicalShadowError[caller_] := (
+            Message[caller::error, "The classical shadow input must be a list " <>
+                "(length equal to the number of samples) of length-2 sublists, each of length equal to the number 
+                of qubits. This is the format {{{bases,outcomes}},...}, matching that output by SampleClassicalShadow[]."];
+            $Failed)
+        
+        CreateClassicalShadow[shadow_List] := 
+            If[
+                Not @ isValidClassicalShadow[shadow],
+                invalidClassicalShadowError[CreateClassicalShadow],
+                CreateClassicalShadowInternal[
+                    Length @ First @ First @ shadow, Length[shadow], 
+                    Flatten @ shadow[[All,1]], Flatten @ shadow[[All,2]]]]
+        CreateClassicalShadow[numQubits_Integer] := 
+            CreateClassicalShadowInternal[numQubits, 0, {}, {}]
+        CreateClassicalShadow[___] := invalidArgError[CreateClassicalShadow]
+        
+        GetClassicalShadow[shadowId_Integer] := 
+            unpackClassicalShadow @ GetClassicalShadowInternal[shadowId]
+        GetClassicalShadow[___] := invalidArgError[GetClassicalShadow]
+        
+        SetAttributes[DestroyClassicalShadow, HoldAll];
+        DestroyClassicalShadow[shadowId_Integer] :=
+            DestroyClassicalShadowInternal[shadowId]
+        DestroyClassicalShadow[shadowId_Symbol] :=
+            Block[{}, DestroyClassicalShadowInternal[ReleaseHold@shadowId]; Clear[shadowId]]
+        DestroyClassicalShadow[shadowId_] :=
+            DestroyClassicalShadowInternal @ ReleaseHold @ shadowId
+        DestroyClassicalShadow[___] := invalidArgError[DestroyClassicalShadow]
+
+
+        (* encodes Pauli products as {codes, targets, numPaulisPerProd} *)
+        getEncodedShadowPauliProds[prods_] := 
+            With[
+                {ops = (List @@@ prods) /. {p_:pauliCodePatt, q_Integer} :> {Subscript[p, q]}},
+                {prodPaulis = ops[[All, All, 1]] /. {X->1,Y->2,Z->3},
+                 prodQubits = ops[[All, All, 2]]},
+                {Flatten @ prodPaulis, Flatten @ prodQubits, Length /@ prodPaulis}]
+        
         CalcExpecPauliProdsFromClassicalShadow[shadow_List, prods:{__:numericCoeffPauliProdPatt}, numBatches_Integer:10] := 
             If[
-                Not @ MatchQ[Dimensions[shadow], {nSamps_, 2, nQb_}],
-                (Message[CalcExpecPauliProdsFromClassicalShadow::error, "The classical shadow input must be a list " <>
-                    "(length equal to the number of samples) of length-2 sublists, each of length equal to the number 
-                    of qubits. This is the format {{{bases,outcomes}},...}, matching that output by SampleClassicalShadow[]."];
-                    $Failed),
-                With[
-                    {ops = (List @@@ prods) /. {p_:pauliCodePatt, q_Integer} :> {Subscript[p, q]}},
-                    {numQb = Length @ First @ First @ shadow,
-                     prodPaulis = ops[[All, All, 1]] /. {X->1,Y->2,Z->3},
-                     prodQubits = ops[[All, All, 2]]},
-                    CalcExpecPauliProdsFromClassicalShadowInternal[
-                        numQb, numBatches, Length[shadow], Flatten @ shadow[[All,1]], Flatten @ shadow[[All,2]],
-                        Flatten @ prodPaulis, Flatten @ prodQubits, Length /@ prodPaulis]
-                ]
+                Not @ isValidClassicalShadow[shadow],
+                invalidClassicalShadowError[CalcExpecPauliProdsFromClassicalShadow],
+                CalcExpecPauliProdsFromClassicalShadowInternal[
+                    Length @ First @ First @ shadow, numBatches, Length[shadow], Flatten @ shadow[[All,1]], Flatten @ shadow[[All,2]],
+                    Sequence @@ getEncodedShadowPauliProds[prods]]
             ]    
+        CalcExpecPauliProdsFromClassicalShadow[shadowId_Integer, prods:{__:numericCoeffPauliProdPatt}, numBatches_Integer:10] := 
+            CalcExpecPauliProdsFromStoredClassicalShadowInternal[
+                shadowId, numBatches, Sequence @@ getEncodedShadowPauliProds[prods]]
          CalcExpecPauliProdsFromClassicalShadow[___] := invalidArgError[CalcExpecPauliProdsFromClassicalShadow]
 
     
@@ -1876,13 +2236,30 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         CreateRemoteQuESTEnv[ip_String, port1_Integer, port2_Integer] := Install @ getRemoteLink[ip, port1, port2]
         CreateRemoteQuESTEnv[___] := invalidArgError[CreateRemoteQuESTEnv]
                     
-        CreateLocalQuESTEnv[arg_:"quest_link"] := With[
-            {fn = arg <> If[$OperatingSystem === "Windows", ".exe", ""]},
-            If[
-                FileExistsQ[fn], 
-                Install[fn],  
-                Message[CreateLocalQuESTEnv::error, "Local quest_link executable not found!"]; $Failed]
+        Options[CreateLocalQuESTEnv] = {
+            "QuregAllocation" -> Automatic
+        };
+        quregAllocModes = {"default", "first-touch", "transparent-huge-pages", "huge-pages"};
+        CreateLocalQuESTEnv[arg_String:"quest_link", OptionsPattern[]] := With[
+            {fn = arg <> If[$OperatingSystem === "Windows", ".exe", ""],
+             alloc = OptionValue["QuregAllocation"]},
+            Which[
+                Not @ FileExistsQ[fn],
+                    Message[CreateLocalQuESTEnv::error, "Local quest_link executable not found!"]; $Failed,
+                alloc === Automatic,
+                    Install[fn],
+                Not @ MemberQ[quregAllocModes, alloc],
+                    Message[CreateLocalQuESTEnv::error, "Option \"QuregAllocation\" must be Automatic or one of " <> 
+                        ToString[quregAllocModes, InputForm] <> "."]; $Failed,
+                True,
+                    (* the executable inherits the variable when launched, after which it is restored *)
+                    With[{prev = Environment["QUESTLINK_QUREG_ALLOC"]},
+                        SetEnvironment["QUESTLINK_QUREG_ALLOC" -> alloc];
+                        With[{link = Install[fn]},
+                            SetEnvironment["QUESTLINK_QUREG_ALLOC" -> If[prev === $Failed, None, prev]];
+                            link]]
             ]
+        ]
         CreateLocalQuESTEnv[__] := invalidArgError[CreateLocalQuESTEnv] (* no args is valid *)
             
         getExecFn["MacOS"|"MacOSX"] = "macos_x86_quest_link";
@@ -1978,6 +2355,39 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
         SetAmp[qureg_Integer, row_Integer, col_Integer, amp_?NumericQ] := SetAmpInternal[qureg, N@Re@N@amp, N@Im@N@amp, row, col]
         SetAmp[___] := invalidArgError[SetAmp]
         
+        (* indices beyond a C long long cannot be sent through WSTP, and are anyway out of range *)
+        getAmpsIndsAreTooLarge[inds_] := (inds =!= {} && Max@Abs@inds >= 2^63)
+        
+        GetAmps[qureg_Integer, inds:({___Integer} | {{_Integer, _Integer}..})] /; getAmpsIndsAreTooLarge[inds] := (
+            Message[GetAmps::error, "An amplitude index is out of range."];
+            $Failed)
+        GetAmps[qureg_Integer, inds:{___Integer}] :=
+            With[{amps = GetAmpsInternal[qureg, inds, {}]},
+                If[amps === $Failed, $Failed, unpackComplexArray[amps]]]
+        GetAmps[qureg_Integer, inds:{{_Integer, _Integer}..}] :=
+            With[{amps = GetAmpsInternal[qureg, inds[[All,1]], inds[[All,2]]]},
+                If[amps === $Failed, $Failed, unpackComplexArray[amps]]]
+        GetAmps[___] := invalidArgError[GetAmps]
+        
+        SetAmps[qureg_Integer, inds:({___Integer} | {{_Integer, _Integer}..}), amps_List] /; getAmpsIndsAreTooLarge[inds] := (
+            Message[SetAmps::error, "An amplitude index is out of range. The qureg has not been changed."];
+            $Failed)
+        SetAmps[qureg_Integer, inds:{___Integer}, amps_List] /; VectorQ[amps, NumericQ] := 
+            SetAmpsInternal[qureg, inds, {}, N@Re@N@amps, N@Im@N@amps]
+        SetAmps[qureg_Integer, inds:{{_Integer, _Integer}..}, amps_List] /; VectorQ[amps, NumericQ] := 
+            SetAmpsInternal[qureg, inds[[All,1]], inds[[All,2]], N@Re@N@amps, N@Im@N@amps]
+        SetAmps[___] := invalidArgError[SetAmps]
+        
+        GetTopAmplitudes[qureg_Integer, k_Integer, minProb_?NumericQ:-1] /; (k < 0) := (
+            Message[GetTopAmplitudes::error, "The number of amplitudes must be a non-negative integer, or All."];
+            $Failed)
+        GetTopAmplitudes[qureg_Integer, k:(_Integer|All), minProb_?NumericQ:-1] /; (k =!= All && k >= 2^63) := 
+            GetTopAmplitudes[qureg, All, minProb]
+        GetTopAmplitudes[qureg_Integer, k:(_Integer|All), minProb_?NumericQ:-1] /; Element[minProb, Reals] :=
+            With[{top = GetTopAmplitudesInternal[qureg, k /. All -> -1, N@minProb]},
+                If[top === $Failed, $Failed, Transpose @ {top[[1]], unpackComplexArray @ top[[2]]}]]
+        GetTopAmplitudes[___] := invalidArgError[GetTopAmplitudes]
+        
         
         
         (*
@@ -2232,11 +2642,79 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                         "Input contained the following sub-expression of Pauli operators which could not be simplified: " <> 
                         ToString @ StandardForm @ uneval]]]
 
-        SimplifyPaulis[expr_] :=
-            Enclose[
-                (* immediately abort upon unrecognised sub-expression *)
-                ConfirmQuiet @ innerSimplifyPaulis @ expr,
-                (ReleaseHold @ # @ "HeldMessageCall"; $Failed) & ]
+        (* SimplifyPaulis of a numerical expression (one containing approximate scalars) is 
+         * instead evaluated by the backend's native Pauli algebra. The held expression is 
+         * encoded as a postfix program of {opcode, arg} instructions, with opcodes matching 
+         * paulis.hpp, which consume the separately sowed {opcode, qubit} Pauli operators 
+         * and scalars. Any non-numerical sub-expression throws, to fall back to the above *)
+        SetAttributes[sowNumericPauliExpr, HoldAll]
+        SetAttributes[getEncodedNumericPauliExpr, HoldAll]
+        
+        sowNumericPauliExpr[ c_?NumericQ ] := (
+            Sow[c, "Scalars"];
+            Sow[{1,0}, "Instrs"])
+        
+        sowNumericPauliExpr[ Subscript[p:pauliCodePatt, q_Integer?NonNegative] ] := (
+            Sow[{getOpCode @ p, q}, "Paulis"];
+            Sow[{0,0}, "Instrs"])
+            
+        sowNumericPauliExpr[ Power[b_, n_Integer?NonNegative] ] := (
+            sowNumericPauliExpr[b];
+            Sow[{4,n}, "Instrs"])
+            
+        (* commutators are natively computed from only the anticommuting terms *)
+        sowNumericPauliExpr[ Plus[NonCommutativeMultiply[a_, b_], Times[-1, NonCommutativeMultiply[b_, a_]]] ] := (
+            sowNumericPauliExpr[a];
+            sowNumericPauliExpr[b];
+            Sow[{5,0}, "Instrs"])
+        
+        (* products (commuting or not) are ordered as written, since the expression is held *)
+        sowNumericPauliExpr[ (h:Plus|Times|NonCommutativeMultiply)[t__] ] := (
+            List @@ (sowNumericPauliExpr /@ Hold[t]);
+            Sow[{If[h === Plus, 2, 3], Length @ Hold[t]}, "Instrs"])
+        
+        sowNumericPauliExpr[ uneval_ ] := With[
+            (* let variables evaluate, and attempt to encode their new form *)
+            {eval = uneval},
+            If[ Unevaluated[uneval] =!= eval,
+                sowNumericPauliExpr[eval],
+                Throw[$Failed, "NonNumericPauliExpr"]]]
+        
+        (* returns {numQubits, lowestQubit, instrs, paulis, scalarsRe, scalarsIm}, or $Failed if 
+         * the expression is symbolic, contains no Paulis, or is optionally exact *)
+        getEncodedNumericPauliExpr[expr_, requireInexact_:True] := Module[
+            {reaped, instrs, paulis, scalars},
+            reaped = Catch[
+                Reap[sowNumericPauliExpr[expr], {"Instrs", "Paulis", "Scalars"}],
+                "NonNumericPauliExpr"];
+            If[reaped === $Failed, Return @ $Failed];
+            {instrs, paulis, scalars} = Flatten[#, 1]& /@ Last @ reaped;
+            If[paulis === {} || (requireInexact && Not @ AnyTrue[scalars, InexactNumberQ]), Return @ $Failed];
+            {1 + Max @ paulis[[All,2]], Min @ paulis[[All,2]], 
+                Flatten @ instrs, Flatten @ paulis, Re @ N @ scalars, Im @ N @ scalars}
+        ]
+        
+        (* the identity term (which has no explicit Paulis) is returned upon the lowest input qubit *)
+        getPauliStringFromNativeEncoding[{re_List, im_List, codes_List, targs_List, numPaulisPerTerm_List}, idQubit_Integer] := 
+            With[
+                {coeffs = MapThread[If[#2 == 0, #1, #1 + I #2]&, {re, im}]},
+                {ops = MapThread[Subscript[{X,Y,Z}[[#1]], #2]&, {codes, targs}]},
+                Plus @@ (coeffs * (If[# === {}, Subscript[Id, idQubit], Times @@ #]& /@ TakeList[ops, numPaulisPerTerm]))]
+        getPauliStringFromNativeEncoding[$Failed, _] := 
+            $Failed
+        
+        simplifyNumericPaulisNatively[{numQb_, idQb_, instrs_, paulis_, scalarsRe_, scalarsIm_}] :=
+            getPauliStringFromNativeEncoding[
+                SimplifyPaulisInternal[numQb, instrs, paulis, scalarsRe, scalarsIm], idQb]
+
+        SimplifyPaulis[expr_] := With[
+            {enc = getEncodedNumericPauliExpr[expr]},
+            If[ enc =!= $Failed,
+                simplifyNumericPaulisNatively[enc],
+                Enclose[
+                    (* immediately abort upon unrecognised sub-expression *)
+                    ConfirmQuiet @ innerSimplifyPaulis @ expr,
+                    (ReleaseHold @ # @ "HeldMessageCall"; $Failed) & ]]]
 
         SimplifyPaulis[__] := invalidArgError[SimplifyPaulis]
         
@@ -5467,7 +5945,9 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
 
 
         Options[ApplyPauliTransferMap] = {
-            "CacheMaps" -> "UntilCallEnd" (* or "Forever" or "Never" *)
+            "CacheMaps" -> "UntilCallEnd", (* or "Forever" or "Never" *)
+            "MinCoefficient" -> 0,
+            "MaxPauliWeight" -> Infinity
         };
 
         (* ApplyPauliTransferMap additionally accepts all options to CalcPauliTransferMap which is called internally *)
@@ -5505,7 +5985,7 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                     (* but for gates and sub-circuits... *)
                     _, If[
                         (* if user requests caching ... *)
-                        MatchQ[cacheOpt, "Forever"|"UntilCallEnd"],
+                        MatchQ[cacheOpt, "Forever"|"UntilCallEnd"|"Native"],
 
                         (* then cache the compacted parameterised gate's PTMap *)
                         Module[{comp,rules, paramed,subs, ptmap},
@@ -5526,8 +6006,16 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
             Check[ OptionValue@"CacheMaps", Return @ $Failed];
 
             (* validate cache setting is valid *)
-            If[Not @ MemberQ[{"Forever", "UntilCallEnd", "Never"}, OptionValue@"CacheMaps"],
-                Message[caller::error, "Option \"CacheMaps\" must be one of \"Forever\", \"UntilCallEnd\" or \"Never\". See ?ApplyPauliTransferMap."]; 
+            If[Not @ MemberQ[{"Forever", "UntilCallEnd", "Never", "Native"}, OptionValue@"CacheMaps"],
+                Message[caller::error, "Option \"CacheMaps\" must be one of \"Forever\", \"UntilCallEnd\", \"Never\" or \"Native\". See ?ApplyPauliTransferMap."]; 
+                Return @ $Failed];
+
+            (* validate truncation settings *)
+            If[Not @ MatchQ[OptionValue@"MinCoefficient", _?(Internal`RealValuedNumericQ[#] && NonNegative[#] &)],
+                Message[caller::error, "Option \"MinCoefficient\" must be a non-negative real number. See ?ApplyPauliTransferMap."]; 
+                Return @ $Failed];
+            If[Not @ MatchQ[OptionValue@"MaxPauliWeight", _Integer?NonNegative | Infinity],
+                Message[caller::error, "Option \"MaxPauliWeight\" must be a non-negative integer, or Infinity. See ?ApplyPauliTransferMap."]; 
                 Return @ $Failed];
         )
 
@@ -5535,8 +6023,8 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
             Module[{cacheOpt=Opt, maps=$Failed},
                 cacheOpt = OptionValue["CacheMaps"]; (* gauranteed not to throw; prior validated *)
 
-                (* optionally pre-clear cache *)
-                If[ cacheOpt === "Never", resetCachedPTMaps[] ];
+                (* optionally pre-clear cache, including that of the backend *)
+                If[ cacheOpt === "Never", resetCachedPTMaps[]; ClearCachedPauliTransferMapsInternal[] ];
                 
                 (* attempt to precompute all maps ... *)
                 Enclose[
@@ -5547,7 +6035,7 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                       ReleaseHold @ # @ "HeldMessageCall" ) & ];
 
                 (* optionally clear cache (even if failed), then return maps (which might be $Failed) *)
-                If[ cacheOpt === "UntilCallEnd", resetCachedPTMaps[] ];
+                If[ MatchQ[cacheOpt, "UntilCallEnd"|"Native"], resetCachedPTMaps[] ];
                 maps
             ]
 
@@ -5583,12 +6071,114 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 If[ MatchQ[pauliStr, pauliOpPatt|pauliProdPatt], {{states,1}}, states]
             ]
 
+        (* flattens numerical PTMaps into {targs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs},
+         * or returns $Failed if any map is incomplete, or has symbolic or complex coefficients *)
+        getEncodedNumericPTMaps[maps:{ptmapPatt..}] := Module[
+            {targs, outs},
+            targs = (List @@@ maps[[All, 0]])[[All, 2;;]];
+            outs = MapThread[
+                Lookup[Association[List @@ #1], Range[0, 4^Length[#2] - 1], Missing[]]&, 
+                {maps, targs}];
+            If[ Not @ FreeQ[outs, Missing[]], Return @ $Failed];
+            outs = Flatten[outs, 1];
+            If[ Not @ AllTrue[Flatten @ outs[[All, All, 2]], Internal`RealValuedNumericQ], Return @ $Failed];
+            {Flatten @ targs, Length /@ targs, Length /@ outs, Flatten @ outs[[All, All, 1]], N @ Re @ Flatten @ outs[[All, All, 2]]}
+        ]
+        
+        (* numerical Pauli strings and PTMaps (which contain approximate scalars, or which are to be 
+         * truncated) are processed by the backend, which alone supports truncation. This returns 
+         * Missing["Symbolic"] if the inputs are symbolic or exact, $Failed if they cannot be truncated, 
+         * else {numQb, maxWeight, minCoeff, encodedPauliStr, encodedMaps} *)
+        getEncodedNumericPTMapSim[pauliStr_, maps:{ptmapPatt..}, caller_Symbol, opts:applyPTMapOptPatt] := Module[
+            {truncate, encStr, encMaps, maxWeight},
+            
+            maxWeight = OptionValue["MaxPauliWeight"];
+            truncate = (OptionValue["MinCoefficient"] != 0 || maxWeight =!= Infinity);
+            If[ Not[truncate] && FreeQ[{pauliStr, maps[[All, All, 2, All, 2]]}, _?InexactNumberQ], 
+                Return @ Missing["Symbolic"]];
+            
+            encStr = getEncodedNumericPauliExpr[pauliStr, False];
+            encMaps = getEncodedNumericPTMaps[maps];
+            If[ encStr === $Failed || encMaps === $Failed,
+                If[truncate,
+                    Message[caller::error, "Options \"MinCoefficient\" and \"MaxPauliWeight\" are only supported when the Pauli string and all maps are numerical."];
+                    Return @ $Failed];
+                Return @ Missing["Symbolic"]];
+            
+            {Max[First @ encStr, 1 + Max @ First @ encMaps], maxWeight /. Infinity -> -1, 
+                N @ OptionValue["MinCoefficient"], encStr[[3;;]], encMaps}
+        ]
+        
+        applyNumericPTMapsNatively[pauliStr_, maps:{ptmapPatt..}, opts:applyPTMapOptPatt] := With[
+            {enc = getEncodedNumericPTMapSim[pauliStr, maps, ApplyPauliTransferMap, opts]},
+            If[ MatchQ[enc, _Missing | $Failed], enc,
+            
+                (* the identity term targets the highest qubit, like GetPauliString[] *)
+                getPauliStringFromNativeEncoding[
+                    ApplyPauliTransferMapsInternal[
+                        enc[[1]], enc[[2]], enc[[3]], Sequence @@ enc[[4]], Sequence @@ enc[[5]]],
+                    enc[[1]] - 1]]]
+
+        (* numerical gates are propagated by the backend, which fetches their PTMaps from its persistent 
+         * cache, keyed by each compacted gate (its type, parameters and arity) and the map options. Only 
+         * the uncached maps are computed by the front-end, and passed to the backend upon a second call. 
+         * This returns Missing["Symbolic"] if the inputs are not numerical gates, else the output or $Failed *)
+        applyGatesWithNativeCachedPTMaps[pauliStr_, gates_List, opts:applyPTMapOptPatt] := Module[
+            {encStr, mapOpts, compacted, keys, keyPositions, uniqueKeys, uniqueGates, keyInds, qubits, numQb, maxWeight, minCoeff, callBackend, out, missing, maps, encMaps},
+            
+            If[ Not @ AllTrue[gates, isGateFormat], Return @ Missing["Symbolic"]];
+            encStr = getEncodedNumericPauliExpr[pauliStr, False];
+            If[ encStr === $Failed, Return @ Missing["Symbolic"]];
+            
+            (* invalid gates are left to the front-end to report *)
+            compacted = Quiet @ Check[GetCircuitCompacted /@ gates, Return @ Missing["Symbolic"]];
+            mapOpts = FilterRules[{opts}, Options @ CalcPauliTransferMap];
+            keys = ToString[{First @ #, mapOpts}, InputForm]& /@ compacted;
+            keyPositions = PositionIndex @ keys;
+            uniqueKeys = Keys @ keyPositions;
+            uniqueGates = compacted[[First /@ Values @ keyPositions, 1]];
+            keyInds = Lookup[AssociationThread[uniqueKeys -> Range[0, Length @ uniqueKeys - 1]], keys];
+            
+            (* compacted qubit q of each gate maps to its qubits[[q+1]] *)
+            qubits = compacted[[All, 2, All, 2]];
+            numQb = Max[First @ encStr, 1 + Max @ qubits];
+            maxWeight = OptionValue["MaxPauliWeight"] /. Infinity -> -1;
+            minCoeff = N @ OptionValue["MinCoefficient"];
+            
+            callBackend = ApplyCachedPauliTransferMapsInternal[
+                numQb, maxWeight, minCoeff, 
+                Sequence @@ encStr[[3;;]], uniqueKeys, keyInds, Flatten @ qubits, Length /@ qubits, ##]&;
+            
+            (* first attempt to use only the cached maps... *)
+            out = callBackend[{}, {}, {}, {}, {}, {}];
+            If[ MatchQ[out, Missing["Uncached", _]],
+            
+                (* computing those uncached (which must be numerical) before retrying *)
+                missing = Last @ out;
+                maps = Quiet @ Check[
+                    CalcPauliTransferMap[#, Sequence @@ mapOpts]& /@ uniqueGates[[missing + 1]], 
+                    Return @ Missing["Symbolic"]];
+                encMaps = If[ MatchQ[maps, {ptmapPatt..}], getEncodedNumericPTMaps[maps], $Failed];
+                If[ encMaps === $Failed, Return @ Missing["Symbolic"]];
+                out = callBackend[missing, Sequence @@ encMaps]];
+
+            (* maps still reported uncached (which the backend should prevent) fall back to the front-end *)
+            If[ MatchQ[out, _Missing], Return @ Missing["Symbolic"]];
+
+            (* the identity term targets the highest qubit, like GetPauliString[] *)
+            getPauliStringFromNativeEncoding[out, numQb - 1]
+        ]
+
         ApplyPauliTransferMap[ pauliStr_?isValidSymbolicPauliString, map:ptmapPatt, opts:OptionsPattern[] ] :=
             Module[
                 {out, scalars},
 
                 (* we don't actually use the options (they inform PTMap gen), but we still validate them *)
                 Check[ validatePauliTransferMapOptions[ApplyPauliTransferMap, opts], Return @ $Failed];
+                
+                (* numerical inputs are natively propagated *)
+                out = applyNumericPTMapsNatively[pauliStr, {map}, opts];
+                If[ out =!= Missing["Symbolic"], Return @ out ];
 
                 (* apply the PTM to each input pauli product ... *)
                 out = Plus @@ Flatten[ Table[
@@ -5630,6 +6220,10 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 (* we don't use nor pass on the options (they inform PTMap gen), but we still validate them  *)
                 Check[ validatePauliTransferMapOptions[ApplyPauliTransferMap, opts], Return @ $Failed];
 
+                (* numerical inputs are natively propagated through all maps at once *)
+                With[{out = applyNumericPTMapsNatively[pauliStr, maps, opts]},
+                    If[ out =!= Missing["Symbolic"], Return @ out ]];
+
                 (* apply each map in turn to the growing pauli string, and simplify the end result *)
                 SimplifyPaulis @ Fold[ApplyPauliTransferMap, pauliStr, maps]
             )
@@ -5639,11 +6233,16 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 (* validate the options *)
                 Check[ validatePauliTransferMapOptions[ApplyPauliTransferMap, opts], Return @ $Failed];
 
+                (* numerical gates may be natively propagated using the persistent backend cache *)
+                If[ OptionValue["CacheMaps"] === "Native",
+                    With[{out = applyGatesWithNativeCachedPTMaps[pauliStr, mixed, opts]},
+                        If[ out =!= Missing["Symbolic"], Return @ out ]]];
+
                 (* validate and pre-compute all PTMaps, managing all caching *)
                 maps = Check[ getAndValidateAllGatesAsPTMaps[mixed, ApplyPauliTransferMap, opts], Return @ $Failed ];
 
-                (* obtain output pauli string; no options need to be propogated *)
-                ApplyPauliTransferMap[pauliStr, maps]]
+                (* obtain output pauli string; only the truncation options need to be propogated *)
+                ApplyPauliTransferMap[pauliStr, maps, Sequence @@ FilterRules[{opts}, {"MinCoefficient", "MaxPauliWeight"}]]]
 
         ApplyPauliTransferMap[ pauliStr_, gate_?isGateFormat, opts___ ] :=
             (* permit passing single gate for user convenience *)
@@ -5694,6 +6293,34 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 layers
             ]
 
+        (* receives each layer of a natively computed evaluation graph as the backend streams 
+         * it, converting it into the "Simple" format (see getSimplePTMapEvaluationGraph) *)
+        appendPTEvalLayer[numQb_Integer, digits_List, ids_List, numParents_List, parentIds_List, factorsRe_List, factorsIm_List] :=
+            AppendTo[ptEvalLayers, If[ ids === {}, {},
+                Transpose @ {
+                    Partition[digits, numQb], 
+                    ids,
+                    TakeList[
+                        Transpose @ {parentIds, MapThread[If[#2 == 0, #1, #1 + I #2]&, {factorsRe, factorsIm}]}, 
+                        numParents]}]]
+
+        (* numerical inputs are evaluated natively, with optional per-layer pruning. This returns 
+         * Missing["Symbolic"] if the inputs are symbolic or exact, else the "Simple" graph or $Failed *)
+        getNumericPTMapEvaluationGraphNatively[pauliStr_, maps:{ptmapPatt..}, mergeStates_, opts___] := Module[
+            {enc, numLayers},
+            enc = getEncodedNumericPTMapSim[pauliStr, maps, CalcPauliTransferEval, 
+                Sequence @@ FilterRules[{opts}, Options @ ApplyPauliTransferMap]];
+            If[ MatchQ[enc, _Missing | $Failed], Return @ enc];
+            
+            ptEvalLayers = {};
+            numLayers = CalcPauliTransferEvalInternal[
+                enc[[1]], Boole @ mergeStates, enc[[2]], enc[[3]], Sequence @@ enc[[4]], Sequence @@ enc[[5]]];
+            If[ numLayers === $Failed, Return @ $Failed];
+            
+            (* release the streamed layers *)
+            With[{layers = ptEvalLayers}, ptEvalLayers = {}; layers]
+        ]
+
         getDetailedPTMapEvaluationGraph[simpleGraph_, include_List:Automatic] := 
             Module[
                 {data=<||>, states, isIncluded},
@@ -5729,7 +6356,11 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 If[ isIncluded @ "Parents",
                     data["Parents"] = <|Table[ s[[2]] -> s[[3,All,1]] /. 0->Nothing, {s,states} ]|> ];
                 If[ isIncluded @ "Children",
-                    data["Children"] = <|Table[ s[[2]] -> Cases[states, c_?(MemberQ[#[[3,All,1]],s[[2]]]&):>c[[2]]], {s,states} ]|> ];
+                    (* inverts every node's parent list in one pass, rather than searching all states per node *)
+                    data["Children"] = Merge[{
+                        <|Table[ s[[2]] -> {}, {s,states} ]|>,
+                        GroupBy[ Flatten[Table[ {p, s[[2]]}, {s,states}, {p, s[[3,All,1]]} ], 1], First -> Last ]},
+                        Apply[Join]] ~KeyDrop~ 0 ];
 
                 (* <| id -> <|id->(expr), id->(expr)|> ... |> *)
                 If[ isIncluded @ "ParentFactors",
@@ -5799,9 +6430,12 @@ Unlike UNonNorm, the given matrix is not internally treated as a unitary matrix.
                 (* validate options (including those for inner functions like CalcPauliTransferMap) *)
                 Check[validateCalcPauliTransferEvalOptions[CalcPauliTransferEval, opts], Return @ $Failed];
 
-                (* compute simple evaluation graph *)
-                inStates = getPauliStringInitStatesForPTMapSim[pauliStr, maps];
-                outEval = getSimplePTMapEvaluationGraph[inStates, maps, OptionValue @ "CombineStrings"];
+                (* compute simple evaluation graph, natively when numerical *)
+                outEval = getNumericPTMapEvaluationGraphNatively[pauliStr, maps, OptionValue @ "CombineStrings", opts];
+                If[ outEval === $Failed, Return @ $Failed];
+                If[ MatchQ[outEval, _Missing],
+                    inStates = getPauliStringInitStatesForPTMapSim[pauliStr, maps];
+                    outEval = getSimplePTMapEvaluationGraph[inStates, maps, OptionValue @ "CombineStrings"]];
 
                 (* optionally post-process graph *)
                 If[ OptionValue @ "OutputForm" === "Detailed",
@@ -0,0 +1,329 @@
+/** @file
+ * Contains the native saving and loading of quregs to and from binary checkpoint
+ * files, which avoids sending (potentially enormous) states through WSTP.
+ *
+ * @author Tyson Jones
+ */
+
+#include "QuEST.h"
+
+#include "checkpoints.hpp"
+#include "errors.hpp"
+#include "link.hpp"
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+
+#include "extensions.hpp"
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+
+
+/*
+ * The layout of the checkpoint file header, which precedes the real then imaginary
+ * components of the amplitudes. The header size keeps the amplitudes aligned.
+ */
+#define CHECKPOINT_MAGIC "QuESTlnk"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER_NUM_BYTES 32
+
+/*
+ * The number of bytes of amplitudes written by each thread at a time
+ */
+#define CHECKPOINT_CHUNK_NUM_BYTES (1LL << 26)
+
+
+
+struct CheckpointHeader {
+    char magic[8];
+    int version;
+    int numQubits;
+    int isDensityMatrix;
+    int numBytesPerReal;
+    long long int numAmps;
+};
+
+void local_setHeaderBytes(char* bytes, CheckpointHeader header) {
+
+    // fields are copied individually, to avoid dependence on struct padding
+    memcpy(bytes,      header.magic,            8);
+    memcpy(bytes + 8,  &header.version,         4);
+    memcpy(bytes + 12, &header.numQubits,       4);
+    memcpy(bytes + 16, &header.isDensityMatrix, 4);
+    memcpy(bytes + 20, &header.numBytesPerReal, 4);
+    memcpy(bytes + 24, &header.numAmps,         8);
+}
+
+CheckpointHeader local_getHeaderFromBytes(const char* bytes) {
+
+    CheckpointHeader header;
+    memcpy(header.magic,            bytes,      8);
+    memcpy(&header.version,         bytes + 8,  4);
+    memcpy(&header.numQubits,       bytes + 12, 4);
+    memcpy(&header.isDensityMatrix, bytes + 16, 4);
+    memcpy(&header.numBytesPerReal, bytes + 20, 4);
+    memcpy(&header.numAmps,         bytes + 24, 8);
+    return header;
+}
+
+/* @throws QuESTException if the header is malformed or incompatible with this
+ *      build, or disagrees with the total number of bytes in the file
+ */
+void local_throwExcepIfInvalidHeader(CheckpointHeader header, long long int numFileBytes) {
+
+    if (memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0)
+        throw QuESTException("", "The file is not a QuESTlink qureg checkpoint."); // throws
+    if (header.version != CHECKPOINT_VERSION)
+        throw QuESTException("", "The checkpoint file format (version " + std::to_string(header.version) +
+            ") is unsupported by this QuESTlink (version " + std::to_string(CHECKPOINT_VERSION) + ")."); // throws
+    if (header.numBytesPerReal != (int) sizeof(qreal))
+        throw QuESTException("", "The checkpoint was saved with a precision of " + std::to_string(header.numBytesPerReal) +
+            " bytes per real number, but this QuESTlink uses " + std::to_string(sizeof(qreal)) + "."); // throws
+
+    // the file's amplitude bytes are divided (rather than numAmps multiplied) to avoid overflow
+    int numBits = header.numQubits * ((header.isDensityMatrix)? 2 : 1);
+    long long int numAmpBytes = numFileBytes - CHECKPOINT_HEADER_NUM_BYTES;
+    long long int numBytesPerAmp = 2 * (long long int) sizeof(qreal);
+    if (header.numQubits < 1 || numBits > 62 ||
+        (header.isDensityMatrix != 0 && header.isDensityMatrix != 1) ||
+        header.numAmps != (1LL << numBits) ||
+        numAmpBytes < 0 || numAmpBytes % numBytesPerAmp != 0 ||
+        numAmpBytes / numBytesPerAmp != header.numAmps)
+        throw QuESTException("", "The checkpoint file is malformed or truncated."); // throws
+}
+
+std::string local_getFileErrorMessage(std::string action, std::string path) {
+    return "Could not " + action + " file \"" + path + "\" (" + std::string(strerror(errno)) + ").";
+}
+
+
+
+void local_saveQuregToFile(Qureg qureg, std::string path) {
+
+    // the amplitudes are written from RAM
+    copyStateFromGPU(qureg); // does nothing on CPU
+
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+    header.version = CHECKPOINT_VERSION;
+    header.numQubits = qureg.numQubitsRepresented;
+    header.isDensityMatrix = qureg.isDensityMatrix;
+    header.numBytesPerReal = sizeof(qreal);
+    header.numAmps = qureg.numAmpsTotal;
+
+    char headerBytes[CHECKPOINT_HEADER_NUM_BYTES] = {0};
+    local_setHeaderBytes(headerBytes, header);
+
+    long long int numAmpBytes = qureg.numAmpsTotal * (long long int) sizeof(qreal);
+
+#ifndef _WIN32
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        throw QuESTException("", local_getFileErrorMessage("create", path)); // throws
+
+    // a failed write removes the partial file, unless the path is not a regular file (like a device)
+    struct stat info;
+    bool isRegularFile = (fstat(fd, &info) == 0 && S_ISREG(info.st_mode));
+
+    // the real and imaginary components are divided into chunks, written concurrently at their offsets
+    long long int numChunksPerArr = (numAmpBytes + CHECKPOINT_CHUNK_NUM_BYTES - 1) / CHECKPOINT_CHUNK_NUM_BYTES;
+    long long int numChunks = 2 * numChunksPerArr;
+    char* reBytes = (char*) qureg.stateVec.real;
+    char* imBytes = (char*) qureg.stateVec.imag;
+
+    // the first failure (by any thread) is recorded, and stops the other threads' writes. A
+    // write of no bytes sets no errno, so is reported as an IO error
+    ssize_t numWritten = pwrite(fd, headerBytes, CHECKPOINT_HEADER_NUM_BYTES, 0);
+    int writeFailed = (numWritten != CHECKPOINT_HEADER_NUM_BYTES);
+    int writeErrno = (numWritten < 0)? errno : EIO;
+    int isFailed;
+    long long int c, arrOffset, numBytes;
+    char* bytes;
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (fd, numChunks,numChunksPerArr, numAmpBytes, reBytes,imBytes, writeFailed,writeErrno) \
+    private  (c, arrOffset,numBytes, bytes, numWritten, isFailed)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (dynamic)
+# endif
+        for (c=0; c<numChunks; c++) {
+            arrOffset = (c % numChunksPerArr) * CHECKPOINT_CHUNK_NUM_BYTES;
+            numBytes = std::min(CHECKPOINT_CHUNK_NUM_BYTES, numAmpBytes - arrOffset);
+            bytes = ((c < numChunksPerArr)? reBytes : imBytes) + arrOffset;
+            off_t fileOffset = CHECKPOINT_HEADER_NUM_BYTES + ((c < numChunksPerArr)? 0 : numAmpBytes) + arrOffset;
+
+            // pwrite may write fewer bytes than requested
+            while (numBytes > 0) {
+# ifdef _OPENMP
+# pragma omp atomic read
+# endif
+                isFailed = writeFailed;
+                if (isFailed)
+                    break;
+
+                numWritten = pwrite(fd, bytes, numBytes, fileOffset);
+                if (numWritten <= 0) {
+# ifdef _OPENMP
+# pragma omp critical (checkpointWriteFailure)
+# endif
+                    {
+                        if (!writeFailed)
+                            writeErrno = (numWritten < 0)? errno : EIO;
+# ifdef _OPENMP
+# pragma omp atomic write
+# endif
+                        writeFailed = 1;
+                    }
+                    break;
+                }
+                bytes += numWritten;
+                fileOffset += numWritten;
+                numBytes -= numWritten;
+            }
+        }
+    }
+
+    if (writeFailed) {
+        errno = writeErrno; // of the failed thread
+        std::string msg = local_getFileErrorMessage("write", path);
+        close(fd);
+        if (isRegularFile)
+            unlink(path.c_str());
+        throw QuESTException("", msg); // throws
+    }
+    if (close(fd) != 0) {
+        std::string msg = local_getFileErrorMessage("write", path);
+        if (isRegularFile)
+            unlink(path.c_str());
+        throw QuESTException("", msg); // throws
+    }
+
+#else
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL)
+        throw QuESTException("", local_getFileErrorMessage("create", path)); // throws
+
+    bool writeFailed =
+        fwrite(headerBytes, 1, CHECKPOINT_HEADER_NUM_BYTES, file) != CHECKPOINT_HEADER_NUM_BYTES ||
+        fwrite(qureg.stateVec.real, sizeof(qreal), qureg.numAmpsTotal, file) != (size_t) qureg.numAmpsTotal ||
+        fwrite(qureg.stateVec.imag, sizeof(qreal), qureg.numAmpsTotal, file) != (size_t) qureg.numAmpsTotal;
+
+    if (fclose(file) != 0 || writeFailed) {
+        std::string msg = local_getFileErrorMessage("write", path);
+        remove(path.c_str());
+        throw QuESTException("", msg); // throws
+    }
+
+#endif
+}
+
+
+
+Qureg local_loadQuregFromFile(std::string path) {
+
+    Qureg qureg;
+
+#ifndef _WIN32
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw QuESTException("", local_getFileErrorMessage("open", path)); // throws
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        std::string msg = local_getFileErrorMessage("open", path);
+        close(fd);
+        throw QuESTException("", msg); // throws
+    }
+    long long int numFileBytes = (long long int) info.st_size;
+    if (numFileBytes < CHECKPOINT_HEADER_NUM_BYTES) {
+        close(fd);
+        throw QuESTException("", "The file is not a QuESTlink qureg checkpoint."); // throws
+    }
+
+    // the mapping remains valid after the descriptor is closed
+    void* map = mmap(NULL, numFileBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        throw QuESTException("", local_getFileErrorMessage("memory-map", path)); // throws
+
+    try {
+        CheckpointHeader header = local_getHeaderFromBytes((char*) map);
+        local_throwExcepIfInvalidHeader(header, numFileBytes); // throws
+
+        madvise(map, numFileBytes, MADV_SEQUENTIAL);
+
+        qureg = (header.isDensityMatrix)?
+            local_createDensityQureg(header.numQubits):
+            local_createQureg(header.numQubits); // throws
+
+        // threads fault-in the file pages as they copy their partition of the amplitudes
+        qreal* ampsRe = (qreal*) ((char*) map + CHECKPOINT_HEADER_NUM_BYTES);
+        qreal* ampsIm = ampsRe + header.numAmps;
+        extension_setAmpRange(qureg, 0, header.numAmps, ampsRe, ampsIm);
+
+    } catch (QuESTException&) {
+        munmap(map, numFileBytes);
+        throw;
+    }
+
+    munmap(map, numFileBytes);
+
+#else
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+        throw QuESTException("", local_getFileErrorMessage("open", path)); // throws
+
+    char headerBytes[CHECKPOINT_HEADER_NUM_BYTES];
+    long long int numFileBytes = -1;
+    if (fread(headerBytes, 1, CHECKPOINT_HEADER_NUM_BYTES, file) == CHECKPOINT_HEADER_NUM_BYTES &&
+        _fseeki64(file, 0, SEEK_END) == 0)
+        numFileBytes = _ftelli64(file);
+
+    try {
+        if (numFileBytes < CHECKPOINT_HEADER_NUM_BYTES)
+            throw QuESTException("", "The file is not a QuESTlink qureg checkpoint."); // throws
+
+        CheckpointHeader header = local_getHeaderFromBytes(headerBytes);
+        local_throwExcepIfInvalidHeader(header, numFileBytes); // throws
+
+        qureg = (header.isDensityMatrix)?
+            local_createDensityQureg(header.numQubits):
+            local_createQureg(header.numQubits); // throws
+
+        // read directly into the qureg's RAM, before updating any GPU memory
+        _fseeki64(file, CHECKPOINT_HEADER_NUM_BYTES, SEEK_SET);
+        if (fread(qureg.stateVec.real, sizeof(qreal), header.numAmps, file) != (size_t) header.numAmps ||
+            fread(qureg.stateVec.imag, sizeof(qreal), header.numAmps, file) != (size_t) header.numAmps) {
+            local_destroyQureg(qureg);
+            throw QuESTException("", local_getFileErrorMessage("read", path)); // throws
+        }
+        copyStateToGPU(qureg); // does nothing on CPU
+
+    } catch (QuESTException&) {
+        fclose(file);
+        throw;
+    }
+
+    fclose(file);
+
+#endif
+
+    return qureg;
+}
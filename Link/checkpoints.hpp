@@ -0,0 +1,32 @@
+
+#ifndef CHECKPOINTS_H
+#define CHECKPOINTS_H
+
+#include "QuEST.h"
+
+#include <string>
+
+
+
+/** Writes qureg to a binary checkpoint file at path, overwriting any existing
+ * file. The file contains a fixed-size header of the qureg's number of qubits,
+ * type and precision (see checkpoints.cpp), followed by the real then imaginary
+ * components of its flat (column-major, for density matrices) amplitudes, in
+ * native byte order. The amplitudes are written by multiple threads in chunks,
+ * where supported.
+ * @throws QuESTException if the file cannot be written
+ */
+void local_saveQuregToFile(Qureg qureg, std::string path); // throws
+
+/** Returns a new qureg (created via local_createQureg() or local_createDensityQureg())
+ * populated from the binary checkpoint file at path, as written by
+ * local_saveQuregToFile(). The file is memory-mapped (where supported) and copied
+ * into the qureg by multiple threads.
+ * @throws QuESTException if the file cannot be read, is malformed, or was saved
+ *      with a different precision, in which case no qureg is created
+ */
+Qureg local_loadQuregFromFile(std::string path); // throws
+
+
+
+#endif // CHECKPOINTS_H
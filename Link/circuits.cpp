@@ -5,6 +5,7 @@
  */
  
 #include <math.h>
+#include <chrono>
 
 #include "wstp.h"
 #include "QuEST.h"
@@ -16,6 +17,7 @@
 #include "extensions.hpp"
 #include "link.hpp"
 #include "derivatives.hpp"
+#include "jobs.hpp"
 #include "utilities.hpp"
 
 
@@ -32,11 +34,19 @@
  */
 #define CALC_PROGRESS_VAR "QuEST`Private`calcProgressVar"
 
+/*
+ * The minimum period between progress updates of the front-end, each of which 
+ * is a full round trip
+ */
+#define PROGRESS_UPDATE_MIN_PERIOD_MS 100
+
+std::chrono::steady_clock::time_point lastProgressUpdateTime;
+
 
 
 int* local_prepareCtrlCache(int* ctrls, int numCtrls, int addTarg) {
     
-    static int ctrlCache[MAX_NUM_TARGS_CTRLS]; 
+    static thread_local int ctrlCache[MAX_NUM_TARGS_CTRLS]; 
     for (int i=0; i < numCtrls; i++)
         ctrlCache[i] = ctrls[i];
     if (addTarg != -1)
@@ -46,7 +56,7 @@ int* local_prepareCtrlCache(int* ctrls, int numCtrls, int addTarg) {
 
 pauliOpType* local_preparePauliCache(pauliOpType pauli, int numPaulis) {
     
-    static pauliOpType pauliCache[MAX_NUM_TARGS_CTRLS]; 
+    static thread_local pauliOpType pauliCache[MAX_NUM_TARGS_CTRLS]; 
     for (int i=0; i < numPaulis; i++)
         pauliCache[i] = pauli;
     return pauliCache;
@@ -54,7 +64,7 @@ pauliOpType* local_preparePauliCache(pauliOpType pauli, int numPaulis) {
 
 pauliOpType* local_preparePauliCache(qreal* paulis, int numPaulis) {
     
-    static pauliOpType pauliCache[MAX_NUM_TARGS_CTRLS]; 
+    static thread_local pauliOpType pauliCache[MAX_NUM_TARGS_CTRLS]; 
     for (int p=0; p < numPaulis; p++) {
         if ((int) paulis[p] == OPCODE_Id)
             pauliCache[p] = PAULI_I;
@@ -64,13 +74,54 @@ pauliOpType* local_preparePauliCache(qreal* paulis, int numPaulis) {
     return pauliCache;
 }
 
+/* Measures the qubit as does QuEST's measure(), but draws the outcome from the calling 
+ * thread's own generator (see utilities.cpp) rather than QuEST's global generator, which 
+ * the main thread and a job's worker thread could otherwise use concurrently.
+ * @throws QuESTException if the qubit is invalid
+ */
+int local_measure(Qureg qureg, int qubit) {
+    
+    qreal zeroProb = calcProbOfOutcome(qureg, qubit, 0); // throws
+    
+    // an (almost) impossible outcome is never chosen, as per QuEST
+    int outcome;
+    if (zeroProb < REAL_EPS)
+        outcome = 1;
+    else if (1 - zeroProb < REAL_EPS)
+        outcome = 0;
+    else {
+        qreal probs[] = {zeroProb, 1 - zeroProb};
+        outcome = local_getRandomIndex(probs, 2);
+    }
+    
+    qreal outcomeProb = (outcome == 0)? zeroProb : 1 - zeroProb;
+    if (qureg.isDensityMatrix)
+        densmatr_collapseToKnownProbOutcome(qureg, qubit, outcome, outcomeProb);
+    else
+        statevec_collapseToKnownProbOutcome(qureg, qubit, outcome, outcomeProb);
+    return outcome;
+}
+
 
 
 /* updates the CALC_PROGRESS_VAR in the front-end with the new passed value 
  * which must lie in [0, 1]. This can be used to indicate progress of a long 
- * evaluation to the user 
+ * evaluation to the user. Updates are throttled to at most one per 
+ * PROGRESS_UPDATE_MIN_PERIOD_MS (except for completion), so this may be called freely
  */
 void local_updateCircuitProgress(qreal progress) {
+    
+    // asynchronous jobs instead record their progress for JobStatus[]
+    Job* job = local_getCurrentJob();
+    if (job != NULL) {
+        job->progress = progress;
+        return;
+    }
+    
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (progress < 1 && now - lastProgressUpdateTime < std::chrono::milliseconds(PROGRESS_UPDATE_MIN_PERIOD_MS))
+        return;
+    lastProgressUpdateTime = now;
 
     // send new packet to MMA
     WSPutFunction(stdlink, "EvaluatePacket", 1);
@@ -765,7 +816,7 @@ void Gate::applyTo(Qureg qureg, qreal* outputs) {
                 
             case OPCODE_M:
                 for (int q=0; q < numTargs; q++) {
-                    int outcome = measure(qureg, targs[q]);
+                    int outcome = local_measure(qureg, targs[q]); // throws
                     if (outputs != NULL)
                         outputs[q] = (qreal) outcome;
                 }
@@ -1069,21 +1120,23 @@ bool Gate::isInvertible() {
         case OPCODE_Fac : 
             return local_isNonZero(params[0]*params[0] + params[1]*params[1]);
         
+        // channels are invertible when the smallest eigenvalue of their superoperator
+        // (the below factor) is not near zero
         case OPCODE_Deph :
             if (numTargs == 1)
-                return local_isNonZero(1 - 2*params[0]);
+                return local_isInvertibleFactor(1 - 2*params[0]);
             if (numTargs == 2)
-                return local_isNonZero(3 - 4*params[0]);
+                return local_isInvertibleFactor(1 - 4*params[0]/3);
         
         case OPCODE_Depol :
             if (numTargs == 1)
-                return local_isNonZero(3 - 4*params[0]);
+                return local_isInvertibleFactor(1 - 4*params[0]/3);
             if (numTargs == 2)
-                return local_isNonZero(15 - 16*params[0]);
+                return local_isInvertibleFactor(1 - 16*params[0]/15);
         
         case OPCODE_Damp :
             if (numTargs == 1)
-                return local_isNonZero(1 - params[0]);
+                return local_isInvertibleFactor(1 - params[0]);
         
         case OPCODE_Kraus :
         case OPCODE_KrausNonTP :
@@ -1136,7 +1189,7 @@ void Gate::applyInverseTo(Qureg qureg) {
         throw QuESTException(getSyntax(), 
             "The inverse of this non-invertible operator was requested. " 
             "This may be because the operator is always non-invertible (like a projector), or only non-invertible with "
-            "its given parameters (for instance, because it is a maximally mixing channel)."); // throws
+            "its given parameters (for instance, because it is a maximally or near-maximally mixing channel, which is too ill-conditioned to invert accurately)."); // throws
     
     if (isUnitary()) { // throws
         applyDaggerTo(qureg); // throws
@@ -1510,16 +1563,19 @@ bool Circuit::isTracePreserving() {
     return true;
 }
 
-void Circuit::applyTo(Qureg qureg, qreal* outputs, bool showProgress) {
+void Circuit::applyTo(Qureg qureg, qreal* outputs, bool showProgress, int* numAppliedGates) {
     
     int outInd = 0;
     
     for (int gateInd=0; gateInd < numGates; gateInd++) {
         
-        // halt if the user has tried to abort
+        if (numAppliedGates != NULL)
+            *numAppliedGates = gateInd;
+        
+        // halt if the user has tried to abort (polling is throttled, so cheap per gate)
         local_throwExcepIfUserAborted(); // throws
         
-        // display progress to the user
+        // display progress to the user (also throttled)
         if (showProgress)
             local_updateCircuitProgress(gateInd / (qreal) numGates);
 
@@ -1530,6 +1586,9 @@ void Circuit::applyTo(Qureg qureg, qreal* outputs, bool showProgress) {
         outInd += gate.getNumOutputs();
     }
     
+    if (numAppliedGates != NULL)
+        *numAppliedGates = numGates;
+    
     // display progress to the user
     if (showProgress)
         local_updateCircuitProgress(1);
@@ -1601,6 +1660,7 @@ Circuit::~Circuit() {
     
     freeMMA();
     delete[] gates;
+    delete[] qubits;
 }
 
 
@@ -1609,85 +1669,238 @@ Circuit::~Circuit() {
  * interfacing 
  */
 
-void internal_applyCircuit(int id, int storeBackup, int showProgress) {
+/* The application of a circuit to a qureg, which is restored upon error if a backup 
+ * was requested, either by undoing the applied gates or by cloning a backup qureg.
+ */
+class ApplyCircuitJob : public Job {
+    public:
+        
+        Circuit circ;
+        int id;
+        Qureg qureg;
+        bool storeBackup;
+        bool undoOnError;
+        bool cloneBackup;
+        bool showProgress;
+        Qureg backup;
+        bool backupCreated;
+        qreal* outputs;
+        
+        ApplyCircuitJob() : Job("ApplyCircuit") {
+            backupCreated = false;
+            outputs = NULL;
+        }
+        
+        ~ApplyCircuitJob() {
+            free(outputs);
+            if (backupCreated)
+                local_destroyQureg(backup);
+        }
+        
+        void compute() {
+            
+            // attempt to apply circuit
+            int numAppliedGates = 0;
+            try {
+                circ.applyTo(qureg, outputs, showProgress, &numAppliedGates); // throws
+                
+            // but if circuit application fails...
+            } catch (QuESTException& err) {
+                
+                // restore backup (if made)
+                bool isRestored = storeBackup;
+                if (cloneBackup)
+                    cloneQureg(qureg, backup);
+                if (undoOnError) {
+                    try {
+                        circ.applyInverseSubTo(qureg, 0, numAppliedGates); // throws
+                    } catch (QuESTException&) {
+                        isRestored = false;
+                    }
+                }
+                    
+                // prepare error message
+                std::string backupNotice;
+                if (isRestored && undoOnError)
+                    backupNotice = " The qureg (id " + std::to_string(id) + 
+                        ") has been restored to its prior state (to within numerical precision) by undoing the applied gates.";
+                else if (isRestored)
+                     backupNotice = " The qureg (id " + std::to_string(id) + 
+                        ") has been restored to its prior state.";
+                else if (storeBackup)
+                    backupNotice = " The applied gates could not be undone, so the qureg (id " + std::to_string(id) + 
+                        ") is now in an unknown state, and should be reinitialised.";
+                else
+                    backupNotice = " Since no backup was stored, the qureg (id " + std::to_string(id) + 
+                        ") is now in an unknown state, and should be reinitialised.";
+                
+                throw QuESTException(err.thrower, err.message + backupNotice); // throws
+            }
+        }
+        
+        void sendResultToMMA() {
+            circ.sendOutputsToMMA(outputs);
+        }
+};
+
+void internal_applyCircuit(int id, int storeBackup, int showProgress, int async) {
     const std::string apiFuncName = "ApplyCircuit";
     
-    // load circuit description (local so no need to explicitly delete)
-    Circuit circ;
-    circ.loadFromMMA();
+    // load circuit description (freed when the job is deleted)
+    ApplyCircuitJob* job = new ApplyCircuitJob();
+    job->circ.loadFromMMA();
+    
+    // an invertible circuit is backed up by undoing its applied gates upon error, 
+    // rather than by cloning the (potentially enormous) qureg beforehand
+    bool undoOnError = false;
+    if (storeBackup) {
+        try {
+            undoOnError = job->circ.isInvertible(); // throws
+        } catch (QuESTException&) {
+            // malformed gates are instead reported by applyTo(), with a cloned backup
+        }
+    }
+    bool cloneBackup = storeBackup && !undoOnError;
     
     // ensure qureg exists, else clean-up and exit
     // (must do this after loading from MMA so those packets are flushed)
     try {
         local_throwExcepIfQuregNotCreated(id); // throws
+        
+        // ensure the backup will fit within the memory budget
+        if (cloneBackup)
+            local_throwExcepIfExceedsMemoryBudget(local_getQuregNumBytes(quregs[id])); // throws
+        
     } catch (QuESTException& err) {
         local_sendErrorAndFail(apiFuncName, err.message);
+        delete job;
         return;
     }
     
-    // optionally prepare a backup state
-    Qureg qureg = quregs[id];
-    Qureg backup;
-    if (storeBackup)
-        backup = createCloneQureg(qureg, env); // must later free
+    job->id = id;
+    job->qureg = quregs[id];
+    job->storeBackup = storeBackup;
+    job->undoOnError = undoOnError;
+    job->cloneBackup = cloneBackup;
+    job->quregIds.push_back(id);
+    
+    // asynchronous jobs always record their progress
+    job->showProgress = showProgress || async;
+    
+    // optionally prepare a backup state (reusing a pooled qureg when possible)
+    if (cloneBackup) {
+        try {
+            job->backup = local_createCloneQureg(job->qureg); // throws
+        } catch (QuESTException& err) {
+            local_sendErrorAndFail(apiFuncName, err.message);
+            delete job;
+            return;
+        }
+        job->backupCreated = true;
+    }
     
     // prepare gate output cache
-    qreal* outputs = (qreal*) malloc(circ.getTotalNumOutputs() * sizeof *outputs);
+    job->outputs = (qreal*) malloc(job->circ.getTotalNumOutputs() * sizeof *job->outputs);
     
-    // attempt to apply circuit and send outputs to MMA
-    try {
-        circ.applyTo(qureg, outputs, showProgress); // throws
-        
-        circ.sendOutputsToMMA(outputs);
+    // apply circuit and send outputs to MMA, now or upon JobResult[]
+    local_runJob(job, async);
+}
+
+/* The Monte Carlo estimation of the expected value of a Hamiltonian under a channel 
+ * (or the exact value, when every decomposition is enumerated).
+ */
+class SampleExpecPauliStringJob : public Job {
+    public:
+        
+        Circuit circ;
+        PauliHamil hamil;
+        bool hamilLoaded;
+        Qureg initQureg;
+        Qureg workState1;
+        Qureg workHamil2;
+        bool workQuregsCreated;
+        long numSamples;
+        bool useAllDecomps;
+        bool showProgress;
+        qreal expecVal;
+        
+        SampleExpecPauliStringJob() : Job("SampleExpecPauliString") {
+            hamilLoaded = false;
+            workQuregsCreated = false;
+        }
         
-    // but if circuit application fails...
-    } catch (QuESTException& err) {
+        ~SampleExpecPauliStringJob() {
+            if (hamilLoaded)
+                local_freePauliHamil(hamil);
+            if (workQuregsCreated) {
+                local_destroyQureg(workState1);
+                local_destroyQureg(workHamil2);
+            }
+        }
         
-        // restore backup (if made)
-        if (storeBackup)
-            cloneQureg(qureg, backup);
+        void compute() {
             
-        // prepare error message
-        std::string backupNotice;
-        if (storeBackup)
-             backupNotice = " The qureg (id " + std::to_string(id) + 
-                ") has been restored to its prior state.";
-        else
-            backupNotice = " Since no backup was stored, the qureg (id " + std::to_string(id) + 
-                ") is now in an unknown state, and should be reinitialised.";
+            qreal expecValSum = 0;
+            qreal compen = 0;
+            
+            for (long n=0; n<numSamples; n++) {
+                
+                // halt if the user has tried to abort (polling is throttled, so cheap per sample)
+                local_throwExcepIfUserAborted(); // throws
+                
+                // display progress to the user (also throttled)
+                if (showProgress)
+                    local_updateCircuitProgress(n / (qreal) numSamples);
+                
+                cloneQureg(workState1, initQureg);
+
+                qreal fac = 1;
+                if (useAllDecomps)
+                    fac = circ.applyDecompTo(workState1, n); // throws
+                else
+                    circ.applyDecompTo(workState1); // throws
+                                
+                qreal sample = fac * calcExpecPauliHamil(workState1, hamil, workHamil2); // throws
+                
+                // aggregate through Kahan summation, to mitigate numerical error
+                qreal tmp1 = sample - compen;
+                qreal tmp2 = expecValSum + tmp1;
+                compen = (tmp2 - expecValSum) - tmp1;
+                expecValSum = tmp2;
+            }
+            
+            // average energy (if random), else determined energy
+            expecVal = expecValSum / ((useAllDecomps)? 1 : numSamples);
+        }
         
-        // send error to Mathematica
-        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower,  err.message + backupNotice);
-    }
-    
-    // clean-up regardless of error state
-    free(outputs);
-    if (storeBackup)
-        destroyQureg(backup, env);
-}
+        void sendResultToMMA() {
+            WSPutQreal(stdlink, expecVal);
+        }
+};
 
-void internal_sampleExpecPauliString(int showProgress, int initQuregId, int workId1, int workId2) {
+void internal_sampleExpecPauliString(int showProgress, int async, int initQuregId, int workId1, int workId2) {
     const std::string apiFuncName = "SampleExpecPauliString";
     
     // precondition: both or neither of workId1 and workId2 are -1, 
     //      to indicate no working registers were passed
     
+    SampleExpecPauliStringJob* job = new SampleExpecPauliStringJob();
     
     // samples is a positive integer, or a flag to instead use deterministic method
     long numSamples;
     WSGetLongInteger(stdlink, &numSamples);
     bool useAllDecomps = (numSamples == -1);
     
-    // load circuit description (local so no need to explicitly delete)
-    Circuit circ;
-    circ.loadFromMMA();
+    // load circuit description (freed when the job is deleted)
+    job->circ.loadFromMMA();
     
-    // load Hamiltonian from MMA (and also validate quregId), must later free
-    PauliHamil hamil;
+    // load Hamiltonian from MMA (and also validate quregId), freed when the job is deleted
     try {
-        hamil = local_loadPauliHamilForQuregFromMMA(initQuregId); // throws
+        job->hamil = local_loadPauliHamilForQuregFromMMA(initQuregId); // throws
+        job->hamilLoaded = true;
     } catch (QuESTException& err) {
         local_sendErrorAndFail(apiFuncName, err.message);
+        delete job;
         return;
     }
         
@@ -1695,9 +1908,6 @@ void internal_sampleExpecPauliString(int showProgress, int initQuregId, int work
     Qureg initQureg = quregs[initQuregId];
     int numQb = initQureg.numQubitsRepresented;
     
-    Qureg workState1;
-    Qureg workHamil2;
-    
     long maxNeededSamples;
     bool maxNeededOverflowed;
     
@@ -1709,10 +1919,17 @@ void internal_sampleExpecPauliString(int showProgress, int initQuregId, int work
         if (initQureg.isDensityMatrix)
             throw QuESTException("", "The initial qureg must be a state-vector."); // throws
         
-        // optionally create new working registers
+        // optionally create new working registers, if they fit the memory budget
         if (workId1 == -1) {
-            workState1 = createQureg(initQureg.numQubitsRepresented, env);
-            workHamil2 = createQureg(initQureg.numQubitsRepresented, env);
+            local_throwExcepIfExceedsMemoryBudget(2 * local_getQuregNumBytes(initQureg)); // throws
+            job->workState1 = local_createQureg(initQureg.numQubitsRepresented); // throws
+            try {
+                job->workHamil2 = local_createQureg(initQureg.numQubitsRepresented); // throws
+            } catch (QuESTException&) {
+                local_destroyQureg(job->workState1);
+                throw;
+            }
+            job->workQuregsCreated = true;
         }
         
         // otherwise validate given registers
@@ -1722,19 +1939,19 @@ void internal_sampleExpecPauliString(int showProgress, int initQuregId, int work
             
             local_throwExcepIfQuregNotCreated(workId1); // throws
             local_throwExcepIfQuregNotCreated(workId2); // throws
-            workState1 = quregs[workId1];
-            workHamil2 = quregs[workId2];
+            job->workState1 = quregs[workId1];
+            job->workHamil2 = quregs[workId2];
             
-            if (workState1.isDensityMatrix || workHamil2.isDensityMatrix)
+            if (job->workState1.isDensityMatrix || job->workHamil2.isDensityMatrix)
                 throw QuESTException("", "The working quregs must be statevectors."); // throws
 
-            if (workState1.numQubitsRepresented != numQb || workHamil2.numQubitsRepresented != numQb)
+            if (job->workState1.numQubitsRepresented != numQb || job->workHamil2.numQubitsRepresented != numQb)
                 throw QuESTException("", "The working quregs must have the same number of qubits as the initial qureg."); // throws
         }
         
         // if above is successful, obtain num messages needed
         try {
-            maxNeededSamples = circ.getNumDecomps(); // throws
+            maxNeededSamples = job->circ.getNumDecomps(); // throws
             maxNeededOverflowed = false;
         }
         catch (QuESTException& err) {
@@ -1752,7 +1969,7 @@ void internal_sampleExpecPauliString(int showProgress, int initQuregId, int work
         
     } catch (QuESTException& err) {
         local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower,  err.message);
-        local_freePauliHamil(hamil);
+        delete job;
         return;
     }
     
@@ -1770,49 +1987,18 @@ void internal_sampleExpecPauliString(int showProgress, int initQuregId, int work
     if (useAllDecomps)
         numSamples = maxNeededSamples;
     
-    // attempt to sample the expected value
-    try {
-        qreal expecValSum = 0;
-        qreal compen = 0;
-        
-        for (long n=0; n<numSamples; n++) {
-            
-            // halt if the user has tried to abort (casues ~x5 slowdown)
-            local_throwExcepIfUserAborted(); // throws
-            
-            // display progress to the user
-            if (showProgress)
-                local_updateCircuitProgress(n / (qreal) numSamples);
-            
-            cloneQureg(workState1, initQureg);
-
-            qreal fac = 1;
-            if (useAllDecomps)
-                fac = circ.applyDecompTo(workState1, n); // throws
-            else
-                circ.applyDecompTo(workState1); // throws
-                            
-            qreal sample = fac * calcExpecPauliHamil(workState1, hamil, workHamil2); // throws
-            
-            // aggregate through Kahan summation, to mitigate numerical error
-            qreal tmp1 = sample - compen;
-            qreal tmp2 = expecValSum + tmp1;
-            compen = (tmp2 - expecValSum) - tmp1;
-            expecValSum = tmp2;
-        }
-        
-        // output average energy (if random), else determined energy
-        qreal expecVal = expecValSum / ((useAllDecomps)? 1 : numSamples);
-        WSPutQreal(stdlink, expecVal);
-        
-    } catch (QuESTException& err) {
-        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower,  err.message);
-    } 
-    
-    // clean-up even if above errors
-    local_freePauliHamil(hamil);
-    if (workId1 == -1) {
-        destroyQureg(workState1, env);
-        destroyQureg(workHamil2, env);
+    job->initQureg = initQureg;
+    job->numSamples = numSamples;
+    job->useAllDecomps = useAllDecomps;
+    job->quregIds.push_back(initQuregId);
+    if (workId1 != -1) {
+        job->quregIds.push_back(workId1);
+        job->quregIds.push_back(workId2);
     }
+    
+    // asynchronous jobs always record their progress
+    job->showProgress = showProgress || async;
+    
+    // sample the expected value and send it to MMA, now or upon JobResult[]
+    local_runJob(job, async);
 }
@@ -113,6 +113,8 @@ pauliOpType* local_preparePauliCache(pauliOpType pauli, int numPaulis);
 
 pauliOpType* local_preparePauliCache(qreal* paulis, int numPaulis);
 
+void local_updateCircuitProgress(qreal progress);
+
 
 
 /** A single quantum gate or decoherence operator.
@@ -191,7 +193,8 @@ class Gate {
         bool isPure();
         
         /** Returns whether the gate can be inverted, and ergo undone from a 
-         * state. 
+         * state to within numerical precision, which excludes ill-conditioned 
+         * operators (like near-singular channels).
          */
         bool isInvertible();
         
@@ -269,14 +272,19 @@ class Circuit {
         Gate* gates;
         int numGates;
         
-        /** Aggregate circuit info needed by freeMMA();
+        /** The packed circuit loaded from MMA (see loadFromMMA()), which persists 
+         * because it supplies the params of the gate instances, and its length 
+         * needed by freeMMA().
+         */
+        qreal* encoding;
+        int encodingLen;
+        
+        /** The ctrls then targs of every gate, decoded from the encoding.
          */
-        int totalNumCtrls;
-        int totalNumTargs;
-        int totalNumParams;
+        int* qubits;
 
-        /** Destroys the MMA arrays which supply ctrls, targs and params to 
-         * the gate instances. This should only be called by the destructor.
+        /** Destroys the MMA array which supplies the params of the gate instances. 
+         * This should only be called by the destructor.
          * This method is defined in decoders.cpp.
          */
         void freeMMA();
@@ -284,9 +292,10 @@ class Circuit {
     public:
         
         /** Load Gate instances from the WSTP link, populating the Circuit 
-         * attributes. Calling this before the WSTP messages are sent will cause 
-         * a crash. Unlike the other methods defined in circuits.cpp, this method 
-         * is defined in decoders.cpp.
+         * attributes. The circuit is received as a single packed list of reals, 
+         * which is decoded in one pass. Calling this before the WSTP messages are 
+         * sent will cause a crash. Unlike the other methods defined in circuits.cpp, 
+         * this method is defined in decoders.cpp.
          */
         void loadFromMMA();
         
@@ -322,7 +331,8 @@ class Circuit {
         
         /** Returns whether the circuit is invertible, which consulting both the 
          * type of gate (returning false for measurements and projections), but also 
-         * the parameters (whether Kraus superoperators are non-invertible).
+         * the parameters (whether Kraus superoperators are non-invertible or 
+         * ill-conditioned).
          */
         bool isInvertible();
         
@@ -340,8 +350,11 @@ class Circuit {
          * unless outputs=NULL (in which case, outputs are discarded).
          * If showProgress = true, a front-end loading bar will display the progress 
          * of the circuit simulation (via local_updateCircuitProgress()).
+         * If numAppliedGates is not NULL, it is set to the number of gates which
+         * were successfully applied, including when an exception is thrown (since
+         * a failing gate does not modify qureg, as it is validated beforehand).
          */
-        void applyTo(Qureg qureg, qreal* outputs=NULL, bool showProgress=false);
+        void applyTo(Qureg qureg, qreal* outputs=NULL, bool showProgress=false, int* numAppliedGates=NULL);
         
         /** Apply only a contiguous subset of the circuit gates to qureg, starting 
          * at index startGateInd (inclusive) and ending with endGateInd (exclusive).
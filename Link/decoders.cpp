@@ -17,6 +17,8 @@
 
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <climits>
 
 
 
@@ -105,38 +107,87 @@ std::string local_getStandardFormFromMMA(std::string expr) {
     return ret;
 }
 
+std::vector<std::string> local_loadStringListFromMMA() {
+    
+    int numStrs = 0;
+    WSTestHead(stdlink, "List", &numStrs);
+    
+    // copy each string before releasing it back to WSTP
+    std::vector<std::string> strs(numStrs);
+    for (int i=0; i<numStrs; i++) {
+        const char* str;
+        WSGetString(stdlink, &str);
+        strs[i] = std::string(str);
+        WSReleaseString(stdlink, str);
+    }
+    return strs;
+}
+
 
 
 /*
  * Matrix sending 
  */
 
+/* Sends the complex array with the given real and imaginary components, and the 
+ * given (row-major) dimensions, to Mathematica as a single packed real array of 
+ * dimensions {dims..., 2}. The front-end converts this to a packed complex array 
+ * in one vectorised step (via unpackComplexArray), avoiding zipping separate lists.
+ */
+void local_throwExcepIfExceedsArrayDim(long long int len) {
+    if (len > INT_MAX)
+        throw QuESTException("", "The result contains " + std::to_string(len) + " elements, which exceeds the "
+            "maximum length (" + std::to_string(INT_MAX) + ") of an array which can be sent to Mathematica."); // throws
+}
+
+void local_sendComplexArrayToMMA(qreal* re, qreal* im, std::vector<int> dims) {
+    
+    long long int numElems = 1;
+    for (size_t d=0; d<dims.size(); d++)
+        numElems *= dims[d];
+    
+    // interleave the components in parallel
+    std::vector<qreal> elems(2*numElems);
+    qreal* elemsPtr = elems.data();
+    long long int i;
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (numElems, re,im, elemsPtr) \
+    private  (i)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (i=0; i<numElems; i++) {
+            elemsPtr[2*i]   = re[i];
+            elemsPtr[2*i+1] = im[i];
+        }
+    }
+    
+    dims.push_back(2);
+    WSPutQrealArray(stdlink, elemsPtr, dims.data(), NULL, dims.size());
+}
+
 void local_sendMatrixToMMA(qmatrix matrix) {
     
-    // must store in heap, not stack, to avoid overflows
-    size_t dim = matrix.size();
-    size_t len = dim*dim;
-    qreal* matrRe = (qreal*) malloc(len * sizeof *matrRe);
-    qreal* matrIm = (qreal*) malloc(len * sizeof *matrIm);
+    // unpack matrix into separate flat arrays (row-major)
+    int dim = matrix.size();
+    std::vector<qreal> matrRe(dim*dim);
+    std::vector<qreal> matrIm(dim*dim);
     
-    // unpack matrix into separate flat arrays
     size_t i=0;
-    for (size_t r=0; r<dim; r++) {
-        for (size_t c=0; c<dim; c++) {
+    for (int r=0; r<dim; r++) {
+        for (int c=0; c<dim; c++) {
             matrRe[i] = real(matrix[r][c]);
             matrIm[i] = imag(matrix[r][c]);
             i++;
         }
     }
     
-    // send each to Mathematica
-    WSPutFunction(stdlink, "List", 2);
-    WSPutQrealList(stdlink, matrRe, len);
-    WSPutQrealList(stdlink, matrIm, len);
-
-    // clean-up
-    free(matrRe);
-    free(matrIm);
+    // send as a single {dim, dim, 2} array
+    local_sendComplexArrayToMMA(matrRe.data(), matrIm.data(), {dim, dim});
 }
 
 
@@ -147,60 +198,50 @@ void local_sendMatrixToMMA(qmatrix matrix) {
  
 void Circuit::loadFromMMA() {
     
-    // prepare pointers (left will persist, middle won't)
-    int* opcodes;
-    int* ctrls;     int* numCtrlsPerOp;
-    int* targs;     int* numTargsPerOp;
-    qreal* params;  int* numParamsPerOp;
-    
-    // load arrays from MMA (order fixed by QuESTlink.m)
-    WSGetInteger32List(stdlink, &opcodes, &numGates);
-    WSGetInteger32List(stdlink, &ctrls, &totalNumCtrls);
-    WSGetInteger32List(stdlink, &numCtrlsPerOp, &numGates);
-    WSGetInteger32List(stdlink, &targs, &totalNumTargs);
-    WSGetInteger32List(stdlink, &numTargsPerOp, &numGates);
-    WSGetQrealList(stdlink, &params, &totalNumParams);
-    WSGetInteger32List(stdlink, &numParamsPerOp, &numGates);
+    /* The circuit arrives as a single flat list of reals (format fixed by 
+     * encodeCircuit in QuESTlink.m), which avoids WSTP transferring many lists:
+     * {numGates, (opcode, numCtrls, numTargs, numParams, ctrls..., targs..., params...) for each gate}
+     * All elements but the params are exactly representable integers.
+     */
+    WSGetQrealList(stdlink, &encoding, &encodingLen);
     
     // allocate gates array attribute (creates all Gate instances)
+    numGates = (int) encoding[0];
     gates = new Gate[numGates];
     
-    int ctrlInd = 0;
-    int targInd = 0;
-    int paramInd = 0;
+    // the gates' params persist within the encoding, but their qubits are copied out
+    // (which fit, since every qubit is preceded by its gate's opcode)
+    qubits = new int[encodingLen];
+    
+    int encInd = 1;
+    int qubitInd = 0;
     
     for (int opInd=0; opInd<numGates; opInd++) {
         
-        int numCtrls  = numCtrlsPerOp[opInd];
-        int numTargs  = numTargsPerOp[opInd];
-        int numParams = numParamsPerOp[opInd];
+        int opcode    = (int) encoding[encInd++];
+        int numCtrls  = (int) encoding[encInd++];
+        int numTargs  = (int) encoding[encInd++];
+        int numParams = (int) encoding[encInd++];
+        
+        int* ctrls = &qubits[qubitInd];
+        int* targs = &qubits[qubitInd + numCtrls];
+        for (int q=0; q<numCtrls+numTargs; q++)
+            qubits[qubitInd++] = (int) encoding[encInd++];
         
         // initialise each gate, persisting ctrls, targs, params
         gates[opInd].init(
-            opcodes[opInd], 
-            &ctrls[ctrlInd],   numCtrls,
-            &targs[targInd],   numTargs,
-            &params[paramInd], numParams);
+            opcode, 
+            ctrls,              numCtrls,
+            targs,              numTargs,
+            &encoding[encInd],  numParams);
             
-        ctrlInd  += numCtrls;
-        targInd  += numTargs;
-        paramInd += numParams;
+        encInd += numParams;
     }
-    
-    // clean-up the arrays which are no longer needed
-    WSReleaseInteger32List(stdlink, opcodes, numGates);
-    WSReleaseInteger32List(stdlink, numCtrlsPerOp,  numGates);
-    WSReleaseInteger32List(stdlink, numTargsPerOp,  numGates);
-    WSReleaseInteger32List(stdlink, numParamsPerOp, numGates);
 }
 
 void Circuit::freeMMA() {
     
-    // first gate has circuit-wide gate array pointers
-    Gate gate = gates[0];
-    WSReleaseInteger32List(stdlink, gate.getCtrlsAddr(),  totalNumCtrls);
-    WSReleaseInteger32List(stdlink, gate.getTargsAddr(),  totalNumTargs);
-    WSReleaseQrealList(   stdlink, gate.getParamsAddr(), totalNumParams);
+    WSReleaseQrealList(stdlink, encoding, encodingLen);
 }
 
 void Circuit::sendOutputsToMMA(qreal* outputs) {
@@ -239,50 +280,41 @@ void DerivCircuit::loadFromMMA() {
     circuit = new Circuit();
     circuit->loadFromMMA();
     
-    int* derivGateInds;    // may contain repetitions (multi-var gates)
-    int* derivVarInds;     // may contain repetitions (repetition of params, product rule) 
-    qreal* derivParams;   int totalNumDerivParams; // needed for later freeing
-    int* numDerivParamsPerDerivGate;    // used only for fault-checking
-    
-    WSGetInteger32List(stdlink, &derivGateInds, &numTerms);
-    WSGetInteger32List(stdlink, &derivVarInds,  &numTerms);
-    WSGetQrealList(stdlink, &derivParams, &totalNumDerivParams);
-    WSGetInteger32List(stdlink, &numDerivParamsPerDerivGate, &numTerms);
-    
-    /*
-        derivQuregInds are numbers 0 to numQuregs which indicate which of the 
-        given quregs (in quregIds) correspond to the current deriv term. 
-    */
+    /* The terms arrive as a single flat list of reals (format fixed by 
+     * encodeDerivCircTerms in QuESTlink.m):
+     * {numTerms, (gateInd, varInd, numDerivParams, derivParams...) for each term}
+     * where gateInd may repeat (multi-var gates), as may varInd (repetition of 
+     * params, product rule)
+     */
+    WSGetQrealList(stdlink, &termsEncoding, &termsEncodingLen);
     
+    numTerms = (int) termsEncoding[0];
     terms = new DerivTerm[numTerms];
-    int derivParamInd = 0;
+    
+    int encInd = 1;
     int maxVarInd = 0;
     
     for (int t=0; t<numTerms; t++) {
         
-        int gateInd = derivGateInds[t];
+        int gateInd = (int) termsEncoding[encInd++];
         Gate gate = circuit->getGate(gateInd);
-        int varInd = derivVarInds[t];
-        int numDerivParams = numDerivParamsPerDerivGate[t];
+        int varInd = (int) termsEncoding[encInd++];
+        int numDerivParams = (int) termsEncoding[encInd++];
 
-        terms[t].init(gate, gateInd, varInd, &derivParams[derivParamInd], numDerivParams);
-        derivParamInd += numDerivParams;
+        // derivParams persist within the encoding
+        terms[t].init(gate, gateInd, varInd, &termsEncoding[encInd], numDerivParams);
+        encInd += numDerivParams;
         
         if (varInd > maxVarInd)
             maxVarInd = varInd;
     }
     
     numVars = maxVarInd + 1;
-    
-    WSReleaseInteger32List(stdlink, derivGateInds, numTerms);
-    WSReleaseInteger32List(stdlink, derivVarInds, numTerms);
-    WSReleaseInteger32List(stdlink, numDerivParamsPerDerivGate, numTerms);
 }
 
 void DerivCircuit::freeMMA() {
     
-    // first term holds (i.e. has array beginning pointer) all term's derivParams
-    WSReleaseQrealList(stdlink, terms[0].getDerivParamsAddr(), totalNumDerivParams);
+    WSReleaseQrealList(stdlink, termsEncoding, termsEncodingLen);
 }
 
 
@@ -5,6 +5,7 @@
 #include "QuEST_complex.h"
 
 #include <string>
+#include <vector>
 
 #include "utilities.hpp"
 
@@ -21,6 +22,15 @@ std::string local_qmatrixToStr(qmatrix m);
 
 std::string local_getStandardFormFromMMA(std::string expr);
 
+std::vector<std::string> local_loadStringListFromMMA();
+
+/** @throws QuESTException if len exceeds the (int) dimension of a WSTP array, and so 
+ *      cannot be sent by local_sendComplexArrayToMMA()
+ */
+void local_throwExcepIfExceedsArrayDim(long long int len); // throws
+
+void local_sendComplexArrayToMMA(qreal* re, qreal* im, std::vector<int> dims);
+
 void local_sendMatrixToMMA(qmatrix matrix);
 
 void local_loadEncodedPauliStringFromMMA(
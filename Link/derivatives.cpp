@@ -16,6 +16,7 @@
 #include "circuits.hpp"
 #include "utilities.hpp"
 #include "derivatives.hpp"
+#include "jobs.hpp"
 #include "link.hpp"
 
 
@@ -447,6 +448,9 @@ void DerivCircuit::applyTo(Qureg* quregs, int numQuregs, Qureg initQureg, Qureg
         
     for (int t=0; t<numTerms; t++) {
         
+        // halt if the user has tried to abort (polling is throttled, so cheap per term)
+        local_throwExcepIfUserAborted(); // throws
+        
         DerivTerm term = terms[t];
         int gateInd = term.getGateInd();
         
@@ -489,6 +493,9 @@ void DerivCircuit::calcDerivEnergiesStateVec(qreal* eneryGrad, PauliHamil hamil,
 
     for (int t=numTerms-1; t>=0; t--) {
         
+        // halt if the user has tried to abort (throttled)
+        local_throwExcepIfUserAborted(); // throws
+        
         DerivTerm derivTerm = terms[t];
         int gateInd = derivTerm.getGateInd();
         int varInd = derivTerm.getVarInd();
@@ -512,7 +519,7 @@ void DerivCircuit::calcDerivEnergiesDenseHamil(qreal* energyGrad, Qureg hamilQur
     if (!circuit->isInvertible()) // throws
         throw QuESTException("", "The circuit must only contain invertible operators, and hence cannot "
             "contain measurements or projections. It is otherwise possible a general operator (like "
-            "U or Kraus) was non-invertible for its particular parameter values. Please instead use ApplyCircuitDerivs[].");
+            "U or Kraus) was non-invertible (or too ill-conditioned to invert accurately) for its particular parameter values. Please instead use ApplyCircuitDerivs[].");
         
     if (!circuit->isTracePreserving()) // throws
         throw QuESTException("", "The circuit must be trace-preserving and hence cannot contain operators "
@@ -548,6 +555,9 @@ void DerivCircuit::calcDerivEnergiesDenseHamil(qreal* energyGrad, Qureg hamilQur
         
     for (int t=numTerms-1; t>=0; t--) {
         
+        // halt if the user has tried to abort (throttled)
+        local_throwExcepIfUserAborted(); // throws
+        
         DerivTerm derivTerm = terms[t];
         int gateInd = derivTerm.getGateInd();
         int varInd = derivTerm.getVarInd();
@@ -595,7 +605,7 @@ void DerivCircuit::calcDerivEnergies(qreal* energyGrad, PauliHamil hamil, Qureg
         calcDerivEnergiesDensMatr(energyGrad, hamil, initQureg, workQuregs, numWorkQuregs); // throws
 }
 
-qmatrix DerivCircuit::calcMetricTensorStateVec(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs) {
+qmatrix DerivCircuit::calcMetricTensorStateVec(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs, bool showProgress) {
     
     if (!circuit->isInvertible()) // throws
         throw QuESTException("", "The circuit must only contain invertible operators, and hence cannot "
@@ -627,6 +637,13 @@ qmatrix DerivCircuit::calcMetricTensorStateVec(Qureg initQureg, Qureg* workQureg
     
     for (int t=0; t<numTerms; t++) {
         
+        // halt if the user has tried to abort (throttled)
+        local_throwExcepIfUserAborted(); // throws
+        
+        // display progress (throttled), where the work of term t is proportional to t
+        if (showProgress)
+            local_updateCircuitProgress((t / (qreal) numTerms) * (t / (qreal) numTerms));
+        
         DerivTerm rowDerivTerm = terms[t];
         int rowGateInd = rowDerivTerm.getGateInd();
         int rowVarInd = rowDerivTerm.getVarInd();
@@ -662,6 +679,9 @@ qmatrix DerivCircuit::calcMetricTensorStateVec(Qureg initQureg, Qureg* workQureg
         
         for (int s=t-1; s>=0; s--) {
             
+            // halt if the user has tried to abort (throttled)
+            local_throwExcepIfUserAborted(); // throws
+            
             DerivTerm colDerivTerm = terms[s];
             int colGateInd = colDerivTerm.getGateInd();
             int colVarInd = colDerivTerm.getVarInd();
@@ -694,12 +714,12 @@ qmatrix DerivCircuit::calcMetricTensorStateVec(Qureg initQureg, Qureg* workQureg
     return tensor;
 }
 
-qmatrix DerivCircuit::calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs) {
+qmatrix DerivCircuit::calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs, bool showProgress) {
     
     if (!circuit->isInvertible()) // throws
         throw QuESTException("", "The circuit must only contain invertible operators, and hence cannot "
             "contain measurements or projections. It is otherwise possible a general operator (like "
-            "U or Kraus) was non-invertible for its particular parameter values. Please instead use ApplyCircuitDerivs[].");
+            "U or Kraus) was non-invertible (or too ill-conditioned to invert accurately) for its particular parameter values. Please instead use ApplyCircuitDerivs[].");
         
     if (!circuit->isTracePreserving()) // throws
         throw QuESTException("", "The circuit must be trace-preserving and hence cannot contain operators "
@@ -730,6 +750,13 @@ qmatrix DerivCircuit::calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQureg
 
     for (int t=numTerms-1; t>=0; t--) {
         
+        // halt if the user has tried to abort (throttled)
+        local_throwExcepIfUserAborted(); // throws
+        
+        // display progress (throttled), where the work of term t is proportional to t
+        if (showProgress)
+            local_updateCircuitProgress(1 - ((t+1) / (qreal) numTerms) * ((t+1) / (qreal) numTerms));
+        
         DerivTerm leftDerivTerm = terms[t];
         int leftVarInd = leftDerivTerm.getVarInd();
         int leftGateInd = leftDerivTerm.getGateInd(); // ordered
@@ -756,6 +783,9 @@ qmatrix DerivCircuit::calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQureg
         
         for (int s=t-1; s>=0; s--) {
             
+            // halt if the user has tried to abort (throttled)
+            local_throwExcepIfUserAborted(); // throws
+            
             DerivTerm rightDerivTerm = terms[s];
             int rightGateInd = rightDerivTerm.getGateInd();
             int rightVarInd = rightDerivTerm.getVarInd();
@@ -784,12 +814,12 @@ qmatrix DerivCircuit::calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQureg
     return tensor;
 }
 
-qmatrix DerivCircuit::calcMetricTensor(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs) {
+qmatrix DerivCircuit::calcMetricTensor(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs, bool showProgress) {
     
     if (circuit->isPure() && !initQureg.isDensityMatrix) // throws
-        return calcMetricTensorStateVec(initQureg, workQuregs, numWorkQuregs); // throws
+        return calcMetricTensorStateVec(initQureg, workQuregs, numWorkQuregs, showProgress); // throws
     else
-        return calcMetricTensorDensMatr(initQureg, workQuregs, numWorkQuregs); // throws
+        return calcMetricTensorDensMatr(initQureg, workQuregs, numWorkQuregs, showProgress); // throws
 }
 
 int DerivCircuit::getNumNeededWorkQuregsFor(std::string funcName, Qureg initQureg) {
@@ -827,11 +857,14 @@ int DerivCircuit::getNumNeededWorkQuregsFor(std::string funcName, Qureg initQure
 
 void DerivCircuit::validateWorkQuregsFor(std::string methodName, int initQuregId, int* workQuregIds, int numWorkQuregs) {
     
-    // no working registers is fine; they will be internally created
-    if (numWorkQuregs == 0)
-        return;
-        
     int numNeeded = getNumNeededWorkQuregsFor(methodName, quregs[initQuregId]); // throws
+    
+    // no working registers is fine; they will be internally created (if they fit the memory budget)
+    if (numWorkQuregs == 0) {
+        local_throwExcepIfExceedsMemoryBudget(numNeeded * local_getQuregNumBytes(quregs[initQuregId])); // throws
+        return;
+    }
+    
     if (numWorkQuregs < numNeeded)
         throw QuESTException("", "Too few working registers were passed (" + std::to_string(numNeeded) + " are required)."); // throws
         
@@ -864,6 +897,23 @@ DerivCircuit::~DerivCircuit() {
  * interfacing
  */
 
+/* Populates workQuregs with new clones of initQureg, destroying those already 
+ * created if any creation fails.
+ * @throws QuESTException if a clone cannot be created
+ */
+void local_createWorkQuregClones(Qureg* workQuregs, int numWorkQuregs, Qureg initQureg) {
+    
+    for (int i=0; i<numWorkQuregs; i++) {
+        try {
+            workQuregs[i] = local_createCloneQureg(initQureg); // throws
+        } catch (QuESTException&) {
+            for (int j=0; j<i; j++)
+                local_destroyQureg(workQuregs[j]);
+            throw;
+        }
+    }
+}
+
 void internal_applyCircuitDerivs(int initQuregId, int workspaceId) {
     const std::string apiFuncName = "ApplyCircuitDerivs";
     
@@ -881,11 +931,9 @@ void internal_applyCircuitDerivs(int initQuregId, int workspaceId) {
         // validate initial state
         local_throwExcepIfQuregNotCreated(initQuregId); // throws
         
-        // validate workspace (if pre-allocated)
-        if (workspaceId != -1) {
-            int workspaces[] = {workspaceId}; // hacky integration into validateWorkQuregsFor(), due to design indecision
-            derivCirc.validateWorkQuregsFor("applyTo", initQuregId, workspaces, 1);
-        }
+        // validate workspace (if pre-allocated, else that it can be created)
+        int workspaces[] = {workspaceId}; // hacky integration into validateWorkQuregsFor(), due to design indecision
+        derivCirc.validateWorkQuregsFor("applyTo", initQuregId, workspaces, (workspaceId != -1)? 1 : 0); // throws
             
         // validate derivative registers (no check of uniqueness)
         int numQb = quregs[initQuregId].numQubitsRepresented;
@@ -916,10 +964,14 @@ void internal_applyCircuitDerivs(int initQuregId, int workspaceId) {
     
     // optionally create workspace
     Qureg workspace;
-    if (workspaceId == -1)
-        workspace = createCloneQureg(initQureg, env);
-    else
-        workspace = quregs[workspaceId];
+    try {
+        workspace = (workspaceId == -1)? local_createCloneQureg(initQureg) : quregs[workspaceId]; // throws
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+        WSReleaseInteger32List(stdlink, quregIds, numQuregs);
+        return;
+    }
     
     // unpack deriv quregs
     Qureg* derivQuregs = (Qureg*) malloc(numQuregs * sizeof *derivQuregs);
@@ -939,7 +991,7 @@ void internal_applyCircuitDerivs(int initQuregId, int workspaceId) {
     free(derivQuregs);
     WSReleaseInteger32List(stdlink, quregIds, numQuregs);
     if (workspaceId == -1)
-        destroyQureg(workspace, env);
+        local_destroyQureg(workspace);
 }
 
 void internal_calcExpecPauliStringDerivs(int initQuregId) {
@@ -967,8 +1019,7 @@ void internal_calcExpecPauliStringDerivs(int initQuregId) {
     
     // validate registers 
     try {
-        if (numPassedWorkQuregs > 0)
-            derivCirc.validateWorkQuregsFor("calcDerivEnergies", initQuregId, workQuregIds, numPassedWorkQuregs); // throws
+        derivCirc.validateWorkQuregsFor("calcDerivEnergies", initQuregId, workQuregIds, numPassedWorkQuregs); // throws
             
     } catch (QuESTException& err) {
         local_sendErrorAndFail(apiFuncName, err.message);
@@ -982,11 +1033,20 @@ void internal_calcExpecPauliStringDerivs(int initQuregId) {
     // optionally create work registers
     int numNeededWorkQuregs = derivCirc.getNumNeededWorkQuregsFor("calcDerivEnergies", initQureg);
     Qureg* workQuregs = (Qureg*) malloc(numNeededWorkQuregs * sizeof *workQuregs);
-    for (int i=0; i<numNeededWorkQuregs; i++)
+    try {
         if (numPassedWorkQuregs == 0)
-            workQuregs[i] = createCloneQureg(initQureg, env);
+            local_createWorkQuregClones(workQuregs, numNeededWorkQuregs, initQureg); // throws
         else
-            workQuregs[i] = quregs[workQuregIds[i]];
+            for (int i=0; i<numNeededWorkQuregs; i++)
+                workQuregs[i] = quregs[workQuregIds[i]];
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+        free(workQuregs);
+        local_freePauliHamil(hamil);
+        WSReleaseInteger32List(stdlink, workQuregIds, numPassedWorkQuregs);
+        return;
+    }
             
     // prepare energy grad vector (malloc onto heap to avoid stack size limits)
     int numDerivs = derivCirc.getNumVars();
@@ -1004,7 +1064,7 @@ void internal_calcExpecPauliStringDerivs(int initQuregId) {
     // clean-up even despite errors
     if (numPassedWorkQuregs == 0)
         for (int i=0; i<numNeededWorkQuregs; i++)
-            destroyQureg(workQuregs[i], env);
+            local_destroyQureg(workQuregs[i]);
     free(workQuregs);
     free(energyGrad);
     local_freePauliHamil(hamil);
@@ -1041,8 +1101,7 @@ void internal_calcExpecPauliStringDerivsDenseHamil(int initQuregId, int hamilQur
             throw QuESTException("", "The initial state Qureg and the Hamiltonian encoded into a "
                 "qureg must be of equal dimensions.");
         
-        if (numPassedWorkQuregs > 0)
-            derivCirc.validateWorkQuregsFor("calcDerivEnergiesDenseHamil", initQuregId, workQuregIds, numPassedWorkQuregs); // throws
+        derivCirc.validateWorkQuregsFor("calcDerivEnergiesDenseHamil", initQuregId, workQuregIds, numPassedWorkQuregs); // throws
         
     } catch (QuESTException& err) {
         local_sendErrorAndFail(apiFuncName, err.message);
@@ -1053,11 +1112,19 @@ void internal_calcExpecPauliStringDerivsDenseHamil(int initQuregId, int hamilQur
     // optionally create work registers
     int numNeededWorkQuregs = derivCirc.getNumNeededWorkQuregsFor("calcDerivEnergiesDenseHamil", initQureg);
     Qureg* workQuregs = (Qureg*) malloc(numNeededWorkQuregs * sizeof *workQuregs);
-    for (int i=0; i<numNeededWorkQuregs; i++)
+    try {
         if (numPassedWorkQuregs == 0)
-            workQuregs[i] = createCloneQureg(initQureg, env);
+            local_createWorkQuregClones(workQuregs, numNeededWorkQuregs, initQureg); // throws
         else
-            workQuregs[i] = quregs[workQuregIds[i]];
+            for (int i=0; i<numNeededWorkQuregs; i++)
+                workQuregs[i] = quregs[workQuregIds[i]];
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+        free(workQuregs);
+        WSReleaseInteger32List(stdlink, workQuregIds, numPassedWorkQuregs);
+        return;
+    }
     
     // prepare energy grad vector (malloc onto heap to avoid stack size limits)
     int numDerivs = derivCirc.getNumVars();
@@ -1076,60 +1143,102 @@ void internal_calcExpecPauliStringDerivsDenseHamil(int initQuregId, int hamilQur
     // clean-up even despite errors
     if (numPassedWorkQuregs == 0)
         for (int i=0; i<numNeededWorkQuregs; i++)
-            destroyQureg(workQuregs[i], env);
+            local_destroyQureg(workQuregs[i]);
     free(workQuregs);
     free(energyGrad);
     WSReleaseInteger32List(stdlink, workQuregIds, numPassedWorkQuregs);
 }
 
-void internal_calcMetricTensor(int initQuregId) {
+/* The computation of the geometric tensor of a parameterised circuit.
+ */
+class CalcMetricTensorJob : public Job {
+    public:
+        
+        DerivCircuit derivCirc;
+        Qureg initQureg;
+        Qureg* workQuregs;
+        int numNeededWorkQuregs;
+        bool workQuregsCreated;
+        bool showProgress;
+        qmatrix tensor;
+        
+        CalcMetricTensorJob() : Job("CalcMetricTensor") {
+            workQuregs = NULL;
+            numNeededWorkQuregs = 0;
+            workQuregsCreated = false;
+        }
+        
+        ~CalcMetricTensorJob() {
+            if (workQuregsCreated)
+                for (int i=0; i<numNeededWorkQuregs; i++)
+                    local_destroyQureg(workQuregs[i]);
+            free(workQuregs);
+        }
+        
+        void compute() {
+            tensor = derivCirc.calcMetricTensor(initQureg, workQuregs, numNeededWorkQuregs, showProgress); // throws
+        }
+        
+        void sendResultToMMA() {
+            local_sendMatrixToMMA(tensor);
+        }
+};
+
+void internal_calcMetricTensor(int initQuregId, int async) {
     const std::string apiFuncName = "CalcMetricTensor";
     
+    CalcMetricTensorJob* job = new CalcMetricTensorJob();
+    
     // load the any-length workspace list from MMA
     int* workQuregIds;
     int numPassedWorkQuregs;
     WSGetInteger32List(stdlink, &workQuregIds, &numPassedWorkQuregs);
     
-    // load the circuit and deriv spec from MMA
-    DerivCircuit derivCirc;
-    derivCirc.loadFromMMA(); // local, so desconstructor automatic
+    // load the circuit and deriv spec from MMA (freed when the job is deleted)
+    job->derivCirc.loadFromMMA();
     
     // validate registers 
     try {
         local_throwExcepIfQuregNotCreated(initQuregId); // throws
-        if (numPassedWorkQuregs > 0)
-            derivCirc.validateWorkQuregsFor("calcMetricTensor", initQuregId, workQuregIds, numPassedWorkQuregs); // throws
+        job->derivCirc.validateWorkQuregsFor("calcMetricTensor", initQuregId, workQuregIds, numPassedWorkQuregs); // throws
             
     } catch (QuESTException& err) {
         local_sendErrorAndFail(apiFuncName, err.message);
         WSReleaseInteger32List(stdlink, workQuregIds, numPassedWorkQuregs);
+        delete job;
         return;
     }
     
     Qureg initQureg = quregs[initQuregId];
+    job->initQureg = initQureg;
+    job->quregIds.push_back(initQuregId);
+    
+    // only asynchronous jobs record their progress, since the front-end shows none
+    job->showProgress = async;
     
     // optionally create work registers
-    int numNeededWorkQuregs = derivCirc.getNumNeededWorkQuregsFor("calcMetricTensor", initQureg);
-    Qureg* workQuregs = (Qureg*) malloc(numNeededWorkQuregs * sizeof *workQuregs);
-    for (int i=0; i<numNeededWorkQuregs; i++)
-        if (numPassedWorkQuregs == 0)
-            workQuregs[i] = createCloneQureg(initQureg, env);
-        else
-            workQuregs[i] = quregs[workQuregIds[i]];
-        
-    // attempt to compute and return tensor 
-    try {
-        qmatrix tensor = derivCirc.calcMetricTensor(initQureg, workQuregs, numNeededWorkQuregs); // throws
-        local_sendMatrixToMMA(tensor);
-        
-    } catch (QuESTException& err) {
-        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower,  err.message);
+    int numNeededWorkQuregs = job->derivCirc.getNumNeededWorkQuregsFor("calcMetricTensor", initQureg);
+    job->numNeededWorkQuregs = numNeededWorkQuregs;
+    job->workQuregs = (Qureg*) malloc(numNeededWorkQuregs * sizeof *job->workQuregs);
+    if (numPassedWorkQuregs == 0) {
+        try {
+            local_createWorkQuregClones(job->workQuregs, numNeededWorkQuregs, initQureg); // throws
+        } catch (QuESTException& err) {
+            local_sendErrorAndFail(apiFuncName, err.message);
+            WSReleaseInteger32List(stdlink, workQuregIds, numPassedWorkQuregs);
+            delete job;
+            return;
+        }
+        job->workQuregsCreated = true;
+    }
+    else {
+        for (int i=0; i<numNeededWorkQuregs; i++) {
+            job->workQuregs[i] = quregs[workQuregIds[i]];
+            job->quregIds.push_back(workQuregIds[i]);
+        }
     }
-    
-    // clean-up, even if error
-    if (numPassedWorkQuregs == 0)
-        for (int i=0; i<numNeededWorkQuregs; i++)
-            destroyQureg(workQuregs[i], env);
-    free(workQuregs);
     WSReleaseInteger32List(stdlink, workQuregIds, numPassedWorkQuregs);
+        
+    // compute the tensor and send it to MMA, now or upon JobResult[]
+    local_runJob(job, async);
 }
@@ -88,29 +88,32 @@ class DerivCircuit {
         DerivTerm* terms;
         int numTerms;
         
-        /** The total number of derivParams aggregated between all terms of the 
-         * differential circuit. This is needed to later free the MMA-loaded 
-         * derivParams array which is shared between DerivTerm instances.
+        /** The packed derivative terms loaded from MMA (see loadFromMMA()), which 
+         * persist because they contain the derivParams shared between DerivTerm 
+         * instances, and their length needed to later free them.
          */
-        int totalNumDerivParams;
+        qreal* termsEncoding;
+        int termsEncodingLen;
         
         /** Qureg type-specific implementations of public methods 
          */
         void calcDerivEnergiesStateVec(qreal* energies, PauliHamil hamil, Qureg initQureg, Qureg* workQuregs, int numWorkQuregs);
         void calcDerivEnergiesDensMatr(qreal* energyGrad, PauliHamil hamil, Qureg initQureg, Qureg* workQuregs, int numWorkQuregs);
-        qmatrix calcMetricTensorStateVec(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs);
-        qmatrix calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs);
+        qmatrix calcMetricTensorStateVec(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs, bool showProgress);
+        qmatrix calcMetricTensorDensMatr(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs, bool showProgress);
         
-        /** Destroys the MMA arrays shared between DerivTerm instances (derivPArams), 
-         * invoked during the destructor. This method is defined in decoders.cpp.
+        /** Destroys the MMA array shared between DerivTerm instances (containing 
+         * derivParams), invoked during the destructor. This method is defined in 
+         * decoders.cpp.
          */
         void freeMMA();
         
     public:
         
         /** Load attributes from the WSTP link, including the non-differentiated 
-         * circuit, and each DerivTerm info. Calling this before the WSTP messages 
-         * are sent will cause an unpreventable crash.
+         * circuit, and each DerivTerm info, each as a single packed list of reals. 
+         * Calling this before the WSTP messages are sent will cause an unpreventable 
+         * crash.
          * Unlike the other methods defined in derivatives.cpp, this method 
          * is defined in decoders.cpp.
          */
@@ -163,9 +166,10 @@ class DerivCircuit {
          * see https://arxiv.org/abs/1912.08660). In both scenarios, the metric tensor 
          * is computed in O(#parameters^2) time and O(1) memory, using my algorithm 
          * from https://arxiv.org/abs/2011.02991 and a density-matrix adaptation.
-         * @throws exception when numWorkQuregs != 4
+         * If showProgress = true, the progress is reported via local_updateCircuitProgress().
+         * @throws exception when numWorkQuregs != 4, or if the user aborts
          */
-        qmatrix calcMetricTensor(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs);
+        qmatrix calcMetricTensor(Qureg initQureg, Qureg* workQuregs, int numWorkQuregs, bool showProgress=false);
         
         /** Returns the number of working registers needed to perform the method 
          * indicated by funcName upon given the initial register.
@@ -173,7 +177,8 @@ class DerivCircuit {
         int getNumNeededWorkQuregsFor(std::string funcName, Qureg initQureg);
         
         /** Throws an exception if the workQuregIds are invalid or if there are too 
-         * few for the given method.
+         * few for the given method, or if none are given and those which would be 
+         * internally created exceed the memory budget.
          * @precondition initQuregId must be valid
          */
         void validateWorkQuregsFor(std::string methodName, int initQuregId, int* workQuregIds, int numWorkQuregs);
@@ -16,6 +16,7 @@
 
 #include "errors.hpp"
 #include "link.hpp"
+#include "jobs.hpp"
 #include "wstp.h"
 
 #include <stdio.h>
@@ -25,6 +26,16 @@
 #include <string>
 #include <vector>
 #include <exception>
+#include <chrono>
+
+
+/*
+ * The minimum period between polls of the link for a user abort, since a poll is 
+ * far more expensive than a gate upon a small qureg
+ */
+#define ABORT_POLL_MIN_PERIOD_MS 50
+
+std::chrono::steady_clock::time_point lastAbortPollTime;
 
 
 /* channel core-QuEST validation errors into catchable exceptions
@@ -110,6 +121,15 @@ void local_throwExcepIfQuregNotCreated(int id) {
         throw QuESTException("", "qureg id " + std::to_string(id) + " is invalid (must be >= 0).");
     if (id >= (int) quregs.size() || !quregIsCreated[id])
         throw QuESTException("", "qureg (with id " + std::to_string(id) + ") has not been created");
+    
+    local_throwExcepIfQuregUsedByJob(id); // throws
+}
+
+void local_throwExcepIfShadowNotCreated(int id) {
+    if (id < 0)
+        throw QuESTException("", "classical shadow id " + std::to_string(id) + " is invalid (must be >= 0).");
+    if (id >= (int) shadows.size() || !shadowIsCreated[id])
+        throw QuESTException("", "classical shadow (with id " + std::to_string(id) + ") has not been created");
 }
 
 QuESTException local_gateUnsupportedExcep(std::string gateSyntax, std::string gateName) {
@@ -157,6 +177,20 @@ QuESTException local_invalidProbExcep(std::string gateName, qreal prob, std::str
 
 void local_throwExcepIfUserAborted() {
     
+    // asynchronous jobs cannot access the link, and are instead cancelled by CancelJob[]
+    Job* job = local_getCurrentJob();
+    if (job != NULL) {
+        if (job->isCancelRequested)
+            throw QuESTException("Abort", "The job was cancelled."); // throws
+        return;
+    }
+    
+    // poll the link at most once per period, so that hot loops may call this freely
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - lastAbortPollTime < std::chrono::milliseconds(ABORT_POLL_MIN_PERIOD_MS))
+        return;
+    lastAbortPollTime = now;
+    
     /* Dear ancient Wolfram Gods; why does this no longer work? 
      * Why is WSAbort undefined despite appearing in the WSTP doc?
      * Why is MLAbort undefined despite appearing in wstp.h?
@@ -32,6 +32,8 @@ void local_sendWarningAndContinue(std::string funcName, std::string warnMsg);
 
 void local_throwExcepIfQuregNotCreated(int id);
 
+void local_throwExcepIfShadowNotCreated(int id);
+
 void local_throwExcepIfUserAborted();
 
 QuESTException local_gateUnsupportedExcep(std::string gateSyntax, std::string gateName);
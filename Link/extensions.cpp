@@ -13,8 +13,49 @@
 
 #include <vector>
 #include <algorithm>
+#include <stdlib.h>
 
+#include "extensions.hpp"
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#ifndef _WIN32
+    #include <sys/mman.h>
+#endif
+
+
+
+/*
+ * The maximum number of elements of a reduced density matrix for which each 
+ * thread accumulates its own partial copy, beyond which the elements are instead
+ * divided between threads
+ */
+#define MAX_NUM_ELEMS_FOR_PARTIAL_TRACE_ACCUMULATORS 4096
+
+/*
+ * The maximum total number of outcome probabilities (of the foremost subsets of 
+ * qubits) for which each thread accumulates its own partial tables, beyond which
+ * the outcomes of the remaining subsets are divided between threads
+ */
+#define MAX_NUM_PROBS_FOR_PARTIAL_SUBSET_ACCUMULATORS 4096
+
+/*
+ * The granularity to which the amplitude arrays of quregs allocated by 
+ * extension_reallocQuregAmps() are padded, which is the (typical) huge page size.
+ * Smaller arrays are left as allocated by QuEST.
+ */
+#define QUREG_ALLOC_NUM_BYTES_PER_PAGE (1LL << 21)
+
+
+
+/** Whether amplitude a = (probability, index) precedes b in order of decreasing
+ * probability, with ties broken in favour of the smaller index
+ */
+bool local_isMoreProbableAmp(const std::pair<qreal,long long int>& a, const std::pair<qreal,long long int>& b) {
+    return (a.first > b.first) || (a.first == b.first && a.second < b.second);
+}
 
 bool extension_isHermitian(Qureg qureg) {
 
@@ -421,235 +462,545 @@ void extension_mixDampingDeriv(Qureg qureg, int targ, qreal prob, qreal probDeri
     extension_addAdjointToSelf(qureg);
 }
 
-void extension_calcExpecPauliProdsFromClassicalShadow(
-    std::vector<qreal> &prodExpecVals, long numProds,
-    int* sampleBases, int* sampleOutcomes, int numQb, long numSamples,
-    int* pauliCodes, int* pauliTargs, int* numPaulisPerProd,
-    int numBatches
-) {
-    // The input arrays are total size O(numSamples*numQb + numProds*numQb), 
-    // permitting creation of temporary vectors with negligible memory overhead.
-    // We hence convert the inputs to bitmasks for asymptotically faster shadow 
-    // processing, as suggested by Balint Koczor
-    std::vector<long> pauliIndOffset(numProds);
-    std::vector<unsigned long long> pauliBitseqs(numProds);
-    std::vector<unsigned long long> pauliTargBitseqs(numProds);
-    std::vector<unsigned long long> outcomeTargBitseqs(numProds);
-    std::vector<unsigned long long> baseBitseqs(numSamples);
-    std::vector<unsigned long long> outcomeBitseqs(numSamples);
-    
-    // serially prepare starting indices of each pauli product, in time O(numProds)
-    pauliIndOffset[0] = 0;
-    for (int i=1; i<numProds; i++)
-        pauliIndOffset[i] = pauliIndOffset[i-1] + numPaulisPerProd[i-1];
-        
-    // parallel validate inputs, avoiding breaking out of OpenMP loops
-    volatile bool invalid = false;
-    std::string errMsg = "";
+void extension_getAmps(Qureg qureg, long long int* inds, long long int numInds, qreal* outRe, qreal* outIm) {
+    
+    qreal* vecRe = qureg.stateVec.real;
+    qreal* vecIm = qureg.stateVec.imag;
+    long long int i;
     
-    // parallel validate the Pauli products, in time O(numProds*prodSize) << O(numProds*numQb)
-    unsigned long long k, numTotalPaulis;
-    numTotalPaulis = pauliIndOffset[numProds-1] + numPaulisPerProd[numProds-1];
 # ifdef _OPENMP
 # pragma omp parallel \
     default  (none) \
-    shared   (invalid,errMsg, numTotalPaulis, pauliCodes,pauliTargs, numQb) \
-    private  (k)
+    shared   (inds,numInds, vecRe,vecIm, outRe,outIm) \
+    private  (i)
 # endif
     {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (k=0; k<numTotalPaulis; k++) {
-            
-            if (invalid)
-                continue;
-            
-            if (pauliCodes[k] < 0 || pauliCodes[k] > 3) {
-                errMsg = "A Pauli product contained an invalid Pauli operator code (" + 
-                    std::to_string(pauliCodes[k]) + "). Each Pauli operator code must be an integer " + 
-                    "0, 1, 2, 3, corresponding to Pauli operators Id, X, Y, Z respectively.";
-                invalid = true;
-            }
-                    
-            if (pauliTargs[k] < 0 || pauliTargs[k] >= numQb) {
-                errMsg = "A Pauli product targeted an invalid qubit (" + 
-                    std::to_string(pauliTargs[k]) + "). Note that the number of qubits in " +
-                    "the shadow was inferred to be " + std::to_string(numQb) + ".";
-                invalid = true;
-            }
+        for (i=0; i<numInds; i++) {
+            outRe[i] = vecRe[inds[i]];
+            outIm[i] = vecIm[inds[i]];
         }
     }
+}
+
+void extension_getAmpRange(Qureg qureg, long long int startInd, long long int numAmps, qreal* outRe, qreal* outIm) {
     
-    if (invalid)
-        throw QuESTException("", errMsg);
+    std::copy(qureg.stateVec.real + startInd, qureg.stateVec.real + startInd + numAmps, outRe);
+    std::copy(qureg.stateVec.imag + startInd, qureg.stateVec.imag + startInd + numAmps, outIm);
+}
+
+void extension_setAmpRange(Qureg qureg, long long int startInd, long long int numAmps, qreal* ampsRe, qreal* ampsIm) {
+    
+    qreal* vecRe = qureg.stateVec.real + startInd;
+    qreal* vecIm = qureg.stateVec.imag + startInd;
+    long long int i;
     
-    // parallel validate the shadow sample bases and outcomes, in time O(numSamples*numQb)
-    unsigned long long numTotalSampVals = numSamples * numQb;
-    invalid = false;
 # ifdef _OPENMP
 # pragma omp parallel \
     default  (none) \
-    shared   (invalid,errMsg, numTotalSampVals, numSamples,sampleBases,sampleOutcomes, numQb) \
-    private  (k)
+    shared   (numAmps, vecRe,vecIm, ampsRe,ampsIm) \
+    private  (i)
 # endif
     {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (k=0; k<numTotalSampVals; k++) {
-            
-            if (invalid)
-                continue;
-            
-            if (sampleBases[k] < 1 || sampleBases[k] > 3) {
-                errMsg = "A shadow sample contained an invalid Pauli measurement basis code (" + 
-                    std::to_string(sampleBases[k]) + "). Each Pauli measurement basis code must be an integer " + 
-                    "1, 2, 3, corresponding to the X, Y, Z bases respectively.";
-                invalid = true;
-            }
-                    
-            if (sampleOutcomes[k] < 0 || sampleOutcomes[k] > 1) {
-                errMsg = "A shadow sample contained an invalid qubit measurement outcome (" + 
-                    std::to_string(sampleOutcomes[k]) + "). Measurement outcomes must be 0 or 1.";
-                invalid = true;
-            }
+        for (i=0; i<numAmps; i++) {
+            vecRe[i] = ampsRe[i];
+            vecIm[i] = ampsIm[i];
         }
     }
+}
+
+void extension_getMostProbableInds(
+    std::vector<long long int>& outInds, Qureg qureg, long long int maxNumInds, qreal minProb
+) {
+    // density matrices are ranked by their diagonal, whose indices are returned as rows
+    long long int numProbs = (qureg.isDensityMatrix)? 
+        (1LL << qureg.numQubitsRepresented) : qureg.numAmpsTotal;
+    long long int stride = (qureg.isDensityMatrix)? numProbs + 1 : 1;
+    int isDensMatr = qureg.isDensityMatrix;
     
-    if (invalid)
-        throw QuESTException("", errMsg);
-        
-    // parallel encode paulis as length 2*numQb bit sequences, and their targets 
-    // as bit masks, in time  O(numProds*prodSize) << O(numProds*numQb) 
-    int p;
-    long i, j;
-    unsigned long long seqPaulis, seqPauliTargs, seqOutcomeTargs;
+    // a negative maxNumInds imposes no limit
+    bool isBounded = (maxNumInds >= 0);
+    if (isBounded && maxNumInds > numProbs)
+        maxNumInds = numProbs;
+    
+    outInds.clear();
+    if (maxNumInds == 0)
+        return;
+    
+    qreal* vecRe = qureg.stateVec.real;
+    qreal* vecIm = qureg.stateVec.imag;
+    std::vector<std::pair<qreal,long long int>> allBest;
+    
+    // each thread selects the most probable of its amplitudes with a bounded heap,
+    // whose front is its least probable amp, before the selections are merged
+    long long int i, j;
+    qreal prob;
 # ifdef _OPENMP
 # pragma omp parallel \
     default  (none) \
-    shared   (numProds,numPaulisPerProd,pauliIndOffset,pauliCodes,pauliTargs, \
-              pauliBitseqs,pauliTargBitseqs,outcomeTargBitseqs) \
-    private  (i,j,p, seqPaulis,seqPauliTargs,seqOutcomeTargs)
+    shared   (allBest, numProbs,stride,isDensMatr, vecRe,vecIm, isBounded,maxNumInds,minProb) \
+    private  (i,j, prob)
 # endif
     {
+        std::vector<std::pair<qreal,long long int>> best;
+        
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (i=0L; i<numProds; i++) {
-            
-            seqPaulis = 00ULL;      // length 2*numQb
-            seqPauliTargs = 00ULL;  // length 2*numQb
-            seqOutcomeTargs = 0ULL; // length numQb
+        for (i=0; i<numProbs; i++) {
+            j = i*stride;
+            prob = (isDensMatr)? vecRe[j] : vecRe[j]*vecRe[j] + vecIm[j]*vecIm[j];
+            if (prob < minProb)
+                continue;
             
-            for (p=0; p<numPaulisPerProd[i]; p++) {
-                j = pauliIndOffset[i] + p;
-                seqPaulis |= (pauliCodes[j] << 2*pauliTargs[j]);
-                seqPauliTargs |= (3ULL << 2*pauliTargs[j]);
-                seqOutcomeTargs |= (1ULL << pauliTargs[j]);
+            std::pair<qreal,long long int> amp(prob, i);
+            if (!isBounded)
+                best.push_back(amp);
+            else if ((long long int) best.size() < maxNumInds) {
+                best.push_back(amp);
+                std::push_heap(best.begin(), best.end(), local_isMoreProbableAmp);
+            }
+            else if (local_isMoreProbableAmp(amp, best.front())) {
+                std::pop_heap(best.begin(), best.end(), local_isMoreProbableAmp);
+                best.back() = amp;
+                std::push_heap(best.begin(), best.end(), local_isMoreProbableAmp);
             }
-            
-            pauliBitseqs[i] = seqPaulis;
-            pauliTargBitseqs[i] = seqPauliTargs;
-            outcomeTargBitseqs[i] = seqOutcomeTargs;
         }
+        
+# ifdef _OPENMP
+# pragma omp critical
+# endif
+        allBest.insert(allBest.end(), best.begin(), best.end());
     }
+    
+    // at most numThreads*maxNumInds amps remain to be ranked
+    std::sort(allBest.begin(), allBest.end(), local_isMoreProbableAmp);
+    if (isBounded && (long long int) allBest.size() > maxNumInds)
+        allBest.resize(maxNumInds);
+    
+    outInds.resize(allBest.size());
+    for (size_t k=0; k<allBest.size(); k++)
+        outInds[k] = allBest[k].second;
+}
 
-    // parallel encode shadow bases and outcomes into bit sequences, in time O(numSamples*numQb)
-    int q, ind;
-    long s, offset;
-    unsigned long long seqBases, seqOuts;
+/* Returns whether each subset's table is accumulated by every thread in a single sweep 
+ * (being among the foremost small tables), rather than divided between threads
+ */
+std::vector<bool> local_getIsSubsetAccumulated(int* numQubitsPerSubset, int numSubsets) {
+    
+    std::vector<bool> isAccum(numSubsets);
+    long long int numAccumProbs = 0;
+    for (int s=0; s<numSubsets; s++) {
+        long long int numProbs = 1LL << numQubitsPerSubset[s];
+        isAccum[s] = (numAccumProbs + numProbs <= MAX_NUM_PROBS_FOR_PARTIAL_SUBSET_ACCUMULATORS);
+        if (isAccum[s])
+            numAccumProbs += numProbs;
+    }
+    return isAccum;
+}
+
+long long int extension_getNumBytesOfSubsetProbAccumulators(int* numQubitsPerSubset, int numSubsets) {
+    
+    std::vector<bool> isAccum = local_getIsSubsetAccumulated(numQubitsPerSubset, numSubsets);
+    long long int numAccumProbs = 0;
+    for (int s=0; s<numSubsets; s++)
+        if (isAccum[s])
+            numAccumProbs += 1LL << numQubitsPerSubset[s];
+    
+    int numThreads = 1;
+# ifdef _OPENMP
+    numThreads = omp_get_max_threads();
+# endif
+    return numThreads * numAccumProbs * (long long int) sizeof(qreal);
+}
+
+void extension_calcProbsOfAllOutcomesOfSubsets(
+    qreal* outProbs, Qureg qureg, int* subsetQubits, int* numQubitsPerSubset, int numSubsets
+) {
+    // the marginal tables of all subsets are concatenated in outProbs, at the below offsets
+    std::vector<long long int> qubitOffsets(numSubsets);
+    std::vector<long long int> outOffsets(numSubsets + 1);
+    qubitOffsets[0] = 0;
+    outOffsets[0] = 0;
+    for (int s=0; s<numSubsets; s++) {
+        if (s > 0)
+            qubitOffsets[s] = qubitOffsets[s-1] + numQubitsPerSubset[s-1];
+        outOffsets[s+1] = outOffsets[s] + (1LL << numQubitsPerSubset[s]);
+    }
+    long long int numOuts = outOffsets[numSubsets];
+    
+    for (long long int i=0; i<numOuts; i++)
+        outProbs[i] = 0;
+    
+    // small tables are concatenated in each thread's accumulator, at the below offsets
+    std::vector<bool> isAccum = local_getIsSubsetAccumulated(numQubitsPerSubset, numSubsets);
+    std::vector<int> accumSubsets;
+    std::vector<long long int> accumOffsets(1, 0);
+    for (int s=0; s<numSubsets; s++) {
+        if (isAccum[s]) {
+            accumSubsets.push_back(s);
+            accumOffsets.push_back(accumOffsets.back() + (1LL << numQubitsPerSubset[s]));
+        }
+    }
+    int numAccumSubsets = accumSubsets.size();
+    long long int numAccumProbs = accumOffsets.back();
+    
+    // density matrices contribute only their (real) diagonal 
+    int numQb = qureg.numQubitsRepresented;
+    long long int numStates = 1LL << numQb;
+    long long int stride = (qureg.isDensityMatrix)? numStates + 1 : 1;
+    int isDensMatr = qureg.isDensityMatrix;
+    qreal* vecRe = qureg.stateVec.real;
+    qreal* vecIm = qureg.stateVec.imag;
+    long long int* qbOffs = qubitOffsets.data();
+    long long int* outOffs = outOffsets.data();
+    int* accSubs = accumSubsets.data();
+    long long int* accOffs = accumOffsets.data();
+    
+    long long int i, j, e, ind;
+    int s, a, k;
+    qreal prob;
+    
+    // a single sweep over the amplitudes populates every small table, with each thread 
+    // accumulating into its own partial tables which are merged at the end
+    if (numAccumSubsets > 0) {
 # ifdef _OPENMP
 # pragma omp parallel \
     default  (none) \
-    shared   (numSamples,numQb,sampleBases,sampleOutcomes, baseBitseqs,outcomeBitseqs) \
-    private  (s,seqBases,seqOuts,offset,q,ind)
+    shared   (outProbs, numStates,stride,isDensMatr, vecRe,vecIm, subsetQubits,numQubitsPerSubset, \
+              qbOffs,outOffs, accSubs,accOffs,numAccumSubsets,numAccumProbs) \
+    private  (i,j,ind,s,a,k, prob)
 # endif
-    {
+        {
+            std::vector<qreal> partialProbs(numAccumProbs, 0);
+            
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (s=0; s<numSamples; s++) {
-            
-            seqBases = 00ULL;   // length 2*numQb
-            seqOuts = 0ULL;     // length numQb
-            offset = numQb*s;
-            
-            for (q=numQb-1; q>=0; q--) {
-                ind = offset+q;
-                seqBases = (seqBases << 2) | sampleBases[ind];
-                seqOuts = (seqOuts << 1) | sampleOutcomes[ind];
+            for (i=0; i<numStates; i++) {
+                j = i*stride;
+                prob = (isDensMatr)? vecRe[j] : vecRe[j]*vecRe[j] + vecIm[j]*vecIm[j];
+                
+                for (a=0; a<numAccumSubsets; a++) {
+                    s = accSubs[a];
+                    ind = 0;
+                    for (k=0; k<numQubitsPerSubset[s]; k++)
+                        ind |= ((i >> subsetQubits[qbOffs[s] + k]) & 1LL) << k;
+                    partialProbs[accOffs[a] + ind] += prob;
+                }
             }
             
-            baseBitseqs[s] = seqBases;
-            outcomeBitseqs[s] = seqOuts;
+# ifdef _OPENMP
+# pragma omp critical
+# endif
+            for (a=0; a<numAccumSubsets; a++)
+                for (ind=0; ind<accOffs[a+1]-accOffs[a]; ind++)
+                    outProbs[outOffs[accSubs[a]] + ind] += partialProbs[accOffs[a] + ind];
         }
     }
     
-    // parallel evauate the expected values of each pauli product, in time O(numProds*numSamples),
-    // modifying output array prodExpecVals.
-    unsigned long long targOuts;
-    long numSampsPerBatch = (long) ceil(numSamples/(qreal) numBatches);
-    int numProdPaulis, b, isFinalBatch, match, par; // re-using p
-    long batchSize, val; // re-using s, i
-    qreal fac;
-    std::vector<qreal> batchVals(numBatches); // thread-private
+    // while each large table has its outcomes divided between threads, each summing 
+    // the probabilities of every basis state of the other qubits
+    for (s=0; s<numSubsets; s++) {
+        if (isAccum[s])
+            continue;
+        
+        int numSubQb = numQubitsPerSubset[s];
+        int* subQbs = &subsetQubits[qbOffs[s]];
+        std::vector<int> otherQubits;
+        for (int q=0; q<numQb; q++)
+            if (std::find(subQbs, subQbs + numSubQb, q) == subQbs + numSubQb)
+                otherQubits.push_back(q);
+        
+        int numOtherQb = otherQubits.size();
+        int* otherQbs = otherQubits.data();
+        long long int numSubOuts = 1LL << numSubQb;
+        long long int numOtherStates = 1LL << numOtherQb;
+        qreal* subProbs = &outProbs[outOffs[s]];
+        long long int subInd;
+        
 # ifdef _OPENMP
 # pragma omp parallel \
     default  (none) \
-    shared   (numProds,numBatches,numSamples,numSampsPerBatch, pauliCodes,pauliTargs, \
-              numPaulisPerProd, baseBitseqs,outcomeBitseqs,pauliBitseqs, \
-              pauliTargBitseqs,outcomeTargBitseqs, prodExpecVals) \
-    private  (numProdPaulis,isFinalBatch,batchSize, targOuts, p,b,i,s, par,val,match,fac) \
-    firstprivate (batchVals)
+    shared   (subProbs, stride,isDensMatr, vecRe,vecIm, subQbs,numSubQb,numSubOuts, \
+              otherQbs,numOtherQb,numOtherStates) \
+    private  (i,j,e,ind,k, subInd, prob)
 # endif
-    {
+        {
 # ifdef _OPENMP
 # pragma omp for schedule (static)
 # endif
-        for (p=0; p<numProds; p++) {
-            
-            numProdPaulis = numPaulisPerProd[p];
-            
-            // divide the sample into batches, where numBatches expected << 100
-            for (b=0; b<numBatches; b++) {
+            for (ind=0; ind<numSubOuts; ind++) {
+                subInd = 0;
+                for (k=0; k<numSubQb; k++)
+                    subInd |= ((ind >> k) & 1LL) << subQbs[k];
                 
-                // batch indivisibility may mean final batch has fewer samples than others
-                isFinalBatch = (b == (numBatches-1));
-                batchSize = isFinalBatch * (numSamples-(numBatches-1)*numSampsPerBatch) + (1-isFinalBatch) * numSampsPerBatch;
-                
-                val = 0;
-                for (i=0; i<batchSize; i++) {
-                    s = b*batchSize + i;
-                    
-                    // determine whether this sample matches the pauli product
-                    match = (baseBitseqs[s] & pauliTargBitseqs[p]) == pauliBitseqs[p];
+                prob = 0;
+                for (e=0; e<numOtherStates; e++) {
+                    i = subInd;
+                    for (k=0; k<numOtherQb; k++)
+                        i |= ((e >> k) & 1LL) << otherQbs[k];
+                    j = i*stride;
+                    prob += (isDensMatr)? vecRe[j] : vecRe[j]*vecRe[j] + vecIm[j]*vecIm[j];
+                }
+                subProbs[ind] = prob;
+            }
+        }
+    }
+}
+
+void extension_calcReducedDensityMatrix(
+    qreal* outRe, qreal* outIm, Qureg qureg, int* keptQubits, int numKept
+) {
+    int numQb = qureg.numQubitsRepresented;
+    long long int dim = 1LL << numQb;
+    long long int dimKept = 1LL << numKept;
+    long long int dimTraced = 1LL << (numQb - numKept);
+    long long int numOuts = dimKept * dimKept;
+    
+    // the full index of every kept basis state (with zero traced qubits), and the traced qubits
+    std::vector<long long int> keptInds(dimKept, 0);
+    for (long long int a=0; a<dimKept; a++)
+        for (int k=0; k<numKept; k++)
+            if ((a >> k) & 1)
+                keptInds[a] |= 1LL << keptQubits[k];
+    std::vector<int> tracedQubits;
+    for (int q=0; q<numQb; q++)
+        if (std::find(keptQubits, keptQubits + numKept, q) == keptQubits + numKept)
+            tracedQubits.push_back(q);
+    
+    for (long long int i=0; i<numOuts; i++) {
+        outRe[i] = 0;
+        outIm[i] = 0;
+    }
+    
+    // element (r,c) of the reduced matrix (stored column-wise, like a density qureg) sums
+    // psi[r|e] conj(psi[c|e]) of a state-vector, or rho[r|e][c|e] of a density matrix, over
+    // every basis state e of the traced qubits
+    int numTraced = tracedQubits.size();
+    int isDensMatr = qureg.isDensityMatrix;
+    qreal* vecRe = qureg.stateVec.real;
+    qreal* vecIm = qureg.stateVec.imag;
+    long long int* kept = keptInds.data();
+    int* traced = tracedQubits.data();
+    
+    long long int e, r, c, i, j, envInd, out;
+    int t;
+    qreal cRe, cIm;
+    
+    // a small reduced matrix is accumulated by each thread over a share of the traced states, 
+    // with the partial matrices merged at the end
+    if (numOuts <= MAX_NUM_ELEMS_FOR_PARTIAL_TRACE_ACCUMULATORS) {
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (outRe,outIm, dim,dimKept,dimTraced,numOuts, numTraced,traced,kept, isDensMatr,vecRe,vecIm) \
+    private  (e,r,c,i,j,envInd,out,t, cRe,cIm)
+# endif
+        {
+            std::vector<qreal> partialRe(numOuts, 0);
+            std::vector<qreal> partialIm(numOuts, 0);
+            
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+            for (e=0; e<dimTraced; e++) {
+                envInd = 0;
+                for (t=0; t<numTraced; t++)
+                    envInd |= ((e >> t) & 1LL) << traced[t];
                     
-                    // obtain the outcomes of only the targeted qubits (rest forced to 0)
-                    targOuts = (outcomeBitseqs[s] & outcomeTargBitseqs[p]);
-
-                    // bit-twiddling hack to determine parity of number of 1s in targOuts
-                    // https://graphics.stanford.edu/~seander/bithacks.html#ParityMultiply
-                    targOuts ^= targOuts >> 1;
-                    targOuts ^= targOuts >> 2;
-                    targOuts = (targOuts & 0x1111111111111111UL) * 0x1111111111111111UL;
-                    par = (targOuts >> 60) & 1;
+                for (c=0; c<dimKept; c++) {
+                    j = envInd | kept[c];
+                    cRe = vecRe[j];
+                    cIm = vecIm[j];
                     
-                    // contribute sample if match (without branching)
-                    val += match * (1-2*par);
+                    for (r=0; r<dimKept; r++) {
+                        i = envInd | kept[r];
+                        out = r + c*dimKept;
+                        if (isDensMatr) {
+                            partialRe[out] += vecRe[i + j*dim];
+                            partialIm[out] += vecIm[i + j*dim];
+                        } else {
+                            partialRe[out] += vecRe[i]*cRe + vecIm[i]*cIm;
+                            partialIm[out] += vecIm[i]*cRe - vecRe[i]*cIm;
+                        }
+                    }
                 }
-                
-                batchVals[b] = val / (qreal) batchSize;
             }
             
-            // choose the median of the batch values
-            fac = pow(3, numProdPaulis);
-            std::sort(batchVals.begin(), batchVals.end());
-            if (numBatches % 2)
-                prodExpecVals[p] = fac * batchVals[numBatches/2];
-            else 
-                prodExpecVals[p] = fac * .5 * (batchVals[numBatches/2] + batchVals[numBatches/2 + 1]);
+# ifdef _OPENMP
+# pragma omp critical
+# endif
+            for (out=0; out<numOuts; out++) {
+                outRe[out] += partialRe[out];
+                outIm[out] += partialIm[out];
+            }
+        }
+        
+    // while a large reduced matrix has its columns divided between threads
+    } else {
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (outRe,outIm, dim,dimKept,dimTraced, numTraced,traced,kept, isDensMatr,vecRe,vecIm) \
+    private  (e,r,c,i,j,envInd,out,t, cRe,cIm)
+# endif
+        {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+            for (c=0; c<dimKept; c++) {
+                for (e=0; e<dimTraced; e++) {
+                    envInd = 0;
+                    for (t=0; t<numTraced; t++)
+                        envInd |= ((e >> t) & 1LL) << traced[t];
+                    
+                    j = envInd | kept[c];
+                    cRe = vecRe[j];
+                    cIm = vecIm[j];
+                    
+                    for (r=0; r<dimKept; r++) {
+                        i = envInd | kept[r];
+                        out = r + c*dimKept;
+                        if (isDensMatr) {
+                            outRe[out] += vecRe[i + j*dim];
+                            outIm[out] += vecIm[i + j*dim];
+                        } else {
+                            outRe[out] += vecRe[i]*cRe + vecIm[i]*cIm;
+                            outIm[out] += vecIm[i]*cRe - vecRe[i]*cIm;
+                        }
+                    }
+                }
+            }
         }
     }
 }
 
+
+
+/*
+ * QUREG ALLOCATION
+ */
+
+/** The padded number of bytes of each amplitude array of qureg as allocated by 
+ * extension_reallocQuregAmps(), or 0 if QuEST's allocation is retained
+ */
+long long int local_getReallocNumBytes(Qureg qureg, QuregAllocMode mode) {
+    
+    long long int numBytes = qureg.numAmpsPerChunk * (long long int) sizeof(qreal);
+    if (mode == ALLOC_DEFAULT || numBytes < QUREG_ALLOC_NUM_BYTES_PER_PAGE)
+        return 0;
+    
+    long long int numPages = (numBytes + QUREG_ALLOC_NUM_BYTES_PER_PAGE - 1) / QUREG_ALLOC_NUM_BYTES_PER_PAGE;
+    return numPages * QUREG_ALLOC_NUM_BYTES_PER_PAGE;
+}
+
+/** Returns untouched memory of numBytes (a multiple of the page size), or NULL
+ */
+qreal* local_allocUntouchedAmps(long long int numBytes, QuregAllocMode mode) {
+    
+#ifndef _WIN32
+    
+    void* mem = MAP_FAILED;
+    
+    // explicit huge pages must be reserved by the administrator, else we fall back to transparent
+#ifdef MAP_HUGETLB
+    if (mode == ALLOC_EXPLICIT_HUGE_PAGES)
+        mem = mmap(NULL, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            return NULL;
+        
+        // must precede the first touch, so that faults are served by huge pages
+#ifdef MADV_HUGEPAGE
+        if (mode != ALLOC_FIRST_TOUCH)
+            madvise(mem, numBytes, MADV_HUGEPAGE);
+#endif
+    }
+    return (qreal*) mem;
+
+#else
+    
+    // Windows lacks anonymous huge pages without privileges, but still places pages upon first touch
+    return (qreal*) malloc(numBytes);
+
+#endif
+}
+
+void local_freeUntouchedAmps(qreal* amps, long long int numBytes) {
+    
+#ifndef _WIN32
+    munmap(amps, numBytes);
+#else
+    free(amps);
+#endif
+}
+
+void extension_reallocQuregAmps(Qureg& qureg, QuregAllocMode mode) {
+    
+    long long int numBytes = local_getReallocNumBytes(qureg, mode);
+    if (numBytes == 0)
+        return;
+    
+    // QuEST's memory is released first, so that the peak memory is not doubled
+    free(qureg.stateVec.real);
+    free(qureg.stateVec.imag);
+    qureg.stateVec.real = NULL;
+    qureg.stateVec.imag = NULL;
+    
+    qreal* vecRe = local_allocUntouchedAmps(numBytes, mode);
+    qreal* vecIm = local_allocUntouchedAmps(numBytes, mode);
+    if (vecRe == NULL || vecIm == NULL) {
+        if (vecRe != NULL)
+            local_freeUntouchedAmps(vecRe, numBytes);
+        if (vecIm != NULL)
+            local_freeUntouchedAmps(vecIm, numBytes);
+        throw QuESTException("", "Could not allocate the " + std::to_string(2*numBytes) + 
+            " bytes of the qureg's amplitudes."); // throws
+    }
+    
+    // each thread first-touches (and so places) the amplitudes it processes in every static kernel
+    long long int numAmps = qureg.numAmpsPerChunk;
+    long long int i;
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (numAmps, vecRe,vecIm) \
+    private  (i)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (i=0; i<numAmps; i++) {
+            vecRe[i] = 0;
+            vecIm[i] = 0;
+        }
+    }
+    
+    // restore the zero state (of both state-vectors and density matrices)
+    vecRe[0] = 1;
+    
+    qureg.stateVec.real = vecRe;
+    qureg.stateVec.imag = vecIm;
+}
+
+void extension_freeQuregAmps(Qureg& qureg, QuregAllocMode mode) {
+    
+    long long int numBytes = local_getReallocNumBytes(qureg, mode);
+    if (numBytes == 0)
+        return;
+    
+    // QuEST's subsequent free of the NULL arrays does nothing
+    local_freeUntouchedAmps(qureg.stateVec.real, numBytes);
+    local_freeUntouchedAmps(qureg.stateVec.imag, numBytes);
+    qureg.stateVec.real = NULL;
+    qureg.stateVec.imag = NULL;
+}
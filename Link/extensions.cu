@@ -12,8 +12,8 @@
 
 #include <vector>
 #include <algorithm>
-#include <thrust/sort.h>
-#include <thrust/execution_policy.h>
+
+#include "extensions.hpp"
 
 
 
@@ -27,6 +27,13 @@ __forceinline__ __device__ long long int flipBit(const long long int number, con
 
 
 
+/** Whether amplitude a = (probability, index) precedes b in order of decreasing
+ * probability, with ties broken in favour of the smaller index
+ */
+bool local_isMoreProbableAmp(const std::pair<qreal,long long int>& a, const std::pair<qreal,long long int>& b) {
+    return (a.first > b.first) || (a.first == b.first && a.second < b.second);
+}
+
 __global__ void extension_isHermitianKernel(Qureg qureg, int *isHermit) {
 
     // if any kernel set the flag to false, stop
@@ -396,224 +403,215 @@ void extension_mixDampingDeriv(Qureg qureg, int targ, qreal prob, qreal probDeri
     extension_addAdjointToSelfKernel<<<CUDABlocks, threadsPerCUDABlock>>>(qureg);
 }
 
-__global__ void local_validateShadowPaulisKernel(int* invalid, int numQb, unsigned long long  numTotalPaulis, int* pauliCodes, int* pauliTargs) {
-    long long int k = blockIdx.x*blockDim.x + threadIdx.x;
-    if (k >= numTotalPaulis) return;
+__global__ void extension_getAmpsKernel(Qureg qureg, long long int* inds, long long int numInds, qreal* outRe, qreal* outIm) {
     
-    if (pauliCodes[k] < 0 || pauliCodes[k] > 3 || pauliTargs[k] < 0 || pauliTargs[k] >= numQb)
-        *invalid = 1;
-}
-
-__global__ void local_validateShadowSampsKernel(int* invalid, unsigned long long numTotalSampVals, int* sampleBases, int* sampleOutcomes) {
-    long long int k = blockIdx.x*blockDim.x + threadIdx.x;
-    if (k >= numTotalSampVals) return;
+    long long int thisTask = blockIdx.x*blockDim.x + threadIdx.x;
+    if (thisTask >= numInds) return;
     
-    if (sampleBases[k] < 1 || sampleBases[k] > 3 || sampleOutcomes[k] < 0 || sampleOutcomes[k] > 1)
-        *invalid = 1;
+    outRe[thisTask] = qureg.deviceStateVec.real[inds[thisTask]];
+    outIm[thisTask] = qureg.deviceStateVec.imag[inds[thisTask]];
 }
 
-__global__ void local_prepareShadowPauliBitseqsKernel(
-    unsigned long long* pauliBitseqs, unsigned long long* pauliTargBitseqs, unsigned long long* outcomeTargBitseqs,
-    long numProds, int* numPaulisPerProd, long* pauliIndOffset, int* pauliCodes, int* pauliTargs
-) {
-    long long int i = blockIdx.x*blockDim.x + threadIdx.x;
-    if (i >= numProds) return;
+void extension_getAmps(Qureg qureg, long long int* inds, long long int numInds, qreal* outRe, qreal* outIm) {
     
-    int offset = pauliIndOffset[i];
-    int numPaulisInProd = numPaulisPerProd[i];
+    // gather the amplitudes on the device, so that only they are copied to RAM
+    long long int* d_inds;
+    qreal *d_outRe, *d_outIm;
+    cudaMalloc(&d_inds, numInds * sizeof *d_inds);
+    cudaMalloc(&d_outRe, numInds * sizeof *d_outRe);
+    cudaMalloc(&d_outIm, numInds * sizeof *d_outIm);
+    cudaMemcpy(d_inds, inds, numInds * sizeof *d_inds, cudaMemcpyHostToDevice);
     
-    unsigned long long seqPaulis = 00ULL;      // length 2*numQb
-    unsigned long long seqPauliTargs = 00ULL;  // length 2*numQb
-    unsigned long long seqOutcomeTargs = 0ULL; // length numQb
+    int threadsPerCUDABlock = 128;
+    int CUDABlocks = ceil(numInds / (qreal) threadsPerCUDABlock);
+    extension_getAmpsKernel<<<CUDABlocks, threadsPerCUDABlock>>>(qureg, d_inds, numInds, d_outRe, d_outIm);
     
-    for (int p=0; p<numPaulisInProd; p++) {
-        int j = offset + p;
-        seqPaulis |= (pauliCodes[j] << 2*pauliTargs[j]);
-        seqPauliTargs |= (3ULL << 2*pauliTargs[j]);
-        seqOutcomeTargs |= (1ULL << pauliTargs[j]);
-    }
+    cudaMemcpy(outRe, d_outRe, numInds * sizeof *d_outRe, cudaMemcpyDeviceToHost);
+    cudaMemcpy(outIm, d_outIm, numInds * sizeof *d_outIm, cudaMemcpyDeviceToHost);
     
-    pauliBitseqs[i] = seqPaulis;
-    pauliTargBitseqs[i] = seqPauliTargs;
-    outcomeTargBitseqs[i] = seqOutcomeTargs;
+    cudaFree(d_inds);
+    cudaFree(d_outRe);
+    cudaFree(d_outIm);
 }
 
-__global__ void local_prepareShadowSampleBitseqsKernel(
-    unsigned long long* baseBitseqs, unsigned long long* outcomeBitseqs,
-    int numQb, long numSamples, int* sampleBases, int* sampleOutcomes
-) {
-    long long int s = blockIdx.x*blockDim.x + threadIdx.x;
-    if (s >= numSamples) return;
+void extension_getAmpRange(Qureg qureg, long long int startInd, long long int numAmps, qreal* outRe, qreal* outIm) {
     
-    long offset = numQb*s;
-    unsigned long long seqBases = 00ULL;   // length 2*numQb
-    unsigned long long seqOuts = 0ULL;     // length numQb
-
-    for (int q=numQb-1; q>=0; q--) {
-        int ind = offset + q;
-        seqBases = (seqBases << 2) | sampleBases[ind];
-        seqOuts = (seqOuts << 1) | sampleOutcomes[ind];
-    }
-        
-    baseBitseqs[s] = seqBases;
-    outcomeBitseqs[s] = seqOuts;
+    // copy only the range, rather than the whole state via copyStateFromGPU()
+    cudaDeviceSynchronize();
+    cudaMemcpy(outRe, qureg.deviceStateVec.real + startInd, numAmps * sizeof *outRe, cudaMemcpyDeviceToHost);
+    cudaMemcpy(outIm, qureg.deviceStateVec.imag + startInd, numAmps * sizeof *outIm, cudaMemcpyDeviceToHost);
 }
 
-#define MAX_NUM_SHADOW_BATCHES 200
+void extension_setAmpRange(Qureg qureg, long long int startInd, long long int numAmps, qreal* ampsRe, qreal* ampsIm) {
     
-__global__ void extension_calcExpecPauliProdsFromClassicalShadowKernel(
-    qreal* prodExpecVals,
-    int numProds, int numSamples, int numBatches,
-    int* numPaulisPerProd,
-    unsigned long long *baseBitseqs, unsigned long long *pauliTargBitseqs, 
-    unsigned long long *pauliBitseqs, unsigned long long *outcomeBitseqs, 
-    unsigned long long *outcomeTargBitseqs
+    cudaDeviceSynchronize();
+    cudaMemcpy(qureg.deviceStateVec.real + startInd, ampsRe, numAmps * sizeof *ampsRe, cudaMemcpyHostToDevice);
+    cudaMemcpy(qureg.deviceStateVec.imag + startInd, ampsIm, numAmps * sizeof *ampsIm, cudaMemcpyHostToDevice);
+}
+
+void extension_getMostProbableInds(
+    std::vector<long long int>& outInds, Qureg qureg, long long int maxNumInds, qreal minProb
 ) {
-    // parallel evauate the expected values of each pauli product, modifying output array prodExpecVals.
-    long long int p = blockIdx.x*blockDim.x + threadIdx.x;
-    if (p >= numProds) return;
+    // the selection is performed in RAM, so that only the selected amps (rather than 
+    // the whole state) need later be sent to Mathematica
+    copyStateFromGPU(qureg);
+    
+    // density matrices are ranked by their diagonal, whose indices are returned as rows
+    long long int numProbs = (qureg.isDensityMatrix)? 
+        (1LL << qureg.numQubitsRepresented) : qureg.numAmpsTotal;
+    long long int stride = (qureg.isDensityMatrix)? numProbs + 1 : 1;
+    
+    // a negative maxNumInds imposes no limit
+    bool isBounded = (maxNumInds >= 0);
+    if (isBounded && maxNumInds > numProbs)
+        maxNumInds = numProbs;
+    
+    outInds.clear();
+    if (maxNumInds == 0)
+        return;
     
-    // divide this thread's job into batches 
-    qreal batchVals[MAX_NUM_SHADOW_BATCHES];
-    long numSampsPerBatch = (long) ceil(numSamples/(qreal) numBatches);
-    int numProdPaulis = numPaulisPerProd[p];
+    qreal* vecRe = qureg.stateVec.real;
+    qreal* vecIm = qureg.stateVec.imag;
     
-    // populate batch values
-    for (int b=0; b<numBatches; b++) {
-        
-        // batch indivisibility may mean final batch has fewer samples than others
-        bool isFinalBatch = (b == (numBatches-1));
-        long batchSize = isFinalBatch * (numSamples-(numBatches-1)*numSampsPerBatch) + (1-isFinalBatch) * numSampsPerBatch;
+    // a bounded heap, whose front is the least probable selected amp
+    std::vector<std::pair<qreal,long long int>> best;
+    for (long long int i=0; i<numProbs; i++) {
+        long long int j = i*stride;
+        qreal prob = (qureg.isDensityMatrix)? vecRe[j] : vecRe[j]*vecRe[j] + vecIm[j]*vecIm[j];
+        if (prob < minProb)
+            continue;
         
-        long val = 0;
-        for (long i=0; i<batchSize; i++) {
-            long s = b*batchSize + i;
-            
-            // determine whether this sample matches the pauli product
-            int match = (baseBitseqs[s] & pauliTargBitseqs[p]) == pauliBitseqs[p];
-            
-            // obtain the outcomes of only the targeted qubits (rest forced to 0)
-            unsigned long long targOuts = (outcomeBitseqs[s] & outcomeTargBitseqs[p]);
-
-            // bit-twiddling hack to determine parity of number of 1s in targOuts
-            // https://graphics.stanford.edu/~seander/bithacks.html#ParityMultiply
-            targOuts ^= targOuts >> 1;
-            targOuts ^= targOuts >> 2;
-            targOuts = (targOuts & 0x1111111111111111UL) * 0x1111111111111111UL;
-            int par = (targOuts >> 60) & 1;
-            
-            // contribute sample if match (without branching)
-            val += match * (1-2*par);
+        std::pair<qreal,long long int> amp(prob, i);
+        if (!isBounded)
+            best.push_back(amp);
+        else if ((long long int) best.size() < maxNumInds) {
+            best.push_back(amp);
+            std::push_heap(best.begin(), best.end(), local_isMoreProbableAmp);
+        }
+        else if (local_isMoreProbableAmp(amp, best.front())) {
+            std::pop_heap(best.begin(), best.end(), local_isMoreProbableAmp);
+            best.back() = amp;
+            std::push_heap(best.begin(), best.end(), local_isMoreProbableAmp);
         }
-        
-        batchVals[b] = val / (qreal) batchSize;
     }
     
-    qreal fac = pow((qreal) 3., (qreal) numProdPaulis); 
+    std::sort(best.begin(), best.end(), local_isMoreProbableAmp);
     
-    // choose the median of the batch values
-    thrust::sort(thrust::seq, batchVals, &(batchVals[numBatches]));
-    if (numBatches % 2)
-        prodExpecVals[p] = fac * batchVals[numBatches/2];
-    else 
-        prodExpecVals[p] = fac * .5 * (batchVals[numBatches/2] + batchVals[numBatches/2 + 1]);
+    outInds.resize(best.size());
+    for (size_t k=0; k<best.size(); k++)
+        outInds[k] = best[k].second;
 }
 
-void extension_calcExpecPauliProdsFromClassicalShadow(
-    std::vector<qreal> &prodExpecVals, long numProds,
-    int* sampleBases, int* sampleOutcomes, int numQb, long numSamples,
-    int* pauliCodes, int* pauliTargs, int* numPaulisPerProd,
-    int numBatches
+void extension_calcProbsOfAllOutcomesOfSubsets(
+    qreal* outProbs, Qureg qureg, int* subsetQubits, int* numQubitsPerSubset, int numSubsets
 ) {
-    // early numBatches validation, since we must be more strict than the CPU variant
-    if (numBatches > MAX_NUM_SHADOW_BATCHES)
-        throw QuESTException("", "The maximum number of batches permitted in GPU mode is " + std::to_string(MAX_NUM_SHADOW_BATCHES));
-    
-    // serial array encode: O(numProds)
-    std::vector<long> pauliIndOffset(numProds);
-    pauliIndOffset[0] = 0;
-    for (int i=1; i<numProds; i++)
-        pauliIndOffset[i] = pauliIndOffset[i-1] + numPaulisPerProd[i-1];
-        
-    // prepare device copy of output structure
-    qreal* d_prodExpecVals;
-    size_t memExpecVals = numProds * sizeof *d_prodExpecVals;
-    cudaMalloc(&d_prodExpecVals, memExpecVals);
-        
-    // prepare device copies of input structures
-    unsigned long long numTotalPaulis = pauliIndOffset[numProds-1] + numPaulisPerProd[numProds-1];
-    size_t memSamps = numSamples*numQb * sizeof(int);
-    size_t memPaulis = numTotalPaulis * sizeof (int);
-    size_t memProds = numProds * sizeof (int);
-    int* d_sampleBases;         cudaMalloc(&d_sampleBases, memSamps);       cudaMemcpy(d_sampleBases, sampleBases, memSamps, cudaMemcpyHostToDevice);
-    int* d_sampleOutcomes;      cudaMalloc(&d_sampleOutcomes, memSamps);    cudaMemcpy(d_sampleOutcomes, sampleOutcomes, memSamps, cudaMemcpyHostToDevice);
-    int* d_pauliCodes;          cudaMalloc(&d_pauliCodes, memPaulis);       cudaMemcpy(d_pauliCodes, pauliCodes, memPaulis, cudaMemcpyHostToDevice);
-    int* d_pauliTargs;          cudaMalloc(&d_pauliTargs, memPaulis);       cudaMemcpy(d_pauliTargs, pauliTargs, memPaulis, cudaMemcpyHostToDevice);
-    int* d_numPaulisPerProd;    cudaMalloc(&d_numPaulisPerProd, memProds);  cudaMemcpy(d_numPaulisPerProd, numPaulisPerProd, memProds, cudaMemcpyHostToDevice);
-    
-    // prepare device working structures
-    size_t memOffset = numProds * sizeof(long);
-    long *d_pauliIndOffset; 
-    cudaMalloc(&d_pauliIndOffset, memOffset);
-    cudaMemcpy(d_pauliIndOffset, pauliIndOffset.data(), memOffset, cudaMemcpyHostToDevice);
-    
-    memProds = numProds * sizeof(unsigned long long);
-    memSamps = numSamples * sizeof(unsigned long long);
-    unsigned long long *d_pauliBitseqs;         cudaMalloc(&d_pauliBitseqs, memProds);
-    unsigned long long *d_pauliTargBitseqs;     cudaMalloc(&d_pauliTargBitseqs, memProds);
-    unsigned long long *d_outcomeTargBitseqs;   cudaMalloc(&d_outcomeTargBitseqs, memProds);
-    unsigned long long *d_baseBitseqs;          cudaMalloc(&d_baseBitseqs, memSamps);
-    unsigned long long *d_outcomeBitseqs;       cudaMalloc(&d_outcomeBitseqs, memSamps);
-    
-    int bs = 128; // blocksize for GPU parallelisation
-    
-    // perform validation 
-    int invalid = 0;
-    int *d_invalid;
-    cudaMalloc(&d_invalid, sizeof(int));
-    cudaMemcpy(d_invalid, &invalid, sizeof(int), cudaMemcpyHostToDevice); 
-    local_validateShadowPaulisKernel<<<ceil(numTotalPaulis/(qreal)bs), bs>>>(
-        d_invalid, numQb, numTotalPaulis, d_pauliCodes, d_pauliTargs);
-    local_validateShadowSampsKernel<<<ceil(numSamples*numQb/(qreal)bs), bs>>>(
-        d_invalid, numSamples*numQb, d_sampleBases, d_sampleOutcomes);
-    cudaMemcpy(&invalid, d_invalid, sizeof(int), cudaMemcpyDeviceToHost);
-    cudaFree(d_invalid);
-    
-    if (!invalid) {
-        
-        // prepare bit sequences
-        local_prepareShadowPauliBitseqsKernel<<<ceil(numProds/(qreal)bs), bs>>>(
-            d_pauliBitseqs, d_pauliTargBitseqs, d_outcomeTargBitseqs,
-            numProds, d_numPaulisPerProd, d_pauliIndOffset, d_pauliCodes, d_pauliTargs);
-        local_prepareShadowSampleBitseqsKernel<<<ceil(numSamples/(qreal)bs), bs>>>(
-            d_baseBitseqs, d_outcomeBitseqs,
-            numQb, numSamples, d_sampleBases, d_sampleOutcomes);
-            
-        // evaluate shadow expec values
-        extension_calcExpecPauliProdsFromClassicalShadowKernel<<<ceil(numSamples/(qreal)bs), bs>>>(
-            d_prodExpecVals,
-            numProds, numSamples, numBatches, 
-            d_numPaulisPerProd, d_baseBitseqs, d_pauliTargBitseqs, 
-            d_pauliBitseqs, d_outcomeBitseqs, d_outcomeTargBitseqs);
+    // the GPU marginal of each subset is already a single parallel pass; the tables are
+    // concatenated in outProbs, in order of the subsets
+    long long int qubitOffset = 0;
+    long long int outOffset = 0;
+    
+    for (int s=0; s<numSubsets; s++) {
+        calcProbOfAllOutcomes(&outProbs[outOffset], qureg, &subsetQubits[qubitOffset], numQubitsPerSubset[s]);
+        qubitOffset += numQubitsPerSubset[s];
+        outOffset += 1LL << numQubitsPerSubset[s];
+    }
+}
+
+
+
+__global__ void extension_calcReducedDensityMatrixKernel(
+    qreal* outRe, qreal* outIm, Qureg qureg, long long int* keptInds, int* tracedQubits, int numKept
+) {
+    // each thread computes one element (r,c) of the column-wise reduced matrix
+    long long int dimKept = 1LL << numKept;
+    long long int thisTask = blockIdx.x*blockDim.x + threadIdx.x;
+    if (thisTask >= dimKept*dimKept) return;
+    
+    long long int r = thisTask % dimKept;
+    long long int c = thisTask / dimKept;
+    int numTraced = qureg.numQubitsRepresented - numKept;
+    long long int dim = 1LL << qureg.numQubitsRepresented;
+    qreal* stateRe = qureg.deviceStateVec.real;
+    qreal* stateIm = qureg.deviceStateVec.imag;
+    
+    qreal sumRe = 0;
+    qreal sumIm = 0;
+    for (long long int e=0; e < (1LL << numTraced); e++) {
+        long long int envInd = 0;
+        for (int t=0; t<numTraced; t++)
+            envInd |= ((e >> t) & 1LL) << tracedQubits[t];
             
-        // copy expec vals back to RAM 
-        cudaMemcpy(prodExpecVals.data(), d_prodExpecVals, memExpecVals, cudaMemcpyDeviceToHost);
+        long long int i = envInd | keptInds[r];
+        long long int j = envInd | keptInds[c];
+        if (qureg.isDensityMatrix) {
+            sumRe += stateRe[i + j*dim];
+            sumIm += stateIm[i + j*dim];
+        } else {
+            sumRe += stateRe[i]*stateRe[j] + stateIm[i]*stateIm[j];
+            sumIm += stateIm[i]*stateRe[j] - stateRe[i]*stateIm[j];
+        }
     }
+    
+    outRe[thisTask] = sumRe;
+    outIm[thisTask] = sumIm;
+}
+
+void extension_calcReducedDensityMatrix(
+    qreal* outRe, qreal* outIm, Qureg qureg, int* keptQubits, int numKept
+) {
+    int numQb = qureg.numQubitsRepresented;
+    long long int dimKept = 1LL << numKept;
+    long long int numOuts = dimKept * dimKept;
+    
+    // the full index of every kept basis state (with zero traced qubits), and the traced qubits
+    std::vector<long long int> keptInds(dimKept, 0);
+    for (long long int a=0; a<dimKept; a++)
+        for (int k=0; k<numKept; k++)
+            if ((a >> k) & 1)
+                keptInds[a] |= 1LL << keptQubits[k];
+    std::vector<int> tracedQubits;
+    for (int q=0; q<numQb; q++)
+        if (std::find(keptQubits, keptQubits + numKept, q) == keptQubits + numKept)
+            tracedQubits.push_back(q);
+    
+    long long int* d_keptInds;
+    int* d_tracedQubits;
+    qreal *d_outRe, *d_outIm;
+    cudaMalloc(&d_keptInds, dimKept * sizeof *d_keptInds);
+    cudaMalloc(&d_tracedQubits, (tracedQubits.size() + 1) * sizeof *d_tracedQubits);
+    cudaMalloc(&d_outRe, numOuts * sizeof *d_outRe);
+    cudaMalloc(&d_outIm, numOuts * sizeof *d_outIm);
+    cudaMemcpy(d_keptInds, keptInds.data(), dimKept * sizeof *d_keptInds, cudaMemcpyHostToDevice);
+    cudaMemcpy(d_tracedQubits, tracedQubits.data(), tracedQubits.size() * sizeof *d_tracedQubits, cudaMemcpyHostToDevice);
+    
+    int threadsPerCUDABlock = 128;
+    int CUDABlocks = ceil(numOuts / (qreal) threadsPerCUDABlock);
+    extension_calcReducedDensityMatrixKernel<<<CUDABlocks, threadsPerCUDABlock>>>(
+        d_outRe, d_outIm, qureg, d_keptInds, d_tracedQubits, numKept);
+    
+    cudaMemcpy(outRe, d_outRe, numOuts * sizeof *d_outRe, cudaMemcpyDeviceToHost);
+    cudaMemcpy(outIm, d_outIm, numOuts * sizeof *d_outIm, cudaMemcpyDeviceToHost);
+    
+    cudaFree(d_keptInds);
+    cudaFree(d_tracedQubits);
+    cudaFree(d_outRe);
+    cudaFree(d_outIm);
+}
 
-    // clean-up
-    cudaFree(d_prodExpecVals);
-    cudaFree(d_sampleOutcomes);
-    cudaFree(d_pauliCodes);
-    cudaFree(d_pauliTargs);
-    cudaFree(d_numPaulisPerProd);
-    cudaFree(d_pauliIndOffset);
-    cudaFree(d_pauliBitseqs);
-    cudaFree(d_pauliTargBitseqs);
-    cudaFree(d_outcomeTargBitseqs);
-    cudaFree(d_baseBitseqs);
-    cudaFree(d_outcomeBitseqs);
-    
-    if (invalid)
-        throw QuESTException("", "The input classical shadow, or the Pauli products, were invalid.");
+
+
+/*
+ * QUREG ALLOCATION
+ */
+
+void extension_reallocQuregAmps(Qureg& qureg, QuregAllocMode mode) {
+    
+    // the amplitudes are processed in GPU memory; the RAM copy is only a staging buffer
+    return;
 }
 
+void extension_freeQuregAmps(Qureg& qureg, QuregAllocMode mode) {
+    
+    // the RAM copy was never reallocated
+    return;
+}
@@ -4,6 +4,31 @@
 
 
 
+/** The allocation of the (CPU) amplitudes of quregs created by the link, fixed at 
+ * link start. All but ALLOC_DEFAULT replace the memory allocated by QuEST with 
+ * memory first-touched by the threads (in the static partition of the kernels) 
+ * which will later process it, so that it is placed on their NUMA nodes, and 
+ * optionally backed by transparent or explicit (pre-reserved) huge pages.
+ */
+enum QuregAllocMode {
+    ALLOC_DEFAULT, 
+    ALLOC_FIRST_TOUCH, 
+    ALLOC_TRANSPARENT_HUGE_PAGES, 
+    ALLOC_EXPLICIT_HUGE_PAGES
+};
+
+/** Replaces the amplitudes of a newly created qureg (in its initial zero state)
+ * with memory allocated as per mode, if the qureg is large enough to benefit.
+ * @throws QuESTException if the memory cannot be allocated, in which case the 
+ *      qureg's amplitudes are NULL and it must be destroyed
+ */
+void extension_reallocQuregAmps(Qureg& qureg, QuregAllocMode mode); // throws
+
+/** Frees the amplitudes of a qureg which were allocated by extension_reallocQuregAmps
+ * (with the same mode), setting them to NULL, before the qureg is destroyed by QuEST.
+ */
+void extension_freeQuregAmps(Qureg& qureg, QuregAllocMode mode);
+
 bool extension_isHermitian(Qureg qureg);
 
 void extension_addAdjointToSelf(Qureg qureg);
@@ -22,12 +47,25 @@ void extension_mixTwoQubitDepolarisingDeriv(Qureg qureg, int t1, int t2, qreal p
 
 void extension_mixDampingDeriv(Qureg qureg, int targ, qreal prob, qreal probDeriv);
 
-void extension_calcExpecPauliProdsFromClassicalShadow(
-    std::vector<qreal> &prodExpecVals, long numProds,
-    int* sampleBases, int* sampleOutcomes, int numQb, long numSamples,
-    int* pauliCodes, int* pauliTargs, int* numPaulisPerProd,
-    int numBatches
-); // throws
+void extension_getAmps(Qureg qureg, long long int* inds, long long int numInds, qreal* outRe, qreal* outIm);
+
+void extension_getAmpRange(Qureg qureg, long long int startInd, long long int numAmps, qreal* outRe, qreal* outIm);
+
+void extension_setAmpRange(Qureg qureg, long long int startInd, long long int numAmps, qreal* ampsRe, qreal* ampsIm);
+
+void extension_getMostProbableInds(
+    std::vector<long long int>& outInds, Qureg qureg, long long int maxNumInds, qreal minProb);
+
+/** Returns the number of bytes of the thread-private tables which are temporarily 
+ * allocated by extension_calcProbsOfAllOutcomesOfSubsets(), excluding outProbs.
+ */
+long long int extension_getNumBytesOfSubsetProbAccumulators(int* numQubitsPerSubset, int numSubsets);
+
+void extension_calcProbsOfAllOutcomesOfSubsets(
+    qreal* outProbs, Qureg qureg, int* subsetQubits, int* numQubitsPerSubset, int numSubsets);
+
+void extension_calcReducedDensityMatrix(
+    qreal* outRe, qreal* outIm, Qureg qureg, int* keptQubits, int numKept);
 
 
 
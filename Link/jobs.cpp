@@ -0,0 +1,296 @@
+/** @file
+ * Contains the asynchronous evaluation of expensive link functions (jobs) upon a
+ * single worker thread, so that the front-end can continue evaluating (such as
+ * post-processing a previous result) while a job is simulated. Jobs are computed
+ * one at a time in submission order, each multithreaded as usual. A job's quregs
+ * are unusable by other link functions until its result is collected, though
+ * other quregs remain usable meanwhile.
+ *
+ * @author Tyson Jones
+ */
+
+#include "wstp.h"
+#include "QuEST.h"
+
+#include "jobs.hpp"
+#include "errors.hpp"
+#include "link.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <stdlib.h>
+
+#include "utilities.hpp"
+
+
+
+/*
+ * The period with which a front-end waiting upon a job checks for a user abort
+ */
+#define JOB_WAIT_ABORT_POLL_MS 100
+
+
+
+/*
+ * Jobs whose results have not yet been collected, keyed by their id, accessed only
+ * by the main thread
+ */
+std::map<int, Job*> jobs;
+int nextJobId = 0;
+
+/*
+ * Jobs awaiting the worker thread, and the lock which guards the queue, the worker
+ * state and all job statuses. The worker awaits jobQueueCond, and the main thread 
+ * jobDoneCond.
+ */
+std::deque<Job*> jobQueue;
+std::mutex jobLock;
+std::condition_variable jobQueueCond;
+std::condition_variable jobDoneCond;
+
+/*
+ * The worker thread, started upon the first job submission and stopped at exit
+ */
+std::thread worker;
+bool isWorkerStarted = false;
+bool isWorkerStopping = false;
+Job* workerJob = NULL;
+
+/*
+ * The job being computed by the worker thread (remaining NULL for the main thread)
+ */
+thread_local Job* currentJob = NULL;
+
+
+
+Job::Job(std::string apiFuncName) {
+    this->apiFuncName = apiFuncName;
+    status = JOB_QUEUED;
+    isCancelRequested = false;
+    progress = 0;
+}
+
+Job* local_getCurrentJob() {
+    return currentJob;
+}
+
+void local_throwExcepIfQuregUsedByJob(int id) {
+
+    if (currentJob != NULL)
+        return;
+
+    for (auto const& entry : jobs) {
+        std::vector<int>& ids = entry.second->quregIds;
+        if (std::find(ids.begin(), ids.end(), id) != ids.end())
+            throw QuESTException("", "qureg (with id " + std::to_string(id) + ") is in use by job " +
+                std::to_string(entry.first) + ", whose result has not yet been collected with JobResult[]."); // throws
+    }
+}
+
+void local_throwExcepIfJobNotSubmitted(int id) {
+    if (jobs.find(id) == jobs.end())
+        throw QuESTException("", "job (with id " + std::to_string(id) +
+            ") has not been submitted, or its result was already collected."); // throws
+}
+
+bool local_isJobFinished(Job* job) {
+    return job->status == JOB_SUCCEEDED || job->status == JOB_FAILED || job->status == JOB_CANCELLED;
+}
+
+
+
+/*
+ * EVALUATION
+ */
+
+void local_computeJobOnWorker(Job* job) {
+
+    jobStatus status = JOB_SUCCEEDED;
+    currentJob = job;
+
+    try {
+        job->compute(); // throws
+
+    } catch (QuESTException& err) {
+        job->errThrower = err.thrower;
+        job->errMessage = err.message;
+        status = (err.thrower == "Abort" && job->isCancelRequested)? JOB_CANCELLED : JOB_FAILED;
+    }
+
+    currentJob = NULL;
+    job->progress = 1;
+
+    std::lock_guard<std::mutex> lock(jobLock);
+    job->status = status;
+    jobDoneCond.notify_all();
+}
+
+void local_runJobsOnWorker() {
+
+    // the worker persists until the process exits
+    while (true) {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(jobLock);
+            while (jobQueue.empty() && !isWorkerStopping)
+                jobQueueCond.wait(lock);
+
+            if (isWorkerStopping)
+                return;
+
+            job = jobQueue.front();
+            jobQueue.pop_front();
+            job->status = JOB_RUNNING;
+            workerJob = job;
+        }
+
+        local_computeJobOnWorker(job);
+
+        std::lock_guard<std::mutex> lock(jobLock);
+        workerJob = NULL;
+    }
+}
+
+/* Called at exit (before the job lock and conditions are destroyed), cancelling 
+ * any running job and awaiting the worker.
+ */
+void local_stopJobWorker() {
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        isWorkerStopping = true;
+        if (workerJob != NULL)
+            workerJob->isCancelRequested = true;
+    }
+    jobQueueCond.notify_one();
+    worker.join();
+}
+
+void local_runJob(Job* job, bool async) {
+
+    // synchronous jobs are computed by the main thread, which may report progress to MMA
+    if (!async) {
+        try {
+            job->compute(); // throws
+            job->sendResultToMMA();
+
+        } catch (QuESTException& err) {
+            local_sendErrorAndFailOrAbortFromExcep(job->apiFuncName, err.thrower, err.message);
+        }
+        delete job;
+        return;
+    }
+
+    int id = nextJobId++;
+    jobs[id] = job;
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        jobQueue.push_back(job);
+
+        if (!isWorkerStarted) {
+            worker = std::thread(local_runJobsOnWorker);
+            isWorkerStarted = true;
+            atexit(local_stopJobWorker);
+        }
+    }
+    jobQueueCond.notify_one();
+
+    WSPutInteger(stdlink, id);
+}
+
+
+
+/*
+ * INTERFACING
+ */
+
+void internal_getJobStatus(int id) {
+
+    try {
+        local_throwExcepIfJobNotSubmitted(id); // throws
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail("JobStatus", err.message);
+        return;
+    }
+
+    Job* job = jobs[id];
+    jobStatus status;
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+        status = job->status;
+    }
+
+    WSPutFunction(stdlink, "List", 2);
+    WSPutInteger(stdlink, status);
+    WSPutReal64(stdlink, job->progress);
+}
+
+void internal_getJobResult(int id) {
+
+    try {
+        local_throwExcepIfJobNotSubmitted(id); // throws
+
+        // wait for the job to finish, interrupted only by a user abort (which leaves the job running)
+        Job* job = jobs[id];
+        std::unique_lock<std::mutex> lock(jobLock);
+        while (!local_isJobFinished(job)) {
+            jobDoneCond.wait_for(lock, std::chrono::milliseconds(JOB_WAIT_ABORT_POLL_MS));
+
+            lock.unlock();
+            local_throwExcepIfUserAborted(); // throws
+            lock.lock();
+        }
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFailOrAbortFromExcep("JobResult", err.thrower, err.message);
+        return;
+    }
+
+    // report the result as if it were returned by the original API function
+    Job* job = jobs[id];
+    if (job->status == JOB_SUCCEEDED)
+        job->sendResultToMMA();
+    else if (job->status == JOB_CANCELLED)
+        local_sendErrorAndFail(job->apiFuncName, job->errMessage);
+    else
+        local_sendErrorAndFailOrAbortFromExcep(job->apiFuncName, job->errThrower, job->errMessage);
+
+    // release the job's quregs and resources
+    jobs.erase(id);
+    delete job;
+}
+
+void internal_cancelJob(int id) {
+
+    try {
+        local_throwExcepIfJobNotSubmitted(id); // throws
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail("CancelJob", err.message);
+        return;
+    }
+
+    Job* job = jobs[id];
+    {
+        std::lock_guard<std::mutex> lock(jobLock);
+
+        // a queued job is cancelled immediately, and a running job when it next polls
+        if (job->status == JOB_QUEUED) {
+            jobQueue.erase(std::find(jobQueue.begin(), jobQueue.end(), job));
+            job->status = JOB_CANCELLED;
+            job->errThrower = "Abort";
+            job->errMessage = "The job (id " + std::to_string(id) + ") was cancelled before it began.";
+        }
+        else if (job->status == JOB_RUNNING)
+            job->isCancelRequested = true;
+    }
+
+    WSPutSymbol(stdlink, "Null");
+}
@@ -0,0 +1,97 @@
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "QuEST.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+
+
+/** The stages of a job, in the order in which they can occur. A job ends in
+ * exactly one of the latter three, after which its result can be collected.
+ */
+typedef enum {JOB_QUEUED, JOB_RUNNING, JOB_SUCCEEDED, JOB_FAILED, JOB_CANCELLED} jobStatus;
+
+
+
+/** An expensive link operation, which is evaluated either immediately (blocking
+ * the front-end), or asynchronously upon the single worker thread. An operation
+ * is split into three phases: the subclass constructor (run by the main thread)
+ * loads and validates its arguments from MMA and prepares any registers;
+ * compute() performs the simulation without any WSTP communication; and
+ * sendResultToMMA() (run by the main thread) returns the result. The subclass
+ * destructor frees its resources, and is always run by the main thread.
+ */
+class Job {
+    public:
+
+        /** The name of the API function, whose ::error tag reports failures.
+         */
+        std::string apiFuncName;
+
+        /** The ids of the quregs read or modified by compute(), which cannot be
+         * used by any other link function until the job's result is collected.
+         */
+        std::vector<int> quregIds;
+
+        /** Modified only by the main and worker threads while holding the job lock
+         * (see jobs.cpp).
+         */
+        jobStatus status;
+
+        /** Set when status is JOB_FAILED or JOB_CANCELLED, to the thrower and
+         * message of the exception which ended compute().
+         */
+        std::string errThrower;
+        std::string errMessage;
+
+        /** Set by CancelJob[], and polled by compute() via local_throwExcepIfUserAborted().
+         */
+        std::atomic<bool> isCancelRequested;
+
+        /** The fraction of compute() completed, in [0, 1], updated via
+         * local_updateCircuitProgress().
+         */
+        std::atomic<double> progress;
+
+        Job(std::string apiFuncName);
+        virtual ~Job() {};
+
+        Job(const Job&) = delete;
+        Job& operator=(const Job&) = delete;
+
+        /** Performs the simulation, which must not communicate with MMA since it
+         * may be run by the worker thread.
+         * @throws QuESTException if the simulation fails or is aborted
+         */
+        virtual void compute() = 0; // throws
+
+        /** Sends the result of a successful compute() to MMA.
+         */
+        virtual void sendResultToMMA() = 0;
+};
+
+
+
+/** Evaluates the (fully prepared) job, taking ownership of it. If async is false,
+ * the job is computed immediately and its result (or error) sent to MMA. Otherwise,
+ * the job is queued for the worker thread, and its id sent to MMA.
+ */
+void local_runJob(Job* job, bool async);
+
+/** Returns the job being computed by the calling thread, which is NULL for the main
+ * thread, and for synchronously computed jobs (which may communicate with MMA).
+ */
+Job* local_getCurrentJob();
+
+/** @throws QuESTException if the qureg with the given id is used by a job whose
+ *      result has not yet been collected. Does nothing when called by the worker.
+ */
+void local_throwExcepIfQuregUsedByJob(int id); // throws
+
+
+
+#endif // JOBS_H
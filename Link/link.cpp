@@ -28,6 +28,9 @@
 #include "extensions.hpp"
 #include "circuits.hpp"
 #include "derivatives.hpp"
+#include "shadows.hpp"
+#include "checkpoints.hpp"
+#include "jobs.hpp"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -35,6 +38,9 @@
 #include <string.h>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <climits>
+#include <map>
 #include <exception>
 
 
@@ -46,6 +52,240 @@
 QuESTEnv env;
 std::vector<Qureg> quregs;
 std::vector<bool> quregIsCreated;
+std::vector<ClassicalShadow> shadows;
+std::vector<bool> shadowIsCreated;
+
+
+
+/*
+ * The default maximum total memory (in bytes) of destroyed quregs retained for reuse
+ */
+#define DEFAULT_QUREG_POOL_MAX_NUM_BYTES (1LL << 30)
+
+/*
+ * Pool of destroyed quregs, keyed by (numQubitsRepresented, isDensityMatrix), whose
+ * memory is reused by subsequently created quregs of the same size and type. This
+ * avoids the repeated allocation (and page-faulting) of short-lived registers.
+ */
+std::map<std::pair<int,int>, std::vector<Qureg>> quregPool;
+long long int quregPoolNumBytes = 0;
+long long int quregPoolMaxNumBytes = DEFAULT_QUREG_POOL_MAX_NUM_BYTES;
+
+/*
+ * Accounting of the memory of all created quregs (of the user, and temporaries of 
+ * link operations, excluding pooled quregs) and of the large temporary buffers of 
+ * link operations (registered by TempMemoryReservation), against an optional budget 
+ * on their total with the pool, which is disabled when negative
+ */
+long long int quregsNumBytes = 0;
+long long int tempBuffersNumBytes = 0;
+long long int memoryBudgetNumBytes = -1;
+
+/*
+ * The allocation of the amplitudes of all quregs created by the link, which is
+ * chosen at link start (by environment variable QUESTLINK_QUREG_ALLOC) and thereafter
+ * fixed, since quregs must be freed consistently with their allocation
+ */
+QuregAllocMode quregAllocMode = ALLOC_DEFAULT;
+
+
+
+/* 
+ * MEMORY ACCOUNTING
+ */
+
+long long int local_getQuregNumBytes(int numQubits, int isDensityMatrix) {
+    int numBits = (isDensityMatrix)? 2*numQubits : numQubits;
+    return (2 * (long long int) sizeof(qreal)) << numBits;
+}
+
+long long int local_getQuregNumBytes(Qureg qureg) {
+    return 2 * qureg.numAmpsTotal * (long long int) sizeof(qreal);
+}
+
+/* Frees the qureg's memory, whether allocated by QuEST or by extension_reallocQuregAmps()
+ */
+void local_freeQureg(Qureg qureg) {
+    extension_freeQuregAmps(qureg, quregAllocMode);
+    destroyQureg(qureg, env);
+}
+
+/* Frees pooled quregs until the pool occupies at most maxNumBytes, returning the 
+ * number of bytes freed. Quregs of the most qubits are freed first.
+ */
+long long int local_trimQuregPool(long long int maxNumBytes) {
+    
+    long long int numFreedBytes = 0;
+    for (auto it = quregPool.rbegin(); it != quregPool.rend() && quregPoolNumBytes > maxNumBytes; ++it) {
+        std::vector<Qureg>& bucket = it->second;
+        while (!bucket.empty() && quregPoolNumBytes > maxNumBytes) {
+            long long int numBytes = local_getQuregNumBytes(bucket.back());
+            local_freeQureg(bucket.back());
+            bucket.pop_back();
+            quregPoolNumBytes -= numBytes;
+            numFreedBytes += numBytes;
+        }
+    }
+    return numFreedBytes;
+}
+
+void local_throwExcepIfExceedsMemoryBudget(long long int numExtraBytes) {
+    if (memoryBudgetNumBytes < 0)
+        return;
+    
+    // pooled quregs are freed to make space
+    long long int numUsedBytes = quregsNumBytes + tempBuffersNumBytes;
+    if (numExtraBytes > memoryBudgetNumBytes - numUsedBytes)
+        throw QuESTException("", "The operation requires an additional " + std::to_string(numExtraBytes) + 
+            " bytes of memory, which would exceed the memory budget of " + std::to_string(memoryBudgetNumBytes) + 
+            " bytes (of which " + std::to_string(numUsedBytes) + " are in use). See SetQuESTMemoryBudget[]."); // throws
+    
+    local_trimQuregPool(memoryBudgetNumBytes - numUsedBytes - numExtraBytes);
+}
+
+TempMemoryReservation::TempMemoryReservation(long long int numBytes) : numBytes(numBytes) {
+    local_throwExcepIfExceedsMemoryBudget(numBytes); // throws
+    tempBuffersNumBytes += numBytes;
+}
+
+TempMemoryReservation::~TempMemoryReservation() {
+    tempBuffersNumBytes -= numBytes;
+}
+
+void internal_setQuESTMemoryBudget(void) {
+    
+    wsint64 rawNumBytes;
+    WSGetInteger64(stdlink, &rawNumBytes); // -1 for no budget
+    long long int numBytes = (long long int) rawNumBytes;
+    
+    try {
+        if (numBytes < -1)
+            throw QuESTException("", "The memory budget must be a non-negative number of bytes, or Infinity."); // throws
+        
+        // the existing quregs and buffers may exceed a new budget, but the pool must not
+        memoryBudgetNumBytes = numBytes;
+        if (numBytes != -1)
+            local_trimQuregPool(std::max(0LL, numBytes - quregsNumBytes - tempBuffersNumBytes));
+        
+        WSPutSymbol(stdlink, "Null");
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail("SetQuESTMemoryBudget", err.message);
+    }
+}
+
+void callable_getQuESTMemoryUsage(void) {
+    
+    WSPutFunction(stdlink, "List", 4);
+    WSPutInteger64(stdlink, quregsNumBytes);
+    WSPutInteger64(stdlink, quregPoolNumBytes);
+    WSPutInteger64(stdlink, tempBuffersNumBytes);
+    WSPutInteger64(stdlink, memoryBudgetNumBytes);
+}
+
+
+
+/* 
+ * QUREG POOL
+ */
+
+Qureg local_createQuregOfType(int numQubits, int isDensityMatrix) {
+    
+    // reuse a pooled qureg when possible, restoring it to the state of a new qureg
+    std::vector<Qureg>& bucket = quregPool[std::make_pair(numQubits, isDensityMatrix)];
+    if (!bucket.empty()) {
+        Qureg qureg = bucket.back();
+        bucket.pop_back();
+        quregPoolNumBytes -= local_getQuregNumBytes(qureg);
+        quregsNumBytes += local_getQuregNumBytes(qureg);
+        
+        stopRecordingQASM(qureg);
+        clearRecordedQASM(qureg);
+        initZeroState(qureg);
+        return qureg;
+    }
+    
+    // (invalid numQubits are reported by QuEST, before any excessive allocation)
+    if (numQubits > 0 && numQubits * (isDensityMatrix? 2 : 1) < 58)
+        local_throwExcepIfExceedsMemoryBudget(local_getQuregNumBytes(numQubits, isDensityMatrix)); // throws
+    
+    Qureg qureg = (isDensityMatrix)?
+        createDensityQureg(numQubits, env): // throws
+        createQureg(numQubits, env); // throws
+    
+    try {
+        extension_reallocQuregAmps(qureg, quregAllocMode); // throws
+    } catch (QuESTException& err) {
+        destroyQureg(qureg, env); // amplitudes were already freed
+        throw;
+    }
+    
+    quregsNumBytes += local_getQuregNumBytes(qureg);
+    return qureg;
+}
+
+Qureg local_createQureg(int numQubits) {
+    return local_createQuregOfType(numQubits, 0); // throws
+}
+
+Qureg local_createDensityQureg(int numQubits) {
+    return local_createQuregOfType(numQubits, 1); // throws
+}
+
+Qureg local_createCloneQureg(Qureg qureg) {
+    Qureg clone = local_createQuregOfType(qureg.numQubitsRepresented, qureg.isDensityMatrix); // throws
+    cloneQureg(clone, qureg);
+    return clone;
+}
+
+void local_destroyQureg(Qureg qureg) {
+    
+    long long int numBytes = local_getQuregNumBytes(qureg);
+    quregsNumBytes -= numBytes;
+    
+    // quregs which would overflow the pool (or the memory budget) are freed
+    bool exceedsBudget = (memoryBudgetNumBytes >= 0 && 
+        quregsNumBytes + tempBuffersNumBytes + quregPoolNumBytes + numBytes > memoryBudgetNumBytes);
+    if (quregPoolNumBytes + numBytes > quregPoolMaxNumBytes || exceedsBudget) {
+        local_freeQureg(qureg);
+        return;
+    }
+    
+    quregPool[std::make_pair(qureg.numQubitsRepresented, qureg.isDensityMatrix)].push_back(qureg);
+    quregPoolNumBytes += numBytes;
+}
+
+void internal_setQuregPoolCapacity(void) {
+    
+    wsint64 rawNumBytes;
+    WSGetInteger64(stdlink, &rawNumBytes);
+    long long int numBytes = (long long int) rawNumBytes;
+    
+    try {
+        if (numBytes < 0)
+            throw QuESTException("", "The pool capacity must be a non-negative number of bytes."); // throws
+        
+        quregPoolMaxNumBytes = numBytes;
+        local_trimQuregPool(numBytes);
+        WSPutSymbol(stdlink, "Null");
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail("SetQuregPoolCapacity", err.message);
+    }
+}
+
+void callable_trimQuregPool(void) {
+    
+    wsint64 numFreedBytes = local_trimQuregPool(0);
+    WSPutInteger64(stdlink, numFreedBytes);
+}
+
+void callable_getQuregPoolUsage(void) {
+    
+    WSPutFunction(stdlink, "List", 2);
+    WSPutInteger64(stdlink, quregPoolNumBytes);
+    WSPutInteger64(stdlink, quregPoolMaxNumBytes);
+}
 
 
 
@@ -72,7 +312,7 @@ size_t local_getNextQuregID(void) {
 void wrapper_createQureg(int numQubits) {
     try { 
         size_t id = local_getNextQuregID();
-        quregs[id] = createQureg(numQubits, env); // throws
+        quregs[id] = local_createQureg(numQubits); // throws
         quregIsCreated[id] = true;
         WSPutInteger(stdlink, id);
         
@@ -84,7 +324,7 @@ void wrapper_createQureg(int numQubits) {
 void wrapper_createDensityQureg(int numQubits) {
     try { 
         size_t id = local_getNextQuregID();
-        quregs[id] = createDensityQureg(numQubits, env); // throws
+        quregs[id] = local_createDensityQureg(numQubits); // throws
         quregIsCreated[id] = true;
         WSPutInteger(stdlink, id);
         
@@ -97,7 +337,7 @@ void wrapper_destroyQureg(int id) {
     try { 
         local_throwExcepIfQuregNotCreated(id); // throws
         
-        destroyQureg(quregs[id], env); // throws
+        local_destroyQureg(quregs[id]);
         quregIsCreated[id] = false;
         WSPutInteger(stdlink, id);
 
@@ -108,17 +348,51 @@ void wrapper_destroyQureg(int id) {
 
 void callable_destroyAllQuregs(void) {
     
+    // no qureg is destroyed if any are in use by an uncollected job
+    try {
+        for (size_t id=0; id < quregs.size(); id++)
+            if (quregIsCreated[id])
+                local_throwExcepIfQuregUsedByJob(id); // throws
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail("DestroyAllQuregs", err.message);
+        return;
+    }
+    
     for (size_t id=0; id < quregs.size(); id++) {
         if (quregIsCreated[id]) {
-            destroyQureg(quregs[id], env);
+            local_destroyQureg(quregs[id]);
             quregIsCreated[id] = false;
         }
     }
     WSPutSymbol(stdlink, "Null");
 }
 
+/* @throws QuESTException if numQuregs new quregs would together exceed the memory budget
+ */
+void local_throwExcepIfQuregsExceedMemoryBudget(int numQubits, int isDensityMatrix, int numQuregs) {
+    
+    // (invalid numQubits are reported by QuEST)
+    if (numQuregs < 1 || numQubits < 1 || numQubits * (isDensityMatrix? 2 : 1) >= 58)
+        return;
+    
+    long long int numBytes = local_getQuregNumBytes(numQubits, isDensityMatrix);
+    long long int numTotalBytes = (numBytes > LLONG_MAX / numQuregs)? LLONG_MAX : numQuregs * numBytes;
+    local_throwExcepIfExceedsMemoryBudget(numTotalBytes); // throws
+}
+
+/* Destroys the first numQuregs quregs of ids, such as those created by a failed CreateQuregs[]
+ */
+void local_destroyQuregs(int* ids, int numQuregs) {
+    for (int i=0; i < numQuregs; i++) {
+        local_destroyQureg(quregs[ids[i]]);
+        quregIsCreated[ids[i]] = false;
+    }
+}
+
 void callable_createQuregs(int numQubits, int numQuregs) {
     int* ids = NULL;
+    int numCreated = 0;
   
     try { 
         if (numQuregs < 0)
@@ -126,15 +400,19 @@ void callable_createQuregs(int numQubits, int numQuregs) {
         
         ids = (int*) malloc(numQuregs * sizeof *ids);
         
+        local_throwExcepIfQuregsExceedMemoryBudget(numQubits, 0, numQuregs); // throws
+        
         for (int i=0; i < numQuregs; i++) {
             int id = local_getNextQuregID();
-            ids[i] = id;
-            quregs[id] = createQureg(numQubits, env); // throws (first; no cleanup needed)
+            quregs[id] = local_createQureg(numQubits); // throws (after creating ids[0, i))
             quregIsCreated[id] = true;
+            ids[i] = id;
+            numCreated++;
         }
         WSPutIntegerList(stdlink, ids, numQuregs);
         
     } catch( QuESTException& err) {
+        local_destroyQuregs(ids, numCreated);
         local_sendErrorAndFail("CreateQuregs", err.message);
     }
     
@@ -145,6 +423,7 @@ void callable_createQuregs(int numQubits, int numQuregs) {
 
 void callable_createDensityQuregs(int numQubits, int numQuregs) {
     int* ids = NULL;
+    int numCreated = 0;
   
     try {
         if (numQuregs < 0)
@@ -152,15 +431,19 @@ void callable_createDensityQuregs(int numQubits, int numQuregs) {
         
         ids = (int*) malloc(numQuregs * sizeof *ids);
             
+        local_throwExcepIfQuregsExceedMemoryBudget(numQubits, 1, numQuregs); // throws
+        
         for (int i=0; i < numQuregs; i++) {
             int id = local_getNextQuregID();
-            ids[i] = id;
-            quregs[id] = createDensityQureg(numQubits, env); // throws (first; no cleanup needed)
+            quregs[id] = local_createDensityQureg(numQubits); // throws (after creating ids[0, i))
             quregIsCreated[id] = true;
+            ids[i] = id;
+            numCreated++;
         }
         WSPutIntegerList(stdlink, ids, numQuregs);
         
     } catch( QuESTException& err) {
+        local_destroyQuregs(ids, numCreated);
         local_sendErrorAndFail("CreateDensityQuregs", err.message);
     }
     
@@ -197,6 +480,62 @@ void internal_setQuregToPauliString(int quregId) {
 
 
 
+/*
+ * CHECKPOINTS
+ */
+
+/** Loads a file path from MMA, as a UTF8 string
+ */
+std::string local_loadFilePathFromMMA() {
+    
+    const unsigned char* bytes;
+    int numBytes, numChars;
+    WSGetUTF8String(stdlink, &bytes, &numBytes, &numChars);
+    std::string path((const char*) bytes, numBytes);
+    WSReleaseUTF8String(stdlink, bytes, numBytes);
+    return path;
+}
+
+void internal_saveQureg(int quregId) {
+    const std::string apiFuncName = "SaveQureg";
+    
+    // get args from MMA (must do this before possible early-exit)
+    std::string path = local_loadFilePathFromMMA();
+    
+    try {
+        local_throwExcepIfQuregNotCreated(quregId); // throws
+        
+        syncQuESTEnv(env); // does nothing on local
+        local_saveQuregToFile(quregs[quregId], path); // throws
+        
+        WSPutInteger(stdlink, quregId);
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+}
+
+void internal_loadQureg(void) {
+    const std::string apiFuncName = "LoadQureg";
+    
+    // get args from MMA (must do this before possible early-exit)
+    std::string path = local_loadFilePathFromMMA();
+    
+    try {
+        // the qureg is only created once the file is validated
+        size_t id = local_getNextQuregID();
+        quregs[id] = local_loadQuregFromFile(path); // throws
+        quregIsCreated[id] = true;
+        
+        WSPutInteger(stdlink, id);
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+}
+
+
+
 /*
  * QASM
  */
@@ -256,6 +595,34 @@ void callable_getRecordedQASM(int id) {
  * GETTERS
  */
 
+/** Populates flatInds with the indices into the (column-major) amplitudes of 
+ * qureg of the given rows, and cols when qureg is a density matrix (else, cols 
+ * must be empty).
+ * @throws QuESTException if the number of rows and cols is inconsistent with
+ *      the qureg type, or any index is out of range
+ */
+void local_getFlatAmpIndices(
+    std::vector<long long int>& flatInds, Qureg qureg, wsint64* rows, int numRows, wsint64* cols, int numCols
+) {
+    if (qureg.isDensityMatrix && numCols != numRows)
+        throw QuESTException("", "Called on a density matrix without supplying both row and column of every amplitude."); // throws
+    if (!qureg.isDensityMatrix && numCols != 0)
+        throw QuESTException("", "Called on a state-vector, yet meaningless column indices were supplied."); // throws
+    
+    long long int dim = (qureg.isDensityMatrix)? 
+        (1LL << qureg.numQubitsRepresented) : qureg.numAmpsTotal;
+    
+    flatInds.resize(numRows);
+    for (int i=0; i<numRows; i++) {
+        long long int row = (long long int) rows[i];
+        long long int col = (qureg.isDensityMatrix)? (long long int) cols[i] : 0;
+        if (row < 0 || row >= dim || col < 0 || col >= dim)
+            throw QuESTException("", "Amplitude index " + std::to_string(i+1) + " is out of range."); // throws
+        
+        flatInds[i] = row + col*dim;
+    }
+}
+
 void internal_getAmp(int quregID) {
     
     // get args from MMA (must do this before possible early-exit)
@@ -295,6 +662,84 @@ void internal_getAmp(int quregID) {
     }
 }
 
+void internal_getAmps(int quregID) {
+    const std::string apiFuncName = "GetAmps";
+    
+    // get args from MMA (must do this before possible early-exit)
+    wsint64* rows;
+    wsint64* cols; // empty for state-vecs
+    int numRows, numCols;
+    WSGetInteger64List(stdlink, &rows, &numRows);
+    WSGetInteger64List(stdlink, &cols, &numCols);
+    
+    try { 
+        local_throwExcepIfQuregNotCreated(quregID); // throws
+        
+        Qureg qureg = quregs[quregID];
+        std::vector<long long int> flatInds;
+        local_getFlatAmpIndices(flatInds, qureg, rows, numRows, cols, numCols); // throws
+        
+        // gather the scattered amps in parallel (on the GPU, when applicable)
+        std::vector<qreal> ampsRe(numRows);
+        std::vector<qreal> ampsIm(numRows);
+        if (numRows > 0)
+            extension_getAmps(qureg, flatInds.data(), numRows, ampsRe.data(), ampsIm.data());
+        
+        local_sendComplexArrayToMMA(ampsRe.data(), ampsIm.data(), {numRows});
+        
+    } catch( QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+    
+    WSReleaseInteger64List(stdlink, rows, numRows);
+    WSReleaseInteger64List(stdlink, cols, numCols);
+}
+
+void internal_getTopAmplitudes(int quregID) {
+    const std::string apiFuncName = "GetTopAmplitudes";
+    
+    // get args from MMA (must do this before possible early-exit)
+    wsint64 rawMaxNumAmps;
+    WSGetInteger64(stdlink, &rawMaxNumAmps); // -1 for unlimited
+    long long int maxNumAmps = (long long int) rawMaxNumAmps;
+    
+    qreal minProb;
+    WSGetQreal(stdlink, &minProb);
+    
+    try { 
+        local_throwExcepIfQuregNotCreated(quregID); // throws
+        
+        if (maxNumAmps < -1)
+            throw QuESTException("", "The number of amplitudes must be a non-negative integer, or All."); // throws
+        
+        // select the most probable amps (from the diagonal of density matrices) in parallel
+        Qureg qureg = quregs[quregID];
+        std::vector<long long int> inds;
+        extension_getMostProbableInds(inds, qureg, maxNumAmps, minProb);
+        
+        // fetch only the selected amps, at their flat indices
+        long long int numAmps = inds.size();
+        local_throwExcepIfExceedsArrayDim(numAmps); // throws
+        std::vector<long long int> flatInds(inds);
+        if (qureg.isDensityMatrix)
+            for (long long int i=0; i<numAmps; i++)
+                flatInds[i] *= (1LL << qureg.numQubitsRepresented) + 1;
+        
+        std::vector<qreal> ampsRe(numAmps);
+        std::vector<qreal> ampsIm(numAmps);
+        if (numAmps > 0)
+            extension_getAmps(qureg, flatInds.data(), numAmps, ampsRe.data(), ampsIm.data());
+        
+        std::vector<wsint64> outInds(inds.begin(), inds.end());
+        WSPutFunction(stdlink, "List", 2);
+        WSPutInteger64List(stdlink, outInds.data(), numAmps);
+        local_sendComplexArrayToMMA(ampsRe.data(), ampsIm.data(), {(int) numAmps});
+        
+    } catch( QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+}
+
 void callable_isDensityMatrix(int quregID) {
     try { 
         local_throwExcepIfQuregNotCreated(quregID); // throws
@@ -307,7 +752,7 @@ void callable_isDensityMatrix(int quregID) {
 }
 
 /* puts a Qureg into MMA, with the structure of
- * {numQubits, isDensityMatrix, realAmps, imagAmps}.
+ * {numQubits, isDensityMatrix, amps} where amps is a {numAmps, 2} real array.
  * Instead gives -1 if error (e.g. qureg id is wrong)
  */
 void internal_getQuregMatrix(int id) {
@@ -318,20 +763,99 @@ void internal_getQuregMatrix(int id) {
         local_throwExcepIfQuregNotCreated(id); // throws
     
         Qureg qureg = quregs[id];
+        local_throwExcepIfExceedsArrayDim(qureg.numAmpsTotal); // throws
+        
+        // the amplitudes are copied into an interleaved array to be sent
+        TempMemoryReservation reservation(local_getQuregNumBytes(qureg)); // throws
+        
         syncQuESTEnv(env);       // does nothing on local
         copyStateFromGPU(qureg); // does nothing on CPU
         
-        WSPutFunction(stdlink, "List", 4);
+        WSPutFunction(stdlink, "List", 3);
         WSPutInteger(stdlink, qureg.numQubitsRepresented);
         WSPutInteger(stdlink, qureg.isDensityMatrix);
-        WSPutQrealList(stdlink, qureg.stateVec.real, qureg.numAmpsTotal);
-        WSPutQrealList(stdlink, qureg.stateVec.imag, qureg.numAmpsTotal);    
+        local_sendComplexArrayToMMA(qureg.stateVec.real, qureg.stateVec.imag, {(int) qureg.numAmpsTotal});
         
     } catch (QuESTException& err) {
         local_sendErrorAndFail("GetQuregState", err.message);
     }
 }
 
+/* Sends the numAmps (flat, column-major) amplitudes of qureg from startInd (or all, when 
+ * numAmps=-1) in chunks of chunkSize amplitudes, each as a separate packet evaluating 
+ * QuEST`Private`receiveQuregStateChunk[offset, amps] (where amps is a {len, 2} real array), 
+ * after first evaluating 
+ * QuEST`Private`initQuregStateBuffer[numAmps]. This permits the front-end to write each 
+ * chunk into a preallocated array (and display progress) so that neither side need 
+ * hold multiple full copies of the state. The user may abort between chunks.
+ * Returns List[numQubits, isDensityMatrix] upon completion.
+ */
+void internal_getQuregStateInChunks(int id) {
+    const std::string apiFuncName = "GetQuregState";
+    
+    // get args from MMA (must do this before possible early-exit)
+    wsint64 rawStartInd, rawNumAmps, rawChunkSize;
+    WSGetInteger64(stdlink, &rawStartInd);
+    WSGetInteger64(stdlink, &rawNumAmps); // -1 for all
+    WSGetInteger64(stdlink, &rawChunkSize);
+    long long int startInd = (long long int) rawStartInd;
+    long long int numAmps = (long long int) rawNumAmps;
+    long long int chunkSize = (long long int) rawChunkSize;
+    
+    try {
+        local_throwExcepIfQuregNotCreated(id); // throws
+        
+        Qureg qureg = quregs[id];
+        if (numAmps == -1)
+            numAmps = qureg.numAmpsTotal - startInd;
+        if (startInd < 0 || numAmps < 0 || startInd + numAmps > qureg.numAmpsTotal)
+            throw QuESTException("", "The range of amplitude indices is invalid; it must lie within [0, " + 
+                std::to_string(qureg.numAmpsTotal) + ")."); // throws
+        if (chunkSize < 1)
+            throw QuESTException("", "The chunk size must be a positive integer."); // throws
+        
+        // WSTP lists are int-indexed
+        if (chunkSize > INT_MAX)
+            chunkSize = INT_MAX;
+        
+        // an array (of at most the state size) is allocated by the front-end
+        syncQuESTEnv(env); // does nothing on local
+        WSPutFunction(stdlink, "EvaluatePacket", 1);
+        WSPutFunction(stdlink, "QuEST`Private`initQuregStateBuffer", 1);
+        WSPutInteger64(stdlink, numAmps);
+        WSEndPacket(stdlink);
+        WSNextPacket(stdlink);
+        WSNewPacket(stdlink);
+        
+        std::vector<qreal> chunkRe(std::min(chunkSize, numAmps));
+        std::vector<qreal> chunkIm(std::min(chunkSize, numAmps));
+        
+        for (long long int offset=0; offset<numAmps; offset+=chunkSize) {
+            
+            // only the chunk is copied from the GPU, when applicable
+            long long int len = std::min(chunkSize, numAmps - offset);
+            extension_getAmpRange(qureg, startInd + offset, len, chunkRe.data(), chunkIm.data());
+            
+            WSPutFunction(stdlink, "EvaluatePacket", 1);
+            WSPutFunction(stdlink, "QuEST`Private`receiveQuregStateChunk", 2);
+            WSPutInteger64(stdlink, offset);
+            local_sendComplexArrayToMMA(chunkRe.data(), chunkIm.data(), {(int) len});
+            WSEndPacket(stdlink);
+            WSNextPacket(stdlink);
+            WSNewPacket(stdlink);
+            
+            local_throwExcepIfUserAborted(); // throws
+        }
+        
+        WSPutFunction(stdlink, "List", 2);
+        WSPutInteger(stdlink, qureg.numQubitsRepresented);
+        WSPutInteger(stdlink, qureg.isDensityMatrix);
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower, err.message);
+    }
+}
+
 /* Returns a list of all created quregs
  */
 void callable_getAllQuregs(void) {
@@ -525,6 +1049,64 @@ void internal_setAmp(int quregID) {
     }
 }
 
+void internal_setAmps(int quregID) {
+    const std::string apiFuncName = "SetAmps";
+    
+    // get args from MMA (must do this before possible early-exit)
+    wsint64* rows;
+    wsint64* cols; // empty for state-vecs
+    int numRows, numCols;
+    WSGetInteger64List(stdlink, &rows, &numRows);
+    WSGetInteger64List(stdlink, &cols, &numCols);
+    
+    qreal* ampsRe;
+    qreal* ampsIm;
+    int numAmpsRe, numAmpsIm;
+    WSGetQrealList(stdlink, &ampsRe, &numAmpsRe);
+    WSGetQrealList(stdlink, &ampsIm, &numAmpsIm);
+    
+    try { 
+        local_throwExcepIfQuregNotCreated(quregID); // throws
+        
+        // validate all indices before modifying the qureg
+        Qureg qureg = quregs[quregID];
+        std::vector<long long int> flatInds;
+        local_getFlatAmpIndices(flatInds, qureg, rows, numRows, cols, numCols); // throws
+        if (numAmpsRe != numRows || numAmpsIm != numRows)
+            throw QuESTException("", "A differing number of indices and amplitudes was supplied. The qureg has not been changed."); // throws
+        
+        // set each maximal run of consecutive indices with a single QuEST call. These 
+        // are taken in the given order, so that repeated indices retain their last amp
+        long long int dim = 1LL << qureg.numQubitsRepresented;
+        int start = 0;
+        while (start < numRows) {
+            int len = 1;
+            while (start + len < numRows && flatInds[start + len] == flatInds[start] + len)
+                len++;
+            
+            // density matrices are contiguous down columns, as are their flat indices
+            if (qureg.isDensityMatrix)
+                setDensityAmps(qureg, 
+                    flatInds[start] % dim, flatInds[start] / dim, 
+                    &ampsRe[start], &ampsIm[start], len); // throws
+            else
+                setAmps(qureg, flatInds[start], &ampsRe[start], &ampsIm[start], len); // throws
+            
+            start += len;
+        }
+        
+        WSPutInteger(stdlink, quregID);
+        
+    } catch( QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+    
+    WSReleaseInteger64List(stdlink, rows, numRows);
+    WSReleaseInteger64List(stdlink, cols, numCols);
+    WSReleaseQrealList(stdlink, ampsRe, numAmpsRe);
+    WSReleaseQrealList(stdlink, ampsIm, numAmpsIm);
+}
+
 
 
 /*
@@ -544,21 +1126,210 @@ void wrapper_calcProbOfOutcome(int id, int qb, int outcome) {
 
 void wrapper_calcProbOfAllOutcomes(int id, int* qubits, long numQubits) {
     
-    long long int numProbs = (1LL << numQubits);
-    qreal* probs = (numQubits > 0)? (qreal*) malloc(numProbs * sizeof* probs) : NULL;
-    
     try {
         local_throwExcepIfQuregNotCreated(id); // throws
-        calcProbOfAllOutcomes(probs, quregs[id], qubits, numQubits); // throws
         
-        WSPutQrealList(stdlink, probs, numProbs);
+        // precede QuEST's validation of the qubits, to avoid an excessive allocation
+        if (numQubits > quregs[id].numQubitsRepresented)
+            throw QuESTException("", "More qubits were given than exist in the qureg."); // throws
+        
+        long long int numProbs = (1LL << numQubits);
+        TempMemoryReservation reservation(numProbs * sizeof(qreal)); // throws
+        std::vector<qreal> probs(numProbs);
+        calcProbOfAllOutcomes(probs.data(), quregs[id], qubits, numQubits); // throws
+        
+        WSPutQrealList(stdlink, probs.data(), numProbs);
         
     } catch( QuESTException& err) {
         local_sendErrorAndFail("CalcProbOfAllOutcomes", err.message);
     }
+}
+
+void internal_calcProbOfAllOutcomesOfSubsets(int quregId) {
+    const std::string apiFuncName = "CalcProbOfAllOutcomes";
     
-    if (numQubits > 0)
-        free(probs);
+    int *subsetQubits, *numQubitsPerSubset;
+    long numTotalQubits, numSubsets;
+    WSGetIntegerList(stdlink, &subsetQubits, &numTotalQubits);
+    WSGetIntegerList(stdlink, &numQubitsPerSubset, &numSubsets);
+    
+    try {
+        local_throwExcepIfQuregNotCreated(quregId); // throws
+        int numQb = quregs[quregId].numQubitsRepresented;
+        
+        if (numSubsets < 1)
+            throw QuESTException("", "At least one subset of qubits must be given."); // throws
+        
+        // validate every subset, and determine the total size of their tables
+        long long int numOuts = 0;
+        long qubitOffset = 0;
+        for (long s=0; s<numSubsets; s++) {
+            int numSubQb = numQubitsPerSubset[s];
+            if (numSubQb < 1 || numSubQb > numQb)
+                throw QuESTException("", "Each subset must contain between 1 and " + std::to_string(numQb) + " qubits."); // throws
+                
+            if (qubitOffset + numSubQb > numTotalQubits)
+                throw QuESTException("", "The subset sizes exceed the number of given qubits."); // throws
+                
+            long long int mask = 0;
+            for (int k=0; k<numSubQb; k++) {
+                int qb = subsetQubits[qubitOffset + k];
+                if (qb < 0 || qb >= numQb)
+                    throw QuESTException("", "Invalid qubit index (" + std::to_string(qb) + ") in a subset of qubits."); // throws
+                if (mask & (1LL << qb))
+                    throw QuESTException("", "The qubits within each subset must be unique."); // throws
+                mask |= 1LL << qb;
+            }
+            
+            qubitOffset += numSubQb;
+            numOuts += 1LL << numSubQb;
+        }
+        if (qubitOffset != numTotalQubits)
+            throw QuESTException("", "The subset sizes do not sum to the number of given qubits."); // throws
+        
+        TempMemoryReservation reservation(numOuts * sizeof(qreal) + 
+            extension_getNumBytesOfSubsetProbAccumulators(numQubitsPerSubset, numSubsets)); // throws
+        std::vector<qreal> probs(numOuts);
+        extension_calcProbsOfAllOutcomesOfSubsets(
+            probs.data(), quregs[quregId], subsetQubits, numQubitsPerSubset, numSubsets);
+        
+        WSPutQrealList(stdlink, probs.data(), numOuts);
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+    
+    WSReleaseIntegerList(stdlink, subsetQubits, numTotalQubits);
+    WSReleaseIntegerList(stdlink, numQubitsPerSubset, numSubsets);
+}
+
+/* @param createQureg whether to return the id of a new density qureg populated with the 
+ *      reduced density matrix, rather than the matrix itself
+ */
+void internal_calcReducedDensityMatrix(int quregId, int createQureg) {
+    const std::string apiFuncName = (createQureg)? "CreateReducedDensityQureg" : "CalcReducedDensityMatrix";
+    
+    int* keptQubits;
+    long numKept;
+    WSGetIntegerList(stdlink, &keptQubits, &numKept);
+    
+    try {
+        local_throwExcepIfQuregNotCreated(quregId); // throws
+        int numQb = quregs[quregId].numQubitsRepresented;
+        
+        if (numKept < 1 || numKept > numQb)
+            throw QuESTException("", "Between 1 and " + std::to_string(numQb) + " qubits must be kept."); // throws
+        
+        long long int mask = 0;
+        for (long k=0; k<numKept; k++) {
+            if (keptQubits[k] < 0 || keptQubits[k] >= numQb)
+                throw QuESTException("", "Invalid qubit index (" + std::to_string(keptQubits[k]) + ") of a kept qubit."); // throws
+            if (mask & (1LL << keptQubits[k]))
+                throw QuESTException("", "The kept qubits must be unique."); // throws
+            mask |= 1LL << keptQubits[k];
+        }
+        
+        // compute only the (column-wise) reduced matrix, which is far smaller than the qureg
+        long long int numElems = 1LL << (2*numKept);
+        TempMemoryReservation reservation(2 * numElems * sizeof(qreal)); // throws
+        std::vector<qreal> elemsRe(numElems);
+        std::vector<qreal> elemsIm(numElems);
+        extension_calcReducedDensityMatrix(
+            elemsRe.data(), elemsIm.data(), quregs[quregId], keptQubits, numKept);
+        
+        if (createQureg) {
+            size_t id = local_getNextQuregID();
+            quregs[id] = local_createDensityQureg(numKept); // throws
+            quregIsCreated[id] = true;
+            setDensityAmps(quregs[id], 0, 0, elemsRe.data(), elemsIm.data(), numElems);
+            WSPutInteger(stdlink, id);
+            
+        } else {
+            // column-major, so sent as {col, row, 2}
+            int dim = 1 << numKept;
+            WSPutFunction(stdlink, "List", 2);
+            WSPutInteger(stdlink, numKept);
+            local_sendComplexArrayToMMA(elemsRe.data(), elemsIm.data(), {dim, dim});
+        }
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+    
+    WSReleaseIntegerList(stdlink, keptQubits, numKept);
+}
+
+/* @param returnCounts whether to return the number of shots of each distinct outcome 
+ *      (as {outcomes, counts}), rather than the outcome of every shot (in order)
+ */
+void internal_sampleQuregOutcomes(int quregId, int returnCounts) {
+    const std::string apiFuncName = "SampleQuregOutcomes";
+    
+    int* qubits;
+    long numQubits;
+    WSGetIntegerList(stdlink, &qubits, &numQubits);
+    
+    long numShots;
+    WSGetLongInteger(stdlink, &numShots);
+    
+    try {
+        local_throwExcepIfQuregNotCreated(quregId); // throws
+        
+        if (numShots < 0)
+            throw QuESTException("", "The number of shots must be a non-negative integer."); // throws
+        
+        // precede QuEST's validation of the qubits, to avoid an excessive allocation
+        if (numQubits > quregs[quregId].numQubitsRepresented)
+            throw QuESTException("", "More qubits were given than exist in the qureg."); // throws
+        
+        // compute the marginal distribution of the qubits in a single (parallel) pass, which 
+        // leaves the state unchanged and accepts density matrices (via their diagonal)
+        long long int numTempBytes = (returnCounts)?
+            (sizeof(qreal) + sizeof(wsint64)) << numQubits :
+            (sizeof(qreal) << numQubits) + numShots * (long long int) sizeof(wsint64);
+        TempMemoryReservation reservation(numTempBytes); // throws
+        
+        std::vector<qreal> cumProbs(1LL << numQubits);
+        calcProbOfAllOutcomes(cumProbs.data(), quregs[quregId], qubits, numQubits); // throws
+        for (size_t i=1; i<cumProbs.size(); i++)
+            cumProbs[i] += cumProbs[i-1];
+        
+        // draw every shot from the cumulative distribution, in time O(numShots numQubits)
+        if (returnCounts) {
+            std::vector<wsint64> counts(cumProbs.size(), 0);
+            for (long n=0; n<numShots; n++)
+                counts[local_getRandomIndexFromCumulative(cumProbs.data(), cumProbs.size())]++;
+            
+            // only the observed outcomes are returned
+            std::vector<wsint64> observedOutcomes;
+            std::vector<wsint64> observedCounts;
+            for (size_t i=0; i<counts.size(); i++) {
+                if (counts[i] > 0) {
+                    observedOutcomes.push_back(i);
+                    observedCounts.push_back(counts[i]);
+                }
+            }
+            
+            WSPutFunction(stdlink, "List", 2);
+            WSPutInteger64List(stdlink, observedOutcomes.data(), observedOutcomes.size());
+            WSPutInteger64List(stdlink, observedCounts.data(), observedCounts.size());
+            
+        } else {
+            std::vector<wsint64> shots(numShots);
+            for (long n=0; n<numShots; n++)
+                shots[n] = local_getRandomIndexFromCumulative(cumProbs.data(), cumProbs.size());
+            
+            WSPutInteger64List(stdlink, shots.data(), numShots);
+        }
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+    
+    WSReleaseIntegerList(stdlink, qubits, numQubits);
 }
 
 void wrapper_calcFidelity(int id1, int id2) {
@@ -669,9 +1440,7 @@ void internal_calcDensityInnerProductsVector(int rhoId, int* omegaIds, long numO
         }
             
         // send result to MMA
-        WSPutFunction(stdlink, "List", 2);
-        WSPutQrealList(stdlink, prodsRe, numOmegas);
-        WSPutQrealList(stdlink, prodsIm, numOmegas);
+        local_sendComplexArrayToMMA(prodsRe, prodsIm, {(int) numOmegas});
     
     } catch (QuESTException& err) {
         local_sendErrorAndFail("CalcDensityInnerProducts", err.message);
@@ -708,9 +1477,7 @@ void internal_calcInnerProductsVector(int braId, int* ketIds, long numKets) {
         }
         
         // send result to MMA
-        WSPutFunction(stdlink, "List", 2);
-        WSPutQrealList(stdlink, vecRe, numKets);
-        WSPutQrealList(stdlink, vecIm, numKets);
+        local_sendComplexArrayToMMA(vecRe, vecIm, {(int) numKets});
         
         // clean-up
         free(vecRe);
@@ -785,9 +1552,7 @@ void internal_calcInnerProductsMatrix(int* quregIds, long numQuregs) {
         }
         
         // return
-        WSPutFunction(stdlink, "List", 2);
-        WSPutQrealList(stdlink, matrRe, len);
-        WSPutQrealList(stdlink, matrIm, len);
+        local_sendComplexArrayToMMA(matrRe, matrIm, {(int) numQuregs, (int) numQuregs});
         
         // cleanup
         free(matrRe);
@@ -811,6 +1576,28 @@ void internal_calcInnerProductsMatrix(int* quregIds, long numQuregs) {
  * HAMILTONIAN EVALUATION
  */
 
+/* rotates qureg so that a subsequent Z-basis measurement of each qubit q instead 
+ * measures it in the Pauli basis of code bases[q] (1=X, 2=Y, else unchanged)
+ */
+void local_rotateQuregIntoPauliBases(Qureg qureg, int* bases) {
+    
+    // prepare Ry(-PI/2) (maps Z -> X) and Rx(PI/2) (maps Z to Y) operators
+    qreal v = 1/sqrt(2.);
+    ComplexMatrix2 ry = local_getZeroComplexMatrix2();
+    ry.real[0][0] =  v;  ry.real[0][1] = v;
+    ry.real[1][0] = -v;  ry.real[1][1] = v;
+    ComplexMatrix2 rx = local_getZeroComplexMatrix2();
+    rx.real[0][0] =  v;  rx.imag[0][1] = -v;
+    rx.imag[1][0] = -v;  rx.real[1][1] = v;
+    
+    for (int q=0; q<qureg.numQubitsRepresented; q++) {
+        if (bases[q] == 1)
+            unitary(qureg, q, ry); // Z -> X
+        if (bases[q] == 2)
+            unitary(qureg, q, rx); // Z -> Y
+    }
+}
+
 void internal_calcExpecPauliString(int quregId, int workspaceId) {
     
     // must load MMA args before validation (these must all also be freed)
@@ -852,6 +1639,181 @@ void internal_calcExpecPauliString(int quregId, int workspaceId) {
         termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm, arrPaulis);
 }
 
+/* @param workspaceId a qureg of equal dimension and type to quregId, or -1 to create one internally
+ * @param weightShots whether to divide the total shots between the groups proportional to 
+ *      their coefficient magnitudes, rather than drawing numShots per group
+ */
+void internal_calcExpecPauliStringFromShots(int quregId, int workspaceId, int weightShots) {
+    const std::string apiFuncName = "CalcExpecPauliStringFromShots";
+    
+    long numShots;
+    WSGetLongInteger(stdlink, &numShots);
+    
+    // load Hamiltonian from MMA (and also validate quregId), must later free
+    PauliHamil hamil;
+    try {
+        hamil = local_loadPauliHamilForQuregFromMMA(quregId); // throws
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+        return;
+    }
+    
+    Qureg qureg = quregs[quregId];
+    Qureg workspace;
+    bool workspaceIsCreated = false;
+    int numQb = hamil.numQubits;
+    
+    try {
+        if (numShots < 2)
+            throw QuESTException("", "The number of shots must be at least 2."); // throws
+        
+        if (workspaceId != -1) {
+            local_throwExcepIfQuregNotCreated(workspaceId); // throws
+            if (workspaceId == quregId)
+                throw QuESTException("", "qureg and workspace must be different quregs."); // throws
+            if (quregs[workspaceId].isDensityMatrix != qureg.isDensityMatrix || 
+                quregs[workspaceId].numQubitsRepresented != qureg.numQubitsRepresented)
+                throw QuESTException("", "workspace must be of equal dimension and type to qureg."); // throws
+        }
+        
+        // identity terms are measured exactly; the rest are greedily assigned (in order of decreasing 
+        // coefficient magnitude) to the first qubit-wise commuting group with a compatible basis
+        qreal idSum = 0;
+        std::vector<int> termOrder;
+        for (int t=0; t<hamil.numSumTerms; t++) {
+            pauliOpType* codes = &hamil.pauliCodes[t*numQb];
+            if (std::all_of(codes, codes + numQb, [](pauliOpType c) { return c == PAULI_I; }))
+                idSum += hamil.termCoeffs[t];
+            else
+                termOrder.push_back(t);
+        }
+        std::stable_sort(termOrder.begin(), termOrder.end(), [&hamil](int a, int b) {
+            return fabs(hamil.termCoeffs[a]) > fabs(hamil.termCoeffs[b]); });
+        
+        std::vector<std::vector<int>> groupBases;
+        std::vector<std::vector<int>> groupTerms;
+        for (int t : termOrder) {
+            pauliOpType* codes = &hamil.pauliCodes[t*numQb];
+            
+            size_t g;
+            for (g=0; g<groupBases.size(); g++) {
+                int q;
+                for (q=0; q<numQb; q++)
+                    if (codes[q] != PAULI_I && groupBases[g][q] != PAULI_I && codes[q] != groupBases[g][q])
+                        break;
+                if (q == numQb)
+                    break;
+            }
+            if (g == groupBases.size()) {
+                groupBases.push_back(std::vector<int>(numQb, PAULI_I));
+                groupTerms.push_back(std::vector<int>());
+            }
+            for (int q=0; q<numQb; q++)
+                if (codes[q] != PAULI_I)
+                    groupBases[g][q] = codes[q];
+            groupTerms[g].push_back(t);
+        }
+        size_t numGroups = groupBases.size();
+        
+        // allocate each group's shots, optionally proportional to the total magnitude of its coefficients
+        std::vector<long> groupShots(numGroups, numShots);
+        qreal totalWeight = 0;
+        std::vector<qreal> groupWeights(numGroups, 0);
+        for (size_t g=0; g<numGroups; g++) {
+            for (int t : groupTerms[g])
+                groupWeights[g] += fabs(hamil.termCoeffs[t]);
+            totalWeight += groupWeights[g];
+        }
+        if (weightShots && totalWeight > 0)
+            for (size_t g=0; g<numGroups; g++)
+                groupShots[g] = std::max(2L, (long) round(numShots * numGroups * groupWeights[g] / totalWeight));
+        
+        if (workspaceId != -1)
+            workspace = quregs[workspaceId];
+        else if (numGroups > 0) {
+            workspace = local_createCloneQureg(qureg); // throws
+            workspaceIsCreated = true;
+        }
+        
+        // the estimate and its variance are the sums of those of the independent groups
+        qreal expecVal = idSum;
+        qreal variance = 0;
+        
+        for (size_t g=0; g<numGroups; g++) {
+            local_throwExcepIfUserAborted(); // throws
+            
+            // rotate a copy of the state into the group's basis
+            cloneQureg(workspace, qureg);
+            local_rotateQuregIntoPauliBases(workspace, groupBases[g].data());
+            
+            // each term's Paulis become a mask of the group's measured (non-identity) qubits
+            std::vector<int> suppQubits;
+            for (int q=0; q<numQb; q++)
+                if (groupBases[g][q] != PAULI_I)
+                    suppQubits.push_back(q);
+            std::vector<long long int> termMasks;
+            for (int t : groupTerms[g]) {
+                long long int mask = 0;
+                for (size_t i=0; i<suppQubits.size(); i++)
+                    if (hamil.pauliCodes[t*numQb + suppQubits[i]] != PAULI_I)
+                        mask |= 1LL << i;
+                termMasks.push_back(mask);
+            }
+            
+            // tally the shots drawn from the group's marginal outcome distribution
+            std::vector<qreal> cumProbs(1LL << suppQubits.size());
+            calcProbOfAllOutcomes(cumProbs.data(), workspace, suppQubits.data(), suppQubits.size()); // throws
+            for (size_t i=1; i<cumProbs.size(); i++)
+                cumProbs[i] += cumProbs[i-1];
+            std::vector<long> counts(cumProbs.size(), 0);
+            for (long n=0; n<groupShots[g]; n++)
+                counts[local_getRandomIndexFromCumulative(cumProbs.data(), cumProbs.size())]++;
+            
+            // each shot yields the group's energy sum_t c_t (-1)^(parity of its outcome under t); 
+            // aggregate the moments of the observed outcomes through Kahan summation, to mitigate 
+            // numerical error
+            qreal sum = 0, sumCompen = 0;
+            qreal sumSq = 0, sumSqCompen = 0;
+            for (size_t m=0; m<counts.size(); m++) {
+                if (counts[m] == 0)
+                    continue;
+                    
+                qreal energy = 0;
+                for (size_t i=0; i<termMasks.size(); i++)
+                    energy += hamil.termCoeffs[groupTerms[g][i]] * (1 - 2*(local_popcount(m & termMasks[i]) & 1));
+                
+                qreal tmp1 = counts[m] * energy - sumCompen;
+                qreal tmp2 = sum + tmp1;
+                sumCompen = (tmp2 - sum) - tmp1;
+                sum = tmp2;
+                
+                tmp1 = counts[m] * energy * energy - sumSqCompen;
+                tmp2 = sumSq + tmp1;
+                sumSqCompen = (tmp2 - sumSq) - tmp1;
+                sumSq = tmp2;
+            }
+            
+            // the variance of the group's mean is its (unbiased) sample variance over the shots
+            long n = groupShots[g];
+            qreal mean = sum / n;
+            expecVal += mean;
+            variance += std::max((qreal) 0, (sumSq - n*mean*mean) / (n - 1)) / n;
+        }
+        
+        WSPutFunction(stdlink, "List", 2);
+        WSPutQreal(stdlink, expecVal);
+        WSPutQreal(stdlink, variance);
+        
+    } catch (QuESTException& err) {
+        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower, err.message);
+    }
+    
+    // clean-up even if above errors
+    local_freePauliHamil(hamil);
+    if (workspaceIsCreated)
+        local_destroyQureg(workspace);
+}
+
 void internal_calcPauliStringMatrix(int numQubits) {
     
     // must load MMA args before validation (these must all also be freed)
@@ -861,9 +1823,25 @@ void internal_calcPauliStringMatrix(int numQubits) {
     local_loadEncodedPauliStringFromMMA(
         &numPaulis, &numTerms, &termCoeffs, &allPauliCodes, &allPauliTargets, &numPaulisPerTerm);
 
-    // create states needed to apply Pauli products
-    Qureg inQureg = createQureg(numQubits, env);
-    Qureg outQureg = createQureg(numQubits, env);
+    // create states needed to apply Pauli products, if they fit the memory budget
+    Qureg inQureg, outQureg;
+    bool isInQuregCreated = false;
+    try {
+        if (numQubits > 0 && numQubits < 58)
+            local_throwExcepIfExceedsMemoryBudget(2 * local_getQuregNumBytes(numQubits, 0)); // throws
+        
+        inQureg = local_createQureg(numQubits); // throws
+        isInQuregCreated = true;
+        outQureg = local_createQureg(numQubits); // throws (despite the above check, if allocation fails)
+        
+    } catch( QuESTException& err) {
+        if (isInQuregCreated)
+            local_destroyQureg(inQureg);
+        local_freePauliString(numPaulis, numTerms, 
+            termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm, NULL);
+        local_sendErrorAndFail("CalcPauliStringMatrix", err.message);
+        return;
+    }
     
     // init to null in case loading fails, to indicate no-cleanup needed
     pauliOpType* arrPaulis = NULL;
@@ -881,17 +1859,17 @@ void internal_calcPauliStringMatrix(int numQubits) {
         // must still perform cleanup to avoid memory leak
         local_freePauliString(numPaulis, numTerms, 
             termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm, arrPaulis);
-        destroyQureg(inQureg, env);
-        destroyQureg(outQureg, env);
+        local_destroyQureg(inQureg);
+        local_destroyQureg(outQureg);
         
         // then exit 
         local_sendErrorAndFail("CalcPauliStringMatrix", err.message);
         return;
     }
     
-    // get result of paulis on each basis state
+    // get result of paulis on each basis state, each sent as a {dim, 2} array
     long long int dim = inQureg.numAmpsTotal;
-    WSPutFunction(stdlink, "List", 2*dim);
+    WSPutFunction(stdlink, "List", dim);
     
     for (long long int i=0; i < dim; i++) {
         initClassicalState(inQureg, i);
@@ -900,8 +1878,7 @@ void internal_calcPauliStringMatrix(int numQubits) {
         syncQuESTEnv(env);
         copyStateFromGPU(outQureg); // does nothing on CPU
         
-        WSPutQrealList(stdlink, outQureg.stateVec.real, dim);
-        WSPutQrealList(stdlink, outQureg.stateVec.imag, dim);
+        local_sendComplexArrayToMMA(outQureg.stateVec.real, outQureg.stateVec.imag, {(int) dim});
     }
     
     // output has already been 'put'
@@ -909,8 +1886,8 @@ void internal_calcPauliStringMatrix(int numQubits) {
     // clean up
     local_freePauliString(numPaulis, numTerms, 
         termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm, arrPaulis);
-    destroyQureg(inQureg, env);
-    destroyQureg(outQureg, env);
+    local_destroyQureg(inQureg);
+    local_destroyQureg(outQureg);
 }
 
 void internal_applyPauliString(int inId, int outId) {
@@ -1199,7 +2176,104 @@ void wrapper_applyFullQFT(int id) {
  * CLASSICAL SHADOWS
  */
 
-void internal_sampleClassicalShadow(int quregId) {
+size_t local_getNextShadowID(void) {
+    size_t id;
+    
+    // check for next id
+    for (id=0; id < shadows.size(); id++)
+        if (!shadowIsCreated[id])
+            return id;
+            
+    // if none are available, make more space (using a blank shadow)
+    ClassicalShadow blank(1);
+    id = shadows.size();
+    shadows.push_back(blank);
+    shadowIsCreated.push_back(false);
+    return id;
+}
+
+void local_throwExcepIfInvalidNumShadowBatches(std::string apiFuncName, int numBatches, long numSamples) {
+    
+    if (numBatches < 1)
+        throw QuESTException("", "The number of batches must be a positive integer (default 10)."); // throws
+    if (numBatches > numSamples)
+        throw QuESTException("", "The number of batches cannot exceed the number of samples."); // throws
+    if (numBatches > 200)
+        local_sendWarningAndContinue(apiFuncName, 
+            "Warning: using a very large number of batches may cause errors. Use Quiet[] to suppress this warning.");
+}
+
+void internal_createClassicalShadow(int numQb) {
+    std::string apiFuncName = "CreateClassicalShadow";
+    
+    long numSamples;
+    WSGetLongInteger(stdlink, &numSamples);
+    
+    int *sampleBases, *sampleOutcomes;
+    long lenTotalBases;
+    WSGetIntegerList(stdlink, &sampleBases, &lenTotalBases);
+    WSGetIntegerList(stdlink, &sampleOutcomes, &lenTotalBases);
+    
+    try {
+        if (numQb < 1)
+            throw QuESTException("", "The number of qubits must be a positive integer."); // throws
+        if (numSamples < 0 || lenTotalBases != numSamples * numQb)
+            throw QuESTException("", "The number of sample bases and outcomes must equal the number of samples times the number of qubits."); // throws
+            
+        // validate and encode the samples before committing to an id
+        ClassicalShadow shadow(numQb);
+        shadow.addSamples(sampleBases, sampleOutcomes, numSamples); // throws
+        
+        size_t id = local_getNextShadowID();
+        shadows[id] = std::move(shadow);
+        shadowIsCreated[id] = true;
+        WSPutInteger(stdlink, id);
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+    
+    // clean-up (even if above errors)
+    WSReleaseIntegerList(stdlink, sampleBases, lenTotalBases);
+    WSReleaseIntegerList(stdlink, sampleOutcomes, lenTotalBases);
+}
+
+void internal_destroyClassicalShadow(int shadowId) {
+    std::string apiFuncName = "DestroyClassicalShadow";
+    
+    try {
+        local_throwExcepIfShadowNotCreated(shadowId); // throws
+        
+        // replace the shadow to free its memory
+        shadows[shadowId] = ClassicalShadow(1);
+        shadowIsCreated[shadowId] = false;
+        WSPutInteger(stdlink, shadowId);
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+}
+
+void internal_getClassicalShadow(int shadowId) {
+    std::string apiFuncName = "GetClassicalShadow";
+    
+    try {
+        local_throwExcepIfShadowNotCreated(shadowId); // throws
+        
+        shadows[shadowId].sendToMMA();
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+}
+
+/* @param shadowId the id of a created shadow to which the samples are appended 
+ *      (in lieu of being returned), or -1
+ */
+void internal_sampleClassicalShadow(int quregId, int shadowId) {
     std::string apiFuncName = "SampleClassicalShadow";
     
     long numSamples;
@@ -1212,6 +2286,20 @@ void internal_sampleClassicalShadow(int quregId) {
         if (numSamples <= 0)
             throw QuESTException("", "The number of samples must be a positive integer."); // throws
             
+        if (shadowId != -1) {
+            local_throwExcepIfShadowNotCreated(shadowId); // throws
+            
+            if (shadows[shadowId].getNumQubits() != quregs[quregId].numQubitsRepresented)
+                throw QuESTException("", "The classical shadow (of " + std::to_string(shadows[shadowId].getNumQubits()) + 
+                    " qubits) has a different number of qubits than the qureg (of " + 
+                    std::to_string(quregs[quregId].numQubitsRepresented) + " qubits)."); // throws
+        }
+        
+        // a clone of the qureg and its outcome distribution are needed
+        local_throwExcepIfExceedsMemoryBudget(
+            local_getQuregNumBytes(quregs[quregId]) + 
+            ((long long int) sizeof(qreal) << quregs[quregId].numQubitsRepresented)); // throws
+            
     } catch( QuESTException& err) {
         
         local_sendErrorAndFail(apiFuncName, err.message);
@@ -1219,7 +2307,6 @@ void internal_sampleClassicalShadow(int quregId) {
     }
     
     Qureg qureg = quregs[quregId];
-    Qureg tmp = createCloneQureg(qureg, env);
     int numQubits = qureg.numQubitsRepresented;
     
     // prepare the output structures
@@ -1227,49 +2314,83 @@ void internal_sampleClassicalShadow(int quregId) {
     std::vector<int> allPauliCodes(outputLens);
     std::vector<int> allBitOutcomes(outputLens);
     
-    // prepare a to-be-shuffled list of targets
-    std::vector<int> targs(numQubits);
+    // draw every sample's random measurement basis upfront
+    for (long long int i=0; i<outputLens; i++)
+        allPauliCodes[i] = 1 + local_getRandomIndex(3); // returns one of {1,2,3}
+    
+    // group the samples by their basis, so that each distinct basis is prepared only once
+    std::vector<long> sampleOrder(numSamples);
+    for (long n=0; n<numSamples; n++)
+        sampleOrder[n] = n;
+    int* codes = allPauliCodes.data();
+    std::sort(sampleOrder.begin(), sampleOrder.end(), [codes, numQubits](long a, long b) {
+        return std::lexicographical_compare(
+            codes + a*numQubits, codes + (a+1)*numQubits, 
+            codes + b*numQubits, codes + (b+1)*numQubits); });
+        
+    // the cumulative outcome distribution of the current basis, over all qubits
+    std::vector<int> allQubits(numQubits);
     for (int q=0; q<numQubits; q++)
-        targs[q] = q;
-        
-    // prepare Ry(-PI/2) (maps Z -> X) and Rx(PI/2) (maps Z to Y) operators
-    qreal v = 1/sqrt(2.);
-    ComplexMatrix2 ry = local_getZeroComplexMatrix2();
-    ry.real[0][0] =  v;  ry.real[0][1] = v;
-    ry.real[1][0] = -v;  ry.real[1][1] = v;
-    ComplexMatrix2 rx = local_getZeroComplexMatrix2();
-    rx.real[0][0] =  v;  rx.imag[0][1] = -v;
-    rx.imag[1][0] = -v;  rx.real[1][1] = v;
-        
-    for (long n=0; n<numSamples; n++) {
+        allQubits[q] = q;
+    std::vector<qreal> cumProbs(1LL << numQubits);
+    
+    Qureg tmp;
+    try {
+        tmp = local_createCloneQureg(qureg); // throws
         
-        // shuffle qubit-collapse order, just for numerical safety
-        cloneQureg(tmp, qureg);
-        local_lazyShuffle(targs);
+    } catch( QuESTException& err) {
         
-        for (int i=0; i<numQubits; i++) {
-            int q = targs[i];
-            int pauli = 1 + local_getRandomIndex(3); // returns one of {1,2,3}
+        local_sendErrorAndFail(apiFuncName, err.message);
+        return;
+    }
+    
+    try {
+        long start = 0;
+        while (start < numSamples) {
+            local_throwExcepIfUserAborted(); // throws
+            
+            // find the extent of the group of samples sharing this basis
+            int* basis = &codes[sampleOrder[start] * numQubits];
+            long end = start + 1;
+            while (end < numSamples && std::equal(basis, basis + numQubits, &codes[sampleOrder[end] * numQubits]))
+                end++;
             
-            // rotate measurement basis
-            if (pauli == 1)
-                unitary(tmp, q, ry); // Z -> X
-            if (pauli == 2)
-                unitary(tmp, q, rx); // Z -> Y    
+            // rotate a copy of the state into the basis
+            cloneQureg(tmp, qureg);
+            local_rotateQuregIntoPauliBases(tmp, basis);
             
-            // record operation, collapse state and record outcome
-            long long int ind = n*numQubits + q;
-            allPauliCodes[ind] = pauli;
-            allBitOutcomes[ind] = measure(tmp, q);
+            // compute the full-register outcome distribution once, and draw every sample from it
+            calcProbOfAllOutcomes(cumProbs.data(), tmp, allQubits.data(), numQubits);
+            for (size_t i=1; i<cumProbs.size(); i++)
+                cumProbs[i] += cumProbs[i-1];
+            
+            for (long i=start; i<end; i++) {
+                long long int outcome = local_getRandomIndexFromCumulative(cumProbs.data(), cumProbs.size());
+                long long int offset = sampleOrder[i] * (long long int) numQubits;
+                for (int q=0; q<numQubits; q++)
+                    allBitOutcomes[offset + q] = (outcome >> q) & 1;
+            }
+            
+            start = end;
+        }
+        
+        // write the samples directly into the persistent shadow (already validated), or return them
+        if (shadowId != -1) {
+            shadows[shadowId].addSamples(allPauliCodes.data(), allBitOutcomes.data(), numSamples);
+            WSPutInteger(stdlink, shadowId);
+        } else {
+            WSPutFunction(stdlink, "List", 3);
+            WSPutInteger(stdlink, numQubits);
+            WSPutIntegerList(stdlink, allPauliCodes.data(), outputLens);
+            WSPutIntegerList(stdlink, allBitOutcomes.data(), outputLens);
         }
+        
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower, err.message);
     }
     
-    WSPutFunction(stdlink, "List", 3);
-    WSPutInteger(stdlink, numQubits);
-    WSPutIntegerList(stdlink, allPauliCodes.data(), outputLens);
-    WSPutIntegerList(stdlink, allBitOutcomes.data(), outputLens);
-    
-    destroyQureg(tmp, env);
+    local_destroyQureg(tmp);
 }
 
 void internal_calcExpecPauliProdsFromClassicalShadow(int numQb, int numBatches) {
@@ -1286,25 +2407,14 @@ void internal_calcExpecPauliProdsFromClassicalShadow(int numQb, int numBatches)
     WSGetIntegerList(stdlink, &pauliTargs, &lenTotalPaulis);
     WSGetIntegerList(stdlink, &numPaulisPerProd, &numProds);
     
-    std::vector<qreal> prodExpecVals(numProds);
-    
     try {
-        // validate numBatches 
-        if (numBatches < 1)
-            throw QuESTException("", "The number of batches must be a positive integer (default 10).");
-        if (numBatches > numSamples)
-            throw QuESTException("", "The number of batches cannot exceed the number of samples.");
-        if (numBatches > 200)
-            local_sendWarningAndContinue(apiFuncName, 
-                "Warning: using a very large number of batches may cause errors. Use Quiet[] to suppress this warning.");
-        
-        // perform remaining validation (parallelised) and populate prodExpecVals
-        extension_calcExpecPauliProdsFromClassicalShadow(
-            prodExpecVals, numProds,
-            sampleBases, sampleOutcomes, numQb, numSamples,
-            pauliCodes,  pauliTargs, numPaulisPerProd,
-            numBatches
-        ); // throws
+        local_throwExcepIfInvalidNumShadowBatches(apiFuncName, numBatches, numSamples); // throws
+        
+        // perform remaining validation (parallelised) of a temporary shadow
+        ClassicalShadow shadow(numQb);
+        shadow.addSamples(sampleBases, sampleOutcomes, numSamples); // throws
+        std::vector<qreal> prodExpecVals = shadow.calcExpecPauliProds(
+            pauliCodes, pauliTargs, numPaulisPerProd, numProds, numBatches); // throws
 
         WSPutQrealList(stdlink, prodExpecVals.data(), numProds);
 
@@ -1321,18 +2431,73 @@ void internal_calcExpecPauliProdsFromClassicalShadow(int numQb, int numBatches)
     WSReleaseIntegerList(stdlink, numPaulisPerProd, numProds);
 }
 
+void internal_calcExpecPauliProdsFromStoredClassicalShadow(int shadowId, int numBatches) {
+    std::string apiFuncName = "CalcExpecPauliProdsFromClassicalShadow";
+    
+    int *pauliCodes, *pauliTargs, *numPaulisPerProd;
+    long lenTotalPaulis, numProds;
+    WSGetIntegerList(stdlink, &pauliCodes, &lenTotalPaulis);
+    WSGetIntegerList(stdlink, &pauliTargs, &lenTotalPaulis);
+    WSGetIntegerList(stdlink, &numPaulisPerProd, &numProds);
+    
+    try {
+        local_throwExcepIfShadowNotCreated(shadowId); // throws
+        local_throwExcepIfInvalidNumShadowBatches(apiFuncName, numBatches, shadows[shadowId].getNumSamples()); // throws
+        
+        // the stored shadow is already validated and encoded
+        std::vector<qreal> prodExpecVals = shadows[shadowId].calcExpecPauliProds(
+            pauliCodes, pauliTargs, numPaulisPerProd, numProds, numBatches); // throws
+
+        WSPutQrealList(stdlink, prodExpecVals.data(), numProds);
+
+    } catch( QuESTException& err) {
+        
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+
+    // clean-up (even if above errors)
+    WSReleaseIntegerList(stdlink, pauliCodes, lenTotalPaulis);
+    WSReleaseIntegerList(stdlink, pauliTargs, lenTotalPaulis);
+    WSReleaseIntegerList(stdlink, numPaulisPerProd, numProds);
+}
+
 
 
 /*
  * WSTP LAUNCH
  */
 
+/* Sets quregAllocMode from the environment variable QUESTLINK_QUREG_ALLOC, which
+ * is one of "default", "first-touch", "transparent-huge-pages" or "huge-pages".
+ * Unrecognised values are reported to stderr (since the link is not yet established)
+ * and ignored.
+ */
+void local_setQuregAllocModeFromEnvVar() {
+    
+    const char* var = getenv("QUESTLINK_QUREG_ALLOC");
+    if (var == NULL)
+        return;
+    
+    std::string mode(var);
+    if (mode == "default")
+        quregAllocMode = ALLOC_DEFAULT;
+    else if (mode == "first-touch")
+        quregAllocMode = ALLOC_FIRST_TOUCH;
+    else if (mode == "transparent-huge-pages")
+        quregAllocMode = ALLOC_TRANSPARENT_HUGE_PAGES;
+    else if (mode == "huge-pages")
+        quregAllocMode = ALLOC_EXPLICIT_HUGE_PAGES;
+    else
+        fprintf(stderr, "QuESTlink: ignoring unrecognised QUESTLINK_QUREG_ALLOC=\"%s\"\n", var);
+}
+
 #ifndef _WIN32
 
     int main(int argc, char* argv[]) {
       
         // create the single, global QuEST execution env
         env = createQuESTEnv();
+        local_setQuregAllocModeFromEnvVar();
         
         // establish link with MMA
         return WSMain(argc, argv);
@@ -1344,6 +2509,7 @@ void internal_calcExpecPauliProdsFromClassicalShadow(int numQb, int numBatches)
       
         // create the single, global QuEST execution env
         env = createQuESTEnv();
+        local_setQuregAllocModeFromEnvVar();
 
         // parse Windows args
         char  buff[512];
@@ -2,6 +2,7 @@
 #define LINK_H
 
 #include "QuEST.h"
+#include "shadows.hpp"
 #include <vector>
 
 
@@ -16,5 +17,54 @@ extern QuESTEnv env;
 extern std::vector<Qureg> quregs;
 extern std::vector<bool> quregIsCreated;
 
+/*
+ * Collection of classical shadows persisted between calls
+ */
+extern std::vector<ClassicalShadow> shadows;
+extern std::vector<bool> shadowIsCreated;
+
+/*
+ * Creation and destruction of temporary and user quregs, which reuse the memory 
+ * of previously destroyed quregs of the same size and type, retained in a pool 
+ * of bounded capacity (see link.cpp). These replace the QuEST functions of the 
+ * same name (which need not be passed env), and their quregs must not be mixed.
+ */
+Qureg local_createQureg(int numQubits); // throws
+Qureg local_createDensityQureg(int numQubits); // throws
+Qureg local_createCloneQureg(Qureg qureg); // throws
+void local_destroyQureg(Qureg qureg);
+
+/*
+ * Accounting of the memory used by the link, against an optional budget (see link.cpp).
+ * Operations should check their extra memory (such as the number of temporary quregs 
+ * they will create, as per DerivCircuit::getNumNeededWorkQuregsFor()) up front, 
+ * before any allocation, so that they fail fast.
+ */
+long long int local_getQuregNumBytes(int numQubits, int isDensityMatrix);
+long long int local_getQuregNumBytes(Qureg qureg);
+
+/** @throws QuESTException if numExtraBytes more memory would exceed the memory 
+ *      budget, after freeing pooled quregs
+ */
+void local_throwExcepIfExceedsMemoryBudget(long long int numExtraBytes); // throws
+
+/** Accounts for a temporary buffer of numBytes over the lifetime of this object, 
+ * which should be constructed before the buffer is allocated.
+ * @throws QuESTException upon construction if the buffer would exceed the memory budget
+ */
+class TempMemoryReservation {
+    private:
+    
+        long long int numBytes;
+    
+    public:
+    
+        TempMemoryReservation(long long int numBytes); // throws
+        ~TempMemoryReservation();
+        
+        TempMemoryReservation(const TempMemoryReservation&) = delete;
+        TempMemoryReservation& operator=(const TempMemoryReservation&) = delete;
+};
+
 
 #endif // LINK_H
\ No newline at end of file
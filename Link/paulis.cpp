@@ -0,0 +1,1052 @@
+/** @file
+ * Contains a native algebra of weighted Pauli strings, stored as packed bitsets,
+ * used to simplify numerical Pauli expressions far faster than is possible
+ * through Mathematica pattern rewriting.
+ *
+ * @author Tyson Jones
+ */
+
+#include "wstp.h"
+#include "QuEST.h"
+#include "QuEST_complex.h"
+
+#include "paulis.hpp"
+#include "errors.hpp"
+#include "circuits.hpp"
+#include "decoders.hpp"
+#include "utilities.hpp"
+
+#include <string>
+#include <vector>
+
+
+
+/*
+ * The minimum number of pairwise term products needed before a product of
+ * Pauli sums is multithreaded
+ */
+#define MIN_NUM_PRODS_FOR_PARALLEL 4096
+
+/*
+ * The front-end function which receives each layer of a natively computed
+ * Pauli transfer evaluation graph, as it is streamed by CalcPauliTransferEval
+ */
+#define PT_EVAL_LAYER_FUNC "QuEST`Private`appendPTEvalLayer"
+
+/*
+ * The maximum number of numerical PTMaps retained by the persistent cache
+ * between calls, beyond which the least recently used are discarded
+ */
+#define MAX_NUM_CACHED_PTMAPS 4096
+
+
+
+/*
+ * global objects
+ */
+
+PauliTransferMapCache cachedPTMaps(MAX_NUM_CACHED_PTMAPS);
+
+
+
+/*
+ * PauliStr methods
+ */
+
+int PauliStr::getPauli(int qubit) const {
+    int w = qubit / 64;
+    int b = qubit % 64;
+    int x = (xBits[w] >> b) & 1ULL;
+    int z = (zBits[w] >> b) & 1ULL;
+
+    // (x,z) = (0,0)->I, (1,0)->X, (1,1)->Y, (0,1)->Z
+    return (z)? 3 - x : x;
+}
+
+void PauliStr::setPauli(int qubit, int code) {
+    int w = qubit / 64;
+    unsigned long long mask = 1ULL << (qubit % 64);
+
+    // clear the qubit's existing Pauli, then set its new bits
+    xBits[w] &= ~mask;
+    zBits[w] &= ~mask;
+    if (code == PAULI_X || code == PAULI_Y)
+        xBits[w] |= mask;
+    if (code == PAULI_Z || code == PAULI_Y)
+        zBits[w] |= mask;
+}
+
+int PauliStr::getWeight() const {
+    int weight = 0;
+    for (size_t w=0; w<xBits.size(); w++)
+        weight += local_popcount(xBits[w] | zBits[w]);
+    return weight;
+}
+
+bool PauliStr::commutesWith(const PauliStr& other) const {
+
+    // strings commute when they differ by a non-identity Pauli on an even number of qubits
+    int parity = 0;
+    for (size_t w=0; w<xBits.size(); w++)
+        parity ^= local_popcount((xBits[w] & other.zBits[w]) ^ (zBits[w] & other.xBits[w])) & 1;
+    return (parity == 0);
+}
+
+int PauliStr::multiply(const PauliStr& other, PauliStr& out) const {
+
+    // with P(x,z) = i^(x.z) X^x Z^z, it follows that P(x1,z1) P(x2,z2) =
+    // i^(x1.z1 + x2.z2 + 2 z1.x2 - x3.z3) P(x3,z3), where x3=x1^x2 and z3=z1^z2
+    int power = 0;
+    for (size_t w=0; w<xBits.size(); w++) {
+        unsigned long long x1 = xBits[w], z1 = zBits[w];
+        unsigned long long x2 = other.xBits[w], z2 = other.zBits[w];
+        unsigned long long x3 = x1 ^ x2, z3 = z1 ^ z2;
+
+        power += local_popcount(x1 & z1) + local_popcount(x2 & z2)
+            + 2*local_popcount(z1 & x2) - local_popcount(x3 & z3);
+
+        out.xBits[w] = x3;
+        out.zBits[w] = z3;
+    }
+    return ((power % 4) + 4) % 4;
+}
+
+size_t PauliStrHasher::operator()(const PauliStr& str) const {
+
+    // combine the golden-ratio-scattered words of both bitsets
+    unsigned long long hash = 0;
+    for (size_t w=0; w<str.xBits.size(); w++) {
+        hash ^= str.xBits[w] * 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+        hash ^= str.zBits[w] * 0xC2B2AE3D27D4EB4FULL + (hash << 6) + (hash >> 2);
+    }
+    return (size_t) hash;
+}
+
+
+
+/*
+ * PauliSum methods
+ */
+
+void PauliSum::addTerm(const PauliStr& str, qcomp coeff) {
+    terms[str] += coeff;
+}
+
+void PauliSum::addSum(const PauliSum& other, qcomp fac) {
+    for (auto const& term : other.terms)
+        terms[term.first] += fac * term.second;
+}
+
+void PauliSum::scale(qcomp fac) {
+    for (auto& term : terms)
+        term.second *= fac;
+}
+
+PauliSum PauliSum::getProductOrCommutator(const PauliSum& other, bool commutator) const {
+
+    // flatten both sums so that their terms can be indexed by threads
+    std::vector<PauliStr> strsA, strsB;
+    std::vector<qcomp> coeffsA, coeffsB;
+    for (auto const& term : terms) {
+        strsA.push_back(term.first);
+        coeffsA.push_back(term.second);
+    }
+    for (auto const& term : other.terms) {
+        strsB.push_back(term.first);
+        coeffsB.push_back(term.second);
+    }
+
+    long numA = strsA.size();
+    long numB = strsB.size();
+    int nWords = numWords;
+
+    // i^p for the phase power p produced by PauliStr::multiply
+    qcomp phases[4] = {qcomp(1,0), qcomp(0,1), qcomp(-1,0), qcomp(0,-1)};
+
+    PauliSum out(numWords);
+    PauliStrMap partial;
+    PauliStr prod;
+    long i, j;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (strsA,strsB, coeffsA,coeffsB, numA,numB, nWords, phases, commutator, out) \
+    private  (i,j, prod, partial) \
+    if       (numA * numB >= MIN_NUM_PRODS_FOR_PARALLEL)
+# endif
+    {
+        prod = PauliStr(nWords);
+
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (i=0; i<numA; i++) {
+            for (j=0; j<numB; j++) {
+
+                // the commutator receives 2AB from anticommuting pairs, and nothing otherwise
+                if (commutator && strsA[i].commutesWith(strsB[j]))
+                    continue;
+
+                int power = strsA[i].multiply(strsB[j], prod);
+                qcomp coeff = coeffsA[i] * coeffsB[j] * phases[power];
+                partial[prod] += (commutator)? qreal(2) * coeff : coeff;
+            }
+        }
+
+        // merge each thread's partial sum
+# ifdef _OPENMP
+# pragma omp critical
+# endif
+        {
+            for (auto const& term : partial)
+                out.addTerm(term.first, term.second);
+        }
+    }
+
+    return out;
+}
+
+PauliSum PauliSum::getProduct(const PauliSum& other) const {
+    return getProductOrCommutator(other, false);
+}
+
+PauliSum PauliSum::getCommutator(const PauliSum& other) const {
+    return getProductOrCommutator(other, true);
+}
+
+PauliSum PauliSum::getPower(int exponent) const {
+
+    PauliSum out(numWords);
+    out.addTerm(PauliStr(numWords), 1);
+    PauliSum base = *this;
+
+    // powers of a single sum commute, so we can repeatedly square
+    while (exponent > 0) {
+        if (exponent & 1)
+            out = out.getProduct(base);
+        exponent >>= 1;
+        if (exponent > 0)
+            base = base.getProduct(base);
+    }
+    return out;
+}
+
+PauliSum PauliSum::getTransferMapped(const PauliTransferMap& map, int maxWeight) const {
+
+    // flatten the sum so that its terms can be indexed by threads
+    std::vector<PauliStr> strs;
+    std::vector<qcomp> coeffs;
+    for (auto const& term : terms) {
+        strs.push_back(term.first);
+        coeffs.push_back(term.second);
+    }
+
+    long numTerms = strs.size();
+    int numTargs = map.targs.size();
+    const int* targs = map.targs.data();
+    const long* outStarts = map.outStarts.data();
+    const int* outInds = map.outInds.data();
+    const qreal* outCoeffs = map.outCoeffs.data();
+
+    PauliSum out(numWords);
+    PauliStrMap partial;
+    PauliStr outStr;
+    long i;
+
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (strs,coeffs,numTerms, numTargs,targs,outStarts,outInds,outCoeffs, maxWeight, out) \
+    private  (i, outStr, partial) \
+    if       (numTerms >= MIN_NUM_PRODS_FOR_PARALLEL)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (i=0; i<numTerms; i++) {
+
+            // find the base-4 index of the Paulis upon the map targets
+            long inInd = 0;
+            for (int t=numTargs-1; t>=0; t--)
+                inInd = 4*inInd + strs[i].getPauli(targs[t]);
+
+            // overwrite the targeted Paulis with those of every output
+            outStr = strs[i];
+            for (long o=outStarts[inInd]; o<outStarts[inInd+1]; o++) {
+                int outInd = outInds[o];
+                for (int t=0; t<numTargs; t++) {
+                    outStr.setPauli(targs[t], outInd % 4);
+                    outInd /= 4;
+                }
+
+                // optionally truncate outputs of too-high weight
+                if (maxWeight >= 0 && outStr.getWeight() > maxWeight)
+                    continue;
+
+                partial[outStr] += coeffs[i] * outCoeffs[o];
+            }
+        }
+
+        // merge each thread's partial sum
+# ifdef _OPENMP
+# pragma omp critical
+# endif
+        {
+            for (auto const& term : partial)
+                out.addTerm(term.first, term.second);
+        }
+    }
+
+    return out;
+}
+
+void PauliSum::removeNegligibleTerms(qreal tol) {
+    for (auto it = terms.begin(); it != terms.end(); ) {
+        if (std::abs(it->second) <= tol)
+            it = terms.erase(it);
+        else
+            it++;
+    }
+}
+
+void PauliSum::sendToMMA() const {
+
+    std::vector<qreal> coeffsRe, coeffsIm;
+    std::vector<int> codes, targs, numPaulisPerTerm;
+
+    for (auto const& term : terms) {
+        coeffsRe.push_back(real(term.second));
+        coeffsIm.push_back(imag(term.second));
+
+        // record only the non-identity Paulis, in increasing order of target
+        int numPaulis = 0;
+        for (int w=0; w<numWords; w++) {
+            if ((term.first.xBits[w] | term.first.zBits[w]) == 0)
+                continue;
+            for (int b=0; b<64; b++) {
+                int code = term.first.getPauli(64*w + b);
+                if (code != PAULI_I) {
+                    codes.push_back(code);
+                    targs.push_back(64*w + b);
+                    numPaulis++;
+                }
+            }
+        }
+        numPaulisPerTerm.push_back(numPaulis);
+    }
+
+    WSPutFunction(stdlink, "List", 5);
+    WSPutQrealList(stdlink, coeffsRe.data(), coeffsRe.size());
+    WSPutQrealList(stdlink, coeffsIm.data(), coeffsIm.size());
+    WSPutIntegerList(stdlink, codes.data(), codes.size());
+    WSPutIntegerList(stdlink, targs.data(), targs.size());
+    WSPutIntegerList(stdlink, numPaulisPerTerm.data(), numPaulisPerTerm.size());
+}
+
+
+
+/*
+ * PauliTransferMapCache methods
+ */
+
+const PauliTransferMap* PauliTransferMapCache::get(const std::string& key) {
+
+    auto found = inds.find(key);
+    if (found == inds.end())
+        return nullptr;
+
+    // move the map to the front of the recency order
+    maps.splice(maps.begin(), maps, found->second);
+    return &(found->second->second);
+}
+
+void PauliTransferMapCache::add(const std::string& key, const PauliTransferMap& map) {
+
+    auto found = inds.find(key);
+    if (found != inds.end()) {
+        maps.erase(found->second);
+        inds.erase(found);
+    }
+
+    // discard the least recently used map to make room
+    if (capacity > 0 && maps.size() >= capacity) {
+        inds.erase(maps.back().first);
+        maps.pop_back();
+    }
+
+    maps.emplace_front(key, map);
+    inds[key] = maps.begin();
+}
+
+void PauliTransferMapCache::clear() {
+    maps.clear();
+    inds.clear();
+}
+
+
+
+/*
+ * PauliTransferEvalLayer methods
+ */
+
+PauliTransferEvalLayer::PauliTransferEvalLayer(const PauliSum& sum) {
+
+    int id = 1;
+    for (auto const& term : sum.getTerms()) {
+        parentStarts.push_back(parentIds.size());
+        strs.push_back(term.first);
+        coeffs.push_back(term.second);
+        ids.push_back(id++);
+
+        // the initial nodes descend from a non-existent node of id 0
+        parentIds.push_back(0);
+        parentFactors.push_back(term.second);
+    }
+    parentStarts.push_back(parentIds.size());
+}
+
+PauliTransferEvalLayer PauliTransferEvalLayer::getTransferMapped(
+    const PauliTransferMap& map, bool combineStrs, int maxWeight, qreal minCoeff, int firstId
+) const {
+    int numTargs = map.targs.size();
+
+    // every output node, some of which may later be pruned
+    std::vector<PauliStr> outStrs;
+    std::vector<qcomp> outCoeffs;
+
+    // every edge as (output node index, parent id, factor), in order of parent
+    std::vector<long> edgeNodes;
+    std::vector<int> edgeParents;
+    std::vector<qreal> edgeFactors;
+
+    // the index in outStrs of every unique string, used only when combining
+    std::unordered_map<PauliStr, long, PauliStrHasher> nodeInds;
+
+    PauliStr outStr;
+    for (size_t n=0; n<strs.size(); n++) {
+
+        // find the base-4 index of the Paulis upon the map targets
+        long inInd = 0;
+        for (int t=numTargs-1; t>=0; t--)
+            inInd = 4*inInd + strs[n].getPauli(map.targs[t]);
+
+        // overwrite the targeted Paulis with those of every output
+        outStr = strs[n];
+        for (long o=map.outStarts[inInd]; o<map.outStarts[inInd+1]; o++) {
+            int outInd = map.outInds[o];
+            for (int t=0; t<numTargs; t++) {
+                outStr.setPauli(map.targs[t], outInd % 4);
+                outInd /= 4;
+            }
+
+            // pruning by weight happens before the node is ever created
+            if (maxWeight >= 0 && outStr.getWeight() > maxWeight)
+                continue;
+
+            // find or create the output node
+            long node = outStrs.size();
+            if (combineStrs) {
+                auto found = nodeInds.emplace(outStr, node);
+                if (!found.second)
+                    node = found.first->second;
+            }
+            if (node == (long) outStrs.size()) {
+                outStrs.push_back(outStr);
+                outCoeffs.push_back(0);
+            }
+
+            outCoeffs[node] += coeffs[n] * map.outCoeffs[o];
+            edgeNodes.push_back(node);
+            edgeParents.push_back(ids[n]);
+            edgeFactors.push_back(map.outCoeffs[o]);
+        }
+    }
+
+    // prune nodes of negligible coefficient, assigning contiguous ids to the rest
+    PauliTransferEvalLayer out;
+    std::vector<long> newInds(outStrs.size(), -1);
+    for (size_t n=0; n<outStrs.size(); n++) {
+        if (minCoeff > 0 && std::abs(outCoeffs[n]) <= minCoeff)
+            continue;
+
+        newInds[n] = out.strs.size();
+        out.strs.push_back(outStrs[n]);
+        out.coeffs.push_back(outCoeffs[n]);
+        out.ids.push_back(firstId + (int) newInds[n]);
+    }
+
+    // counting-sort the surviving edges by their node, forming compressed rows
+    size_t numNodes = out.strs.size();
+    out.parentStarts.assign(numNodes + 1, 0);
+    for (size_t e=0; e<edgeNodes.size(); e++)
+        if (newInds[edgeNodes[e]] >= 0)
+            out.parentStarts[newInds[edgeNodes[e]] + 1]++;
+    for (size_t n=0; n<numNodes; n++)
+        out.parentStarts[n+1] += out.parentStarts[n];
+
+    std::vector<long> nextEdge(out.parentStarts.begin(), out.parentStarts.end() - 1);
+    out.parentIds.resize(out.parentStarts[numNodes]);
+    out.parentFactors.resize(out.parentStarts[numNodes]);
+    for (size_t e=0; e<edgeNodes.size(); e++) {
+        long node = newInds[edgeNodes[e]];
+        if (node < 0)
+            continue;
+        long ind = nextEdge[node]++;
+        out.parentIds[ind] = edgeParents[e];
+        out.parentFactors[ind] = edgeFactors[e];
+    }
+
+    return out;
+}
+
+void PauliTransferEvalLayer::sendToMMA(int numQubits) const {
+
+    std::vector<int> digits, numParentsPerNode;
+    std::vector<qreal> factorsRe, factorsIm;
+
+    digits.reserve(strs.size() * numQubits);
+    for (size_t n=0; n<strs.size(); n++) {
+        for (int q=numQubits-1; q>=0; q--)
+            digits.push_back(strs[n].getPauli(q));
+        numParentsPerNode.push_back(parentStarts[n+1] - parentStarts[n]);
+    }
+    for (size_t e=0; e<parentFactors.size(); e++) {
+        factorsRe.push_back(real(parentFactors[e]));
+        factorsIm.push_back(imag(parentFactors[e]));
+    }
+
+    // send new packet to MMA
+    WSPutFunction(stdlink, "EvaluatePacket", 1);
+
+    WSPutFunction(stdlink, PT_EVAL_LAYER_FUNC, 7);
+    WSPutInteger(stdlink, numQubits);
+    WSPutIntegerList(stdlink, digits.data(), digits.size());
+    WSPutIntegerList(stdlink, ids.data(), ids.size());
+    WSPutIntegerList(stdlink, numParentsPerNode.data(), numParentsPerNode.size());
+    WSPutIntegerList(stdlink, parentIds.data(), parentIds.size());
+    WSPutQrealList(stdlink, factorsRe.data(), factorsRe.size());
+    WSPutQrealList(stdlink, factorsIm.data(), factorsIm.size());
+
+    WSEndPacket(stdlink);
+    WSNextPacket(stdlink);
+    WSNewPacket(stdlink);
+
+    // a new packet is now expected; caller MUST send something else
+}
+
+
+
+/*
+ * matrix decomposition
+ */
+
+void local_setPauliCoeffsFromMatrix(std::vector<qcomp>& elems, int numQubits) {
+
+    qcomp* arr = elems.data();
+    long long numGroups = (1LL << (2*numQubits)) / 4;
+    long long g;
+    qcomp iunit = qcomp(0, 1);
+
+    for (int q=0; q<numQubits; q++) {
+        long long colBit = 1LL << q;
+        long long rowBit = colBit << numQubits;
+        int rowBitInd = numQubits + q;
+
+# ifdef _OPENMP
+# pragma omp parallel for \
+    default  (none) \
+    shared   (arr, numGroups, colBit, rowBit, q, rowBitInd, iunit) \
+    private  (g) \
+    schedule (static)
+# endif
+        for (g=0; g<numGroups; g++) {
+
+            // insert zero bits at the qubit's column and row positions
+            long long k = ((g >> q) << (q+1)) | (g & (colBit-1));
+            k = ((k >> rowBitInd) << (rowBitInd+1)) | (k & (rowBit-1));
+
+            // map the qubit's 2x2 block [[a,b],[c,d]] to its (I,X,Y,Z) coefficients
+            qcomp a = arr[k];
+            qcomp b = arr[k | colBit];
+            qcomp c = arr[k | rowBit];
+            qcomp d = arr[k | colBit | rowBit];
+            arr[k]                   = (qreal) 0.5 * (a + d);
+            arr[k | colBit]          = (qreal) 0.5 * (b + c);
+            arr[k | rowBit]          = (qreal) 0.5 * iunit * (b - c);
+            arr[k | colBit | rowBit] = (qreal) 0.5 * (a - d);
+        }
+    }
+}
+
+
+
+/*
+ * Pauli expression evaluation
+ */
+
+int local_getNumPauliStrWords(int numQubits) {
+    return (numQubits <= 0)? 1 : 1 + (numQubits - 1)/64;
+}
+
+std::vector<PauliTransferMap> local_loadPauliTransferMapsFromMMA(int numQubits) {
+
+    // must load all MMA args before validation
+    int *mapTargs, *numTargsPerMap, *numOutsPerIn, *outInds;
+    int numMapTargs, numMaps, numIns, numOuts;
+    qreal* outCoeffs;
+    WSGetInteger32List(stdlink, &mapTargs, &numMapTargs);
+    WSGetInteger32List(stdlink, &numTargsPerMap, &numMaps);
+    WSGetInteger32List(stdlink, &numOutsPerIn, &numIns);
+    WSGetInteger32List(stdlink, &outInds, &numOuts);
+    WSGetQrealList(stdlink, &outCoeffs, &numOuts);
+
+    // unpack the flat lists into maps, deferring validation until all are released
+    std::vector<PauliTransferMap> maps(numMaps);
+    std::string errMsg = "";
+    int targInd = 0;
+    int inInd = 0;
+    int outInd = 0;
+
+    for (int m=0; m<numMaps && errMsg.empty(); m++) {
+        int numTargs = numTargsPerMap[m];
+        long numMapIns = 1L << (2*numTargs);
+
+        if (numTargs < 1 || numTargs > 15 || targInd + numTargs > numMapTargs || inInd + numMapIns > numIns) {
+            errMsg = "Internal error: the encoded Pauli transfer maps were malformed.";
+            break;
+        }
+
+        for (int t=0; t<numTargs; t++) {
+            int targ = mapTargs[targInd++];
+            if (targ < 0 || targ >= numQubits)
+                errMsg = "Invalid target qubit (" + std::to_string(targ) + ") of a Pauli transfer map upon "
+                    + std::to_string(numQubits) + " qubits.";
+            for (size_t u=0; u<maps[m].targs.size(); u++)
+                if (maps[m].targs[u] == targ)
+                    errMsg = "The target qubits of a Pauli transfer map were not unique.";
+            maps[m].targs.push_back(targ);
+        }
+
+        // row offsets are relative to this map's own arrays
+        int outBase = outInd;
+        maps[m].outStarts.push_back(0);
+        for (long i=0; i<numMapIns; i++) {
+            for (int o=0; o<numOutsPerIn[inInd] && outInd < numOuts; o++) {
+                if (outInds[outInd] < 0 || outInds[outInd] >= numMapIns)
+                    errMsg = "Internal error: the encoded Pauli transfer maps contained an invalid output Pauli index.";
+                maps[m].outInds.push_back(outInds[outInd]);
+                maps[m].outCoeffs.push_back(outCoeffs[outInd]);
+                outInd++;
+            }
+            maps[m].outStarts.push_back(outInd - outBase);
+            inInd++;
+        }
+    }
+
+    if (errMsg.empty() && (inInd != numIns || outInd != numOuts || targInd != numMapTargs))
+        errMsg = "Internal error: the encoded Pauli transfer maps were malformed.";
+
+    WSReleaseInteger32List(stdlink, mapTargs, numMapTargs);
+    WSReleaseInteger32List(stdlink, numTargsPerMap, numMaps);
+    WSReleaseInteger32List(stdlink, numOutsPerIn, numIns);
+    WSReleaseInteger32List(stdlink, outInds, numOuts);
+    WSReleaseQrealList(stdlink, outCoeffs, numOuts);
+
+    if (!errMsg.empty())
+        throw QuESTException("", errMsg); // throws
+
+    return maps;
+}
+
+PauliSum local_evalPauliExpression(
+    int numQubits, int* instrs, int numInstrs, int* paulis, int numPaulis,
+    qreal* scalarsRe, qreal* scalarsIm, int numScalars
+) {
+    int numWords = local_getNumPauliStrWords(numQubits);
+    std::vector<PauliSum> stack;
+
+    int pauliInd = 0;
+    int scalarInd = 0;
+
+    for (int i=0; i<numInstrs; i++) {
+        int opcode = instrs[2*i];
+        int arg = instrs[2*i+1];
+
+        // ops which consume operands must find enough on the stack
+        int numOperands = 0;
+        if (opcode == PAULI_EXPR_OPCODE_SUM || opcode == PAULI_EXPR_OPCODE_PROD)
+            numOperands = arg;
+        if (opcode == PAULI_EXPR_OPCODE_POW)
+            numOperands = 1;
+        if (opcode == PAULI_EXPR_OPCODE_COMM)
+            numOperands = 2;
+        if (numOperands < 0 || numOperands > (int) stack.size())
+            throw QuESTException("", "Internal error: the encoded Pauli expression was malformed."); // throws
+
+        switch (opcode) {
+
+            case PAULI_EXPR_OPCODE_PAULI : {
+                if (pauliInd >= numPaulis)
+                    throw QuESTException("", "Internal error: the encoded Pauli expression referred to a missing Pauli operator."); // throws
+
+                int code = paulis[2*pauliInd];
+                int targ = paulis[2*pauliInd+1];
+                pauliInd++;
+                if (targ < 0 || targ >= numQubits)
+                    throw QuESTException("", "Invalid target index (" + std::to_string(targ) +
+                        ") of Pauli operator in Pauli expression of " + std::to_string(numQubits) + " qubits."); // throws
+
+                PauliStr str(numWords);
+                str.setPauli(targ, (code == OPCODE_Id)? PAULI_I : code);
+                PauliSum sum(numWords);
+                sum.addTerm(str, 1);
+                stack.push_back(sum);
+                break;
+            }
+            case PAULI_EXPR_OPCODE_SCALAR : {
+                if (scalarInd >= numScalars)
+                    throw QuESTException("", "Internal error: the encoded Pauli expression referred to a missing scalar."); // throws
+
+                PauliSum sum(numWords);
+                sum.addTerm(PauliStr(numWords), qcomp(scalarsRe[scalarInd], scalarsIm[scalarInd]));
+                scalarInd++;
+                stack.push_back(sum);
+                break;
+            }
+            case PAULI_EXPR_OPCODE_SUM : {
+                PauliSum sum(numWords);
+                for (size_t s=stack.size()-arg; s<stack.size(); s++)
+                    sum.addSum(stack[s], 1);
+                stack.erase(stack.end() - arg, stack.end());
+                stack.push_back(sum);
+                break;
+            }
+            case PAULI_EXPR_OPCODE_PROD : {
+                PauliSum prod(numWords);
+                prod.addTerm(PauliStr(numWords), 1);
+                for (size_t s=stack.size()-arg; s<stack.size(); s++)
+                    prod = prod.getProduct(stack[s]);
+                stack.erase(stack.end() - arg, stack.end());
+                stack.push_back(prod);
+                break;
+            }
+            case PAULI_EXPR_OPCODE_POW : {
+                if (arg < 0)
+                    throw QuESTException("", "Pauli expressions can only be raised to non-negative integer powers."); // throws
+                stack.back() = stack.back().getPower(arg);
+                break;
+            }
+            case PAULI_EXPR_OPCODE_COMM : {
+                PauliSum comm = stack[stack.size()-2].getCommutator(stack.back());
+                stack.erase(stack.end() - 2, stack.end());
+                stack.push_back(comm);
+                break;
+            }
+            default:
+                throw QuESTException("", "Internal error: the encoded Pauli expression contained an unrecognised opcode (" +
+                    std::to_string(opcode) + ")."); // throws
+        }
+    }
+
+    if (stack.size() != 1)
+        throw QuESTException("", "Internal error: the encoded Pauli expression was malformed."); // throws
+
+    return stack.back();
+}
+
+
+
+/* propagates sum through each map in-turn, truncating as we go
+ * @throws QuESTException if the user aborts
+ */
+void local_applyPauliTransferMaps(PauliSum& sum, const std::vector<PauliTransferMap>& maps, int maxWeight, qreal minCoeff) {
+
+    for (size_t m=0; m<maps.size(); m++) {
+        local_throwExcepIfUserAborted(); // throws
+        sum = sum.getTransferMapped(maps[m], maxWeight);
+        sum.removeNegligibleTerms(minCoeff);
+    }
+}
+
+
+
+/*
+ * interfacing
+ */
+
+void internal_simplifyPaulis(int numQubits) {
+    const std::string apiFuncName = "SimplifyPaulis";
+
+    // must load all MMA args before validation (these must all later be freed)
+    int *instrs, *paulis;
+    int numInstrFlat, numPauliFlat;
+    qreal *scalarsRe, *scalarsIm;
+    int numScalars;
+    WSGetInteger32List(stdlink, &instrs, &numInstrFlat);
+    WSGetInteger32List(stdlink, &paulis, &numPauliFlat);
+    WSGetQrealList(stdlink, &scalarsRe, &numScalars);
+    WSGetQrealList(stdlink, &scalarsIm, &numScalars);
+
+    try {
+        PauliSum sum = local_evalPauliExpression(
+            numQubits, instrs, numInstrFlat/2, paulis, numPauliFlat/2,
+            scalarsRe, scalarsIm, numScalars); // throws
+
+        // discard terms which have exactly cancelled
+        sum.removeNegligibleTerms(0);
+        sum.sendToMMA();
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+
+    WSReleaseInteger32List(stdlink, instrs, numInstrFlat);
+    WSReleaseInteger32List(stdlink, paulis, numPauliFlat);
+    WSReleaseQrealList(stdlink, scalarsRe, numScalars);
+    WSReleaseQrealList(stdlink, scalarsIm, numScalars);
+}
+
+void internal_applyPauliTransferMaps(int numQubits, int maxWeight) {
+    const std::string apiFuncName = "ApplyPauliTransferMap";
+
+    // must load all MMA args before validation (these must all later be freed)
+    qreal minCoeff;
+    int *instrs, *paulis;
+    int numInstrFlat, numPauliFlat;
+    qreal *scalarsRe, *scalarsIm;
+    int numScalars;
+    WSGetQreal(stdlink, &minCoeff);
+    WSGetInteger32List(stdlink, &instrs, &numInstrFlat);
+    WSGetInteger32List(stdlink, &paulis, &numPauliFlat);
+    WSGetQrealList(stdlink, &scalarsRe, &numScalars);
+    WSGetQrealList(stdlink, &scalarsIm, &numScalars);
+
+    try {
+        std::vector<PauliTransferMap> maps = local_loadPauliTransferMapsFromMMA(numQubits); // throws
+
+        PauliSum sum = local_evalPauliExpression(
+            numQubits, instrs, numInstrFlat/2, paulis, numPauliFlat/2,
+            scalarsRe, scalarsIm, numScalars); // throws
+
+        local_applyPauliTransferMaps(sum, maps, maxWeight, minCoeff); // throws
+        sum.sendToMMA();
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower, err.message);
+    }
+
+    WSReleaseInteger32List(stdlink, instrs, numInstrFlat);
+    WSReleaseInteger32List(stdlink, paulis, numPauliFlat);
+    WSReleaseQrealList(stdlink, scalarsRe, numScalars);
+    WSReleaseQrealList(stdlink, scalarsIm, numScalars);
+}
+
+void internal_calcPauliTransferEval(int numQubits, int combineStrs, int maxWeight) {
+    const std::string apiFuncName = "CalcPauliTransferEval";
+
+    // must load all MMA args before validation (these must all later be freed)
+    qreal minCoeff;
+    int *instrs, *paulis;
+    int numInstrFlat, numPauliFlat;
+    qreal *scalarsRe, *scalarsIm;
+    int numScalars;
+    WSGetQreal(stdlink, &minCoeff);
+    WSGetInteger32List(stdlink, &instrs, &numInstrFlat);
+    WSGetInteger32List(stdlink, &paulis, &numPauliFlat);
+    WSGetQrealList(stdlink, &scalarsRe, &numScalars);
+    WSGetQrealList(stdlink, &scalarsIm, &numScalars);
+
+    try {
+        std::vector<PauliTransferMap> maps = local_loadPauliTransferMapsFromMMA(numQubits); // throws
+
+        PauliSum sum = local_evalPauliExpression(
+            numQubits, instrs, numInstrFlat/2, paulis, numPauliFlat/2,
+            scalarsRe, scalarsIm, numScalars); // throws
+
+        // stream each layer to the front-end as soon as it is computed, so that
+        // only the current layer is ever kept in memory
+        PauliTransferEvalLayer layer(sum);
+        layer.sendToMMA(numQubits);
+        int nextId = 1 + layer.getNumNodes();
+
+        for (size_t m=0; m<maps.size(); m++) {
+            local_throwExcepIfUserAborted(); // throws
+            layer = layer.getTransferMapped(maps[m], combineStrs, maxWeight, minCoeff, nextId);
+            layer.sendToMMA(numQubits);
+            nextId += layer.getNumNodes();
+        }
+
+        // return the total number of streamed layers
+        WSPutInteger(stdlink, 1 + maps.size());
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower, err.message);
+    }
+
+    WSReleaseInteger32List(stdlink, instrs, numInstrFlat);
+    WSReleaseInteger32List(stdlink, paulis, numPauliFlat);
+    WSReleaseQrealList(stdlink, scalarsRe, numScalars);
+    WSReleaseQrealList(stdlink, scalarsIm, numScalars);
+}
+
+void internal_applyCachedPauliTransferMaps(int numQubits, int maxWeight) {
+    const std::string apiFuncName = "ApplyPauliTransferMap";
+
+    // must load all MMA args before validation (these must all later be freed)
+    qreal minCoeff;
+    int *instrs, *paulis;
+    int numInstrFlat, numPauliFlat;
+    qreal *scalarsRe, *scalarsIm;
+    int numScalars;
+    int *gateKeyInds, *gateQubits, *numQubitsPerGate, *givenKeyInds;
+    int numGates, numGateQubits, numGiven;
+    WSGetQreal(stdlink, &minCoeff);
+    WSGetInteger32List(stdlink, &instrs, &numInstrFlat);
+    WSGetInteger32List(stdlink, &paulis, &numPauliFlat);
+    WSGetQrealList(stdlink, &scalarsRe, &numScalars);
+    WSGetQrealList(stdlink, &scalarsIm, &numScalars);
+    std::vector<std::string> keys = local_loadStringListFromMMA();
+    WSGetInteger32List(stdlink, &gateKeyInds, &numGates);
+    WSGetInteger32List(stdlink, &gateQubits, &numGateQubits);
+    WSGetInteger32List(stdlink, &numQubitsPerGate, &numGates);
+    WSGetInteger32List(stdlink, &givenKeyInds, &numGiven);
+
+    try {
+        // the maps given by the front-end (upon compacted targets) are those previously uncached
+        std::vector<PauliTransferMap> givenMaps = local_loadPauliTransferMapsFromMMA(numQubits); // throws
+        if ((int) givenMaps.size() != numGiven)
+            throw QuESTException("", "Internal error: the number of given Pauli transfer maps did not match their keys."); // throws
+
+        // collect every key's map, copying every cached map before any given map is added
+        // to the cache, since the adds may evict maps (found by the front-end's previous call)
+        int numKeys = keys.size();
+        std::vector<PauliTransferMap> keyMaps(numKeys);
+        std::vector<bool> isKeyGiven(numKeys, false);
+        for (int i=0; i<numGiven; i++) {
+            if (givenKeyInds[i] < 0 || givenKeyInds[i] >= numKeys)
+                throw QuESTException("", "Internal error: a given Pauli transfer map had an invalid key index."); // throws
+            isKeyGiven[givenKeyInds[i]] = true;
+        }
+        std::vector<int> uncachedKeyInds;
+        for (int k=0; k<numKeys; k++) {
+            if (isKeyGiven[k])
+                continue;
+            const PauliTransferMap* map = cachedPTMaps.get(keys[k]);
+            if (map == nullptr)
+                uncachedKeyInds.push_back(k);
+            else
+                keyMaps[k] = *map;
+        }
+        for (int i=0; i<numGiven; i++) {
+            cachedPTMaps.add(keys[givenKeyInds[i]], givenMaps[i]);
+            keyMaps[givenKeyInds[i]] = givenMaps[i];
+        }
+
+        // request the front-end compute any uncached maps, after which it will call again
+        if (!uncachedKeyInds.empty()) {
+            WSPutFunction(stdlink, "Missing", 2);
+            WSPutString(stdlink, "Uncached");
+            WSPutIntegerList(stdlink, uncachedKeyInds.data(), uncachedKeyInds.size());
+
+        } else {
+            // retarget each gate's map from its compacted qubits to the gate's qubits
+            std::vector<PauliTransferMap> maps(numGates);
+            int qubitInd = 0;
+            for (int g=0; g<numGates; g++) {
+                if (gateKeyInds[g] < 0 || gateKeyInds[g] >= numKeys || qubitInd + numQubitsPerGate[g] > numGateQubits)
+                    throw QuESTException("", "Internal error: the encoded gates were malformed."); // throws
+
+                maps[g] = keyMaps[gateKeyInds[g]];
+                for (size_t t=0; t<maps[g].targs.size(); t++) {
+                    int compTarg = maps[g].targs[t];
+                    if (compTarg >= numQubitsPerGate[g])
+                        throw QuESTException("", "Internal error: a cached Pauli transfer map targeted more qubits than its gate."); // throws
+                    maps[g].targs[t] = gateQubits[qubitInd + compTarg];
+                    if (maps[g].targs[t] < 0 || maps[g].targs[t] >= numQubits)
+                        throw QuESTException("", "Invalid target qubit (" + std::to_string(maps[g].targs[t]) + 
+                            ") of a gate upon " + std::to_string(numQubits) + " qubits."); // throws
+                }
+                qubitInd += numQubitsPerGate[g];
+            }
+
+            PauliSum sum = local_evalPauliExpression(
+                numQubits, instrs, numInstrFlat/2, paulis, numPauliFlat/2,
+                scalarsRe, scalarsIm, numScalars); // throws
+
+            local_applyPauliTransferMaps(sum, maps, maxWeight, minCoeff); // throws
+            sum.sendToMMA();
+        }
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFailOrAbortFromExcep(apiFuncName, err.thrower, err.message);
+    }
+
+    WSReleaseInteger32List(stdlink, instrs, numInstrFlat);
+    WSReleaseInteger32List(stdlink, paulis, numPauliFlat);
+    WSReleaseQrealList(stdlink, scalarsRe, numScalars);
+    WSReleaseQrealList(stdlink, scalarsIm, numScalars);
+    WSReleaseInteger32List(stdlink, gateKeyInds, numGates);
+    WSReleaseInteger32List(stdlink, gateQubits, numGateQubits);
+    WSReleaseInteger32List(stdlink, numQubitsPerGate, numGates);
+    WSReleaseInteger32List(stdlink, givenKeyInds, numGiven);
+}
+
+void internal_clearCachedPauliTransferMaps() {
+    cachedPTMaps.clear();
+    WSPutSymbol(stdlink, "Null");
+}
+
+void internal_getPauliStringFromMatrix(int numQubits) {
+    const std::string apiFuncName = "GetPauliString";
+
+    // must load all MMA args before validation (these must all later be freed)
+    qreal minCoeff;
+    qreal *matrRe, *matrIm;
+    int numElems;
+    WSGetQreal(stdlink, &minCoeff);
+    WSGetQrealList(stdlink, &matrRe, &numElems);
+    WSGetQrealList(stdlink, &matrIm, &numElems);
+
+    try {
+        // Pauli indices must fit within an int
+        if (numQubits < 1 || numQubits > 15)
+            throw QuESTException("", "Only matrices of between 1 and 15 qubits can be decomposed."); // throws
+        if (numElems != (1LL << (2*numQubits)))
+            throw QuESTException("", "Internal error: the matrix had an incorrect number of elements."); // throws
+
+        std::vector<qcomp> elems(numElems);
+        for (int i=0; i<numElems; i++)
+            elems[i] = qcomp(matrRe[i], matrIm[i]);
+
+        local_setPauliCoeffsFromMatrix(elems, numQubits);
+
+        // send only the non-negligible coefficients, alongside their Pauli index
+        std::vector<qreal> coeffsRe, coeffsIm;
+        std::vector<int> pauliInds;
+        for (int k=0; k<numElems; k++) {
+            if (std::abs(elems[k]) <= minCoeff)
+                continue;
+
+            int ind = 0;
+            for (int q=numQubits-1; q>=0; q--)
+                ind = 4*ind + 2*((k >> (numQubits + q)) & 1) + ((k >> q) & 1);
+
+            coeffsRe.push_back(real(elems[k]));
+            coeffsIm.push_back(imag(elems[k]));
+            pauliInds.push_back(ind);
+        }
+
+        WSPutFunction(stdlink, "List", 3);
+        WSPutQrealList(stdlink, coeffsRe.data(), coeffsRe.size());
+        WSPutQrealList(stdlink, coeffsIm.data(), coeffsIm.size());
+        WSPutIntegerList(stdlink, pauliInds.data(), pauliInds.size());
+
+    } catch (QuESTException& err) {
+        local_sendErrorAndFail(apiFuncName, err.message);
+    }
+
+    WSReleaseQrealList(stdlink, matrRe, numElems);
+    WSReleaseQrealList(stdlink, matrIm, numElems);
+}
@@ -0,0 +1,281 @@
+
+#ifndef PAULIS_H
+#define PAULIS_H
+
+#include "QuEST.h"
+#include "QuEST_complex.h"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include "utilities.hpp"
+
+
+
+/*
+ * Opcodes of the postfix instructions which encode a numerical Pauli
+ * expression, as produced by QuESTlink.m for SimplifyPaulis[].
+ */
+
+#define PAULI_EXPR_OPCODE_PAULI 0
+#define PAULI_EXPR_OPCODE_SCALAR 1
+#define PAULI_EXPR_OPCODE_SUM 2
+#define PAULI_EXPR_OPCODE_PROD 3
+#define PAULI_EXPR_OPCODE_POW 4
+#define PAULI_EXPR_OPCODE_COMM 5
+
+
+
+/** An unweighted tensor product of Pauli operators, stored as a pair of packed
+ * bitsets. A qubit is targeted by X when only its bit in xBits is set, by Z when
+ * only its bit in zBits is set, by Y when both are set, and otherwise by Id.
+ */
+class PauliStr {
+    public:
+
+        std::vector<unsigned long long> xBits;
+        std::vector<unsigned long long> zBits;
+
+        /** Construct the all-identity string of the given number of 64-qubit words.
+         */
+        PauliStr() {};
+        PauliStr(int numWords) : xBits(numWords, 0), zBits(numWords, 0) {};
+
+        int getNumWords() const { return (int) xBits.size(); };
+
+        /** Getter and setter of the Pauli upon a single qubit, using the codes of
+         * pauliOpType (0=I, 1=X, 2=Y, 3=Z).
+         * @precondition qubit < 64*getNumWords()
+         */
+        int getPauli(int qubit) const;
+        void setPauli(int qubit, int code);
+
+        /** Returns the number of non-identity Paulis in the string.
+         */
+        int getWeight() const;
+
+        /** Returns whether this string commutes with other (of equal size).
+         */
+        bool commutesWith(const PauliStr& other) const;
+
+        /** Modifies out to be the product (this * other), up to a phase factor i^p,
+         * where p in {0,1,2,3} is returned.
+         * @precondition other and out have the same number of words as this string
+         */
+        int multiply(const PauliStr& other, PauliStr& out) const;
+
+        bool operator==(const PauliStr& other) const {
+            return xBits == other.xBits && zBits == other.zBits;
+        };
+};
+
+struct PauliStrHasher {
+    size_t operator()(const PauliStr& str) const;
+};
+
+typedef std::unordered_map<PauliStr, qcomp, PauliStrHasher> PauliStrMap;
+
+
+
+/** A numerical Pauli transfer map upon a few target qubits, as produced by
+ * CalcPauliTransferMap[]. Each of the 4^numTargs basis Pauli strings upon targs
+ * (indexed in base 4, with the first target least significant) is mapped to a
+ * real-weighted sum of basis strings, stored in compressed-row form; the outputs
+ * of input i are at indices [outStarts[i], outStarts[i+1]) of outInds and outCoeffs.
+ */
+class PauliTransferMap {
+    public:
+
+        std::vector<int> targs;
+        std::vector<long> outStarts;
+        std::vector<int> outInds;
+        std::vector<qreal> outCoeffs;
+};
+
+
+
+/** A bounded cache of numerical Pauli transfer maps, keyed by a string which
+ * identifies the compacted gate (and map options) from which the front-end
+ * computed each map. When full, the least recently used map is discarded.
+ */
+class PauliTransferMapCache {
+    private:
+
+        size_t capacity;
+
+        /** The cached maps in order of most recent use, with an index thereinto.
+         */
+        std::list<std::pair<std::string, PauliTransferMap>> maps;
+        std::unordered_map<std::string, std::list<std::pair<std::string, PauliTransferMap>>::iterator> inds;
+
+    public:
+
+        PauliTransferMapCache(size_t capacity) : capacity(capacity) {};
+
+        size_t getNumMaps() const { return maps.size(); };
+
+        /** Returns the map of the given key (marking it as most recently used),
+         * or nullptr if uncached. The pointer is invalidated by a subsequent add().
+         */
+        const PauliTransferMap* get(const std::string& key);
+
+        /** Caches map under key, replacing any existing map of that key, and
+         * discarding the least recently used map if the cache is full.
+         */
+        void add(const std::string& key, const PauliTransferMap& map);
+
+        void clear();
+};
+
+
+
+/** A weighted sum of unique Pauli strings, each with a complex coefficient.
+ * All strings within a sum have the same number of words, fixed at construction.
+ */
+class PauliSum {
+    private:
+
+        int numWords;
+
+        PauliStrMap terms;
+
+        /** Returns the product (this * other), or the commutator [this, other]
+         * for which only the products of anticommuting pairs of terms are computed.
+         * Uses multithreading when the sums are large.
+         */
+        PauliSum getProductOrCommutator(const PauliSum& other, bool commutator) const;
+
+    public:
+
+        PauliSum(int numWords) : numWords(numWords) {};
+
+        /** Getters
+         */
+        int getNumWords() const { return numWords; };
+        size_t getNumTerms() const { return terms.size(); };
+        const PauliStrMap& getTerms() const { return terms; };
+
+        /** Adds coeff*str to the sum, combining it with any identical string.
+         */
+        void addTerm(const PauliStr& str, qcomp coeff);
+
+        /** Adds fac*other to this sum.
+         */
+        void addSum(const PauliSum& other, qcomp fac);
+
+        /** Multiplies every coefficient by fac.
+         */
+        void scale(qcomp fac);
+
+        /** Returns the product (this * other), in that order.
+         */
+        PauliSum getProduct(const PauliSum& other) const;
+
+        /** Returns the commutator (this * other - other * this).
+         */
+        PauliSum getCommutator(const PauliSum& other) const;
+
+        /** Returns this sum raised to the given non-negative integer power, via
+         * repeated squaring. The zeroth power is the identity.
+         */
+        PauliSum getPower(int exponent) const;
+
+        /** Returns the sum produced by the action of map upon every term. Output
+         * strings with more than maxWeight non-identity Paulis are discarded, unless
+         * maxWeight is negative. Uses multithreading when the sum is large.
+         * @precondition the map targets lie within the strings
+         */
+        PauliSum getTransferMapped(const PauliTransferMap& map, int maxWeight) const;
+
+        /** Removes all terms with coefficient magnitudes not exceeding tol.
+         */
+        void removeNegligibleTerms(qreal tol);
+
+        /** Sends the sum to Mathematica as List[coeffsRe, coeffsIm, codes, targs,
+         * numPaulisPerTerm], where identity Paulis are excluded from codes, such
+         * that the all-identity string has zero Paulis.
+         */
+        void sendToMMA() const;
+};
+
+/** A single layer of the evaluation graph of a Pauli string under a sequence of
+ * Pauli transfer maps, as output by CalcPauliTransferEval[]. Node n has Pauli
+ * string strs[n], coefficient coeffs[n] and unique id ids[n]. Its parents (nodes
+ * of the previous layer) are stored in compressed-row form; the ids of the parents
+ * of node n, and the factors the map multiplied upon them, are at indices
+ * [parentStarts[n], parentStarts[n+1]) of parentIds and parentFactors.
+ */
+class PauliTransferEvalLayer {
+    public:
+
+        std::vector<PauliStr> strs;
+        std::vector<qcomp> coeffs;
+        std::vector<int> ids;
+        std::vector<long> parentStarts;
+        std::vector<int> parentIds;
+        std::vector<qcomp> parentFactors;
+
+        /** Construct an empty layer, or the initial layer of an evaluation graph,
+         * wherein each term of sum is a node with ids (from 1) and a single parent
+         * of id 0 (with the term coefficient as its factor).
+         */
+        PauliTransferEvalLayer() {};
+        PauliTransferEvalLayer(const PauliSum& sum);
+
+        size_t getNumNodes() const { return strs.size(); };
+
+        /** Returns the layer produced by the action of map upon every node. When
+         * combineStrs, nodes of identical Pauli strings are merged into one with
+         * multiple parents. Nodes with more than maxWeight non-identity Paulis
+         * (unless maxWeight is negative), or with coefficient magnitudes not
+         * exceeding a positive minCoeff, are pruned. The new nodes receive
+         * contiguous ids starting from firstId.
+         * @precondition the map targets lie within the strings
+         */
+        PauliTransferEvalLayer getTransferMapped(
+            const PauliTransferMap& map, bool combineStrs, int maxWeight, qreal minCoeff, int firstId) const;
+
+        /** Sends the layer to Mathematica as the arguments of an EvaluatePacket call
+         * to the function PT_EVAL_LAYER_FUNC, as numQubits, digits, ids,
+         * numParentsPerNode, parentIds, factorsRe, factorsIm. Each node's Pauli
+         * string is flattened into digits (0=I, 1=X, 2=Y, 3=Z) with the highest
+         * qubit first, like GetPauliStringReformatted[].
+         */
+        void sendToMMA(int numQubits) const;
+};
+
+/** Overwrites the flattened (row-major) elements of a 2^numQubits square matrix
+ * with its coefficients in the Pauli basis, via an in-place butterfly transform of
+ * each qubit, in O(numQubits 4^numQubits) time. The coefficient of the Pauli
+ * string with base-4 digit p_q upon qubit q is written to the element at row bits
+ * (p_q / 2) and column bits (p_q % 2). Uses multithreading.
+ */
+void local_setPauliCoeffsFromMatrix(std::vector<qcomp>& elems, int numQubits);
+
+/** Returns the number of 64-bit words needed to store Pauli strings of numQubits.
+ */
+int local_getNumPauliStrWords(int numQubits);
+
+/** Loads a list of Pauli transfer maps from MMA, as encoded by QuESTlink.m, via
+ * the lists mapTargs, numTargsPerMap, numOutsPerIn, outInds and outCoeffs.
+ * @throws QuESTException if the maps are incompatible with numQubits, though
+ *      only after all lists have been loaded and released
+ */
+std::vector<PauliTransferMap> local_loadPauliTransferMapsFromMMA(int numQubits); // throws
+
+/** Evaluates the postfix program of a numerical Pauli expression, as encoded by
+ * QuESTlink.m, returning the resulting simplified sum.
+ * @param instrs flat list of (opcode, arg) pairs
+ * @param paulis flat list of (opcode, target) pairs, consumed by OPCODE_PAULI
+ * @param scalarsRe/Im scalars consumed by OPCODE_SCALAR
+ * @throws QuESTException if the program is malformed
+ */
+PauliSum local_evalPauliExpression(
+    int numQubits, int* instrs, int numInstrs, int* paulis, int numPaulis,
+    qreal* scalarsRe, qreal* scalarsIm, int numScalars); // throws
+
+
+
+#endif // PAULIS_H
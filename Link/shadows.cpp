@@ -0,0 +1,413 @@
+/** @file
+ * Contains a native store of classical shadows, encoded as bitmasks, against
+ * which the expected values of many Pauli products can be queried without the
+ * shadow being re-sent, re-validated nor re-encoded.
+ *
+ * @author Tyson Jones
+ */
+
+#include "wstp.h"
+#include "QuEST.h"
+
+#include "shadows.hpp"
+#include "errors.hpp"
+#include "utilities.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+
+
+/*
+ * The minimum number of Pauli products sharing a support, before the classical
+ * shadow samples are indexed by their bases upon that support
+ */
+#define MIN_NUM_PRODS_FOR_SHADOW_INDEX 2
+
+/*
+ * Hashes the bit-planes of a shadow sample's bases projected onto a support
+ */
+struct ShadowBasisHasher {
+    size_t operator()(const std::vector<unsigned long long>& key) const {
+        size_t hash = 0;
+        for (size_t i=0; i<key.size(); i++)
+            hash ^= std::hash<unsigned long long>()(key[i]) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+
+
+/*
+ * CLASSICAL SHADOW
+ */
+
+ClassicalShadow::ClassicalShadow(int numQubits) :
+    numQubits(numQubits), numWords(1 + (numQubits - 1)/64), numSamples(0) {}
+
+void ClassicalShadow::addSamples(int* sampleBases, int* sampleOutcomes, long numNewSamples) {
+
+    // local copies of attributes, for OpenMP
+    int numQb = numQubits;
+    int words = numWords;
+    
+    // parallel validate the shadow sample bases and outcomes, in time O(numNewSamples*numQb),
+    // avoiding breaking out of OpenMP loops
+    volatile bool invalid = false;
+    std::string errMsg = "";
+    unsigned long long k, numTotalSampVals = numNewSamples * (unsigned long long) numQb;
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (invalid,errMsg, numTotalSampVals, sampleBases,sampleOutcomes) \
+    private  (k)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (k=0; k<numTotalSampVals; k++) {
+
+            if (invalid)
+                continue;
+
+            if (sampleBases[k] < 1 || sampleBases[k] > 3) {
+                errMsg = "A shadow sample contained an invalid Pauli measurement basis code (" +
+                    std::to_string(sampleBases[k]) + "). Each Pauli measurement basis code must be an integer " +
+                    "1, 2, 3, corresponding to the X, Y, Z bases respectively.";
+                invalid = true;
+            }
+
+            if (sampleOutcomes[k] < 0 || sampleOutcomes[k] > 1) {
+                errMsg = "A shadow sample contained an invalid qubit measurement outcome (" +
+                    std::to_string(sampleOutcomes[k]) + "). Measurement outcomes must be 0 or 1.";
+                invalid = true;
+            }
+        }
+    }
+
+    if (invalid)
+        throw QuESTException("", errMsg); // throws
+
+    // make space for the new samples
+    long firstSample = numSamples;
+    numSamples += numNewSamples;
+    baseLoBitseqs.resize(numSamples * numWords, 0);
+    baseHiBitseqs.resize(numSamples * numWords, 0);
+    outcomeBitseqs.resize(numSamples * numWords, 0);
+
+    // parallel encode shadow bases and outcomes into bit-planes, in time O(numNewSamples*numQb)
+    unsigned long long *baseLo=baseLoBitseqs.data(), *baseHi=baseHiBitseqs.data(), *outs=outcomeBitseqs.data();
+    int q, w;
+    long s, offset, ind;
+    unsigned long long bit;
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (numNewSamples,firstSample,numQb,words,sampleBases,sampleOutcomes, baseLo,baseHi,outs) \
+    private  (s,offset,q,ind,bit,w)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (s=0; s<numNewSamples; s++) {
+
+            offset = (firstSample + s)*words;
+
+            for (q=0; q<numQb; q++) {
+                ind = numQb*s + q;
+                w = q / 64;
+                bit = 1ULL << (q % 64);
+
+                if (sampleBases[ind] & 1)
+                    baseLo[offset+w] |= bit;
+                if (sampleBases[ind] & 2)
+                    baseHi[offset+w] |= bit;
+                if (sampleOutcomes[ind])
+                    outs[offset+w] |= bit;
+            }
+        }
+    }
+}
+
+std::vector<qreal> ClassicalShadow::calcExpecPauliProds(
+    int* pauliCodes, int* pauliTargs, int* numPaulisPerProd, long numProds, int numBatches
+) const {
+    // The product arrays are total size O(numProds*numQb), permitting creation
+    // of temporary vectors with negligible memory overhead. Each product is
+    // encoded like the samples, with a mask of its non-identity targets
+    std::vector<qreal> prodExpecVals(numProds);
+    if (numProds == 0)
+        return prodExpecVals;
+
+    // local copies of attributes, for OpenMP
+    int numQb = numQubits;
+    int numWords = this->numWords;
+    long numSamples = this->numSamples;
+    
+    std::vector<long> pauliIndOffset(numProds);
+    std::vector<unsigned long long> pauliLoBitseqs(numProds * numWords);
+    std::vector<unsigned long long> pauliHiBitseqs(numProds * numWords);
+    std::vector<unsigned long long> pauliTargBitseqs(numProds * numWords);
+    std::vector<int> pauliWeights(numProds);
+
+    // serially prepare starting indices of each pauli product, in time O(numProds)
+    pauliIndOffset[0] = 0;
+    for (long i=1; i<numProds; i++)
+        pauliIndOffset[i] = pauliIndOffset[i-1] + numPaulisPerProd[i-1];
+
+    // parallel validate the Pauli products, in time O(numProds*prodSize) << O(numProds*numQb),
+    // avoiding breaking out of OpenMP loops
+    volatile bool invalid = false;
+    std::string errMsg = "";
+    unsigned long long k, numTotalPaulis;
+    numTotalPaulis = pauliIndOffset[numProds-1] + numPaulisPerProd[numProds-1];
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (invalid,errMsg, numTotalPaulis, pauliCodes,pauliTargs, numQb) \
+    private  (k)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (k=0; k<numTotalPaulis; k++) {
+
+            if (invalid)
+                continue;
+
+            if (pauliCodes[k] < 0 || pauliCodes[k] > 3) {
+                errMsg = "A Pauli product contained an invalid Pauli operator code (" +
+                    std::to_string(pauliCodes[k]) + "). Each Pauli operator code must be an integer " +
+                    "0, 1, 2, 3, corresponding to Pauli operators Id, X, Y, Z respectively.";
+                invalid = true;
+            }
+
+            if (pauliTargs[k] < 0 || pauliTargs[k] >= numQb) {
+                errMsg = "A Pauli product targeted an invalid qubit (" +
+                    std::to_string(pauliTargs[k]) + "). Note that the number of qubits in " +
+                    "the shadow was inferred to be " + std::to_string(numQb) + ".";
+                invalid = true;
+            }
+        }
+    }
+
+    if (invalid)
+        throw QuESTException("", errMsg); // throws
+
+    // parallel encode paulis as bit-planes, and their targets as bit masks, in
+    // time O(numProds*prodSize) << O(numProds*numQb). Identity operators target
+    // no qubit, since they match every basis.
+    int p, w, weight;
+    long i, j, offset;
+    unsigned long long bit;
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (numProds,numWords,numPaulisPerProd,pauliIndOffset,pauliCodes,pauliTargs, \
+              pauliLoBitseqs,pauliHiBitseqs,pauliTargBitseqs,pauliWeights) \
+    private  (i,j,p,w,weight,offset,bit)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (i=0L; i<numProds; i++) {
+
+            offset = i*numWords;
+            weight = 0;
+
+            for (p=0; p<numPaulisPerProd[i]; p++) {
+                j = pauliIndOffset[i] + p;
+                if (pauliCodes[j] == 0)
+                    continue;
+
+                w = pauliTargs[j] / 64;
+                bit = 1ULL << (pauliTargs[j] % 64);
+
+                // repeated targets are not additionally weighted
+                if (!(pauliTargBitseqs[offset+w] & bit))
+                    weight++;
+
+                pauliTargBitseqs[offset+w] |= bit;
+                if (pauliCodes[j] & 1)
+                    pauliLoBitseqs[offset+w] |= bit;
+                if (pauliCodes[j] & 2)
+                    pauliHiBitseqs[offset+w] |= bit;
+            }
+
+            pauliWeights[i] = weight;
+        }
+    }
+
+    // group the products by their support, so that those of a common support can share an index
+    std::vector<long> prodOrder(numProds);
+    for (i=0; i<numProds; i++)
+        prodOrder[i] = i;
+    unsigned long long* prodTargs = pauliTargBitseqs.data();
+    std::sort(prodOrder.begin(), prodOrder.end(), [prodTargs, numWords](long a, long b) {
+        return std::lexicographical_compare(
+            prodTargs + a*numWords, prodTargs + (a+1)*numWords,
+            prodTargs + b*numWords, prodTargs + (b+1)*numWords); });
+    std::vector<long> groupStarts;
+    for (i=0; i<numProds; i++)
+        if (i == 0 || !std::equal(
+                prodTargs + prodOrder[i]*numWords, prodTargs + (prodOrder[i]+1)*numWords,
+                prodTargs + prodOrder[i-1]*numWords))
+            groupStarts.push_back(i);
+    groupStarts.push_back(numProds);
+    long numGroups = groupStarts.size() - 1;
+
+    // samples are divided into near-equal contiguous batches, where numBatches expected << 100
+    std::vector<long> batchSizes(numBatches, 0);
+    for (long s=0; s<numSamples; s++)
+        batchSizes[(s * numBatches) / numSamples]++;
+
+    // parallel evaluate the (unnormalised) contribution of each batch to each product, in time
+    // O(numGroups*numSamples*numWords + numMatches), populating prodBatchSums
+    std::vector<long> prodBatchSums(numProds * numBatches, 0);
+    long* sums = prodBatchSums.data();
+    const unsigned long long *baseLo=baseLoBitseqs.data(), *baseHi=baseHiBitseqs.data(), *outs=outcomeBitseqs.data();
+    unsigned long long *prodLo=pauliLoBitseqs.data(), *prodHi=pauliHiBitseqs.data();
+    long g, n, s, groupSize, prodOffset, sampOffset; // re-using p, i, w
+    int par;
+    unsigned long long mismatch;
+    long* order = prodOrder.data();
+    long* starts = groupStarts.data();
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (numGroups,starts,order,numSamples,numBatches,numWords, \
+              baseLo,baseHi,outs, prodLo,prodHi,prodTargs, sums) \
+    private  (g,n,p,i,s,w, groupSize,prodOffset,sampOffset, par,mismatch)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (dynamic)
+# endif
+        for (g=0; g<numGroups; g++) {
+            groupSize = starts[g+1] - starts[g];
+
+            // a lone product scans every sample for a match, without branching
+            if (groupSize < MIN_NUM_PRODS_FOR_SHADOW_INDEX) {
+                for (n=starts[g]; n<starts[g+1]; n++) {
+                    p = order[n];
+                    prodOffset = p*numWords;
+
+                    for (s=0; s<numSamples; s++) {
+                        sampOffset = s*numWords;
+
+                        // a sample matches the product when their bases agree upon every targeted
+                        // qubit, in which case it contributes the parity of the targeted outcomes
+                        mismatch = 0;
+                        par = 0;
+                        for (w=0; w<numWords; w++) {
+                            mismatch |= ((baseLo[sampOffset+w] ^ prodLo[prodOffset+w]) |
+                                         (baseHi[sampOffset+w] ^ prodHi[prodOffset+w])) & prodTargs[prodOffset+w];
+                            par += local_popcount(outs[sampOffset+w] & prodTargs[prodOffset+w]);
+                        }
+                        sums[p*numBatches + (s * numBatches) / numSamples] += (mismatch == 0) * (1 - 2*(par & 1));
+                    }
+                }
+                continue;
+            }
+
+            // otherwise index the samples by their bases projected onto the common support,
+            // so that each product visits only its matching samples
+            unsigned long long* supp = &prodTargs[order[starts[g]] * numWords];
+            std::unordered_map<std::vector<unsigned long long>, std::vector<long>, ShadowBasisHasher> index;
+            std::vector<unsigned long long> key(2*numWords);
+
+            for (s=0; s<numSamples; s++) {
+                sampOffset = s*numWords;
+                for (w=0; w<numWords; w++) {
+                    key[2*w]   = baseLo[sampOffset+w] & supp[w];
+                    key[2*w+1] = baseHi[sampOffset+w] & supp[w];
+                }
+                index[key].push_back(s);
+            }
+
+            for (n=starts[g]; n<starts[g+1]; n++) {
+                p = order[n];
+                prodOffset = p*numWords;
+                for (w=0; w<numWords; w++) {
+                    key[2*w]   = prodLo[prodOffset+w];
+                    key[2*w+1] = prodHi[prodOffset+w];
+                }
+
+                auto found = index.find(key);
+                if (found == index.end())
+                    continue;
+
+                for (long m : found->second) {
+                    sampOffset = m*numWords;
+                    par = 0;
+                    for (w=0; w<numWords; w++)
+                        par += local_popcount(outs[sampOffset+w] & supp[w]);
+                    sums[p*numBatches + (m * numBatches) / numSamples] += 1 - 2*(par & 1);
+                }
+            }
+        }
+    }
+
+    // parallel choose the median of each product's batch values
+    qreal fac;
+    qreal* expecVals = prodExpecVals.data();
+    long* sizes = batchSizes.data();
+    std::vector<qreal> batchVals(numBatches); // thread-private
+# ifdef _OPENMP
+# pragma omp parallel \
+    default  (none) \
+    shared   (numProds,numBatches, pauliWeights, sums,sizes, expecVals) \
+    private  (p,i, fac) \
+    firstprivate (batchVals)
+# endif
+    {
+# ifdef _OPENMP
+# pragma omp for schedule (static)
+# endif
+        for (p=0; p<numProds; p++) {
+            for (i=0; i<numBatches; i++)
+                batchVals[i] = sums[p*numBatches + i] / (qreal) sizes[i];
+
+            fac = pow(3, pauliWeights[p]);
+            std::sort(batchVals.begin(), batchVals.end());
+            if (numBatches % 2)
+                expecVals[p] = fac * batchVals[numBatches/2];
+            else
+                expecVals[p] = fac * .5 * (batchVals[numBatches/2 - 1] + batchVals[numBatches/2]);
+        }
+    }
+
+    return prodExpecVals;
+}
+
+void ClassicalShadow::sendToMMA() const {
+
+    // decode the bit-planes into flat lists of codes and outcomes
+    long long int len = numSamples * (long long int) numQubits;
+    std::vector<int> sampleBases(len);
+    std::vector<int> sampleOutcomes(len);
+
+    for (long s=0; s<numSamples; s++) {
+        for (int q=0; q<numQubits; q++) {
+            long offset = s*numWords + q/64;
+            int shift = q % 64;
+            long long int ind = s*(long long int) numQubits + q;
+
+            sampleBases[ind] =
+                     ((baseLoBitseqs[offset] >> shift) & 1) +
+                2 * ((baseHiBitseqs[offset] >> shift) & 1);
+            sampleOutcomes[ind] = (outcomeBitseqs[offset] >> shift) & 1;
+        }
+    }
+
+    WSPutFunction(stdlink, "List", 3);
+    WSPutInteger(stdlink, numQubits);
+    WSPutIntegerList(stdlink, sampleBases.data(), len);
+    WSPutIntegerList(stdlink, sampleOutcomes.data(), len);
+}
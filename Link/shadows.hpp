@@ -0,0 +1,73 @@
+
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include "QuEST.h"
+
+#include <vector>
+
+
+
+/** A classical shadow of a fixed number of qubits; a sequence of samples, each
+ * of which is a Pauli measurement basis (X=1, Y=2, Z=3) and a measurement outcome
+ * (0 or 1) per qubit. Samples are stored validated and encoded, with each basis
+ * as two bit-planes of its codes' low and high bits (so that X, Y, Z occupy bits
+ * (1,0), (0,1), (1,1)), and each outcome as a bitmask, all with one word per 64
+ * qubits. This permits asymptotically faster shadow processing, as suggested by
+ * Balint Koczor, and a persistent shadow to be queried without re-encoding.
+ */
+class ClassicalShadow {
+    private:
+
+        int numQubits;
+        int numWords;
+        long numSamples;
+
+        /** The bit-planes of sample s occupy indices [s*numWords, (s+1)*numWords)
+         */
+        std::vector<unsigned long long> baseLoBitseqs;
+        std::vector<unsigned long long> baseHiBitseqs;
+        std::vector<unsigned long long> outcomeBitseqs;
+
+    public:
+
+        /** Construct an empty shadow of the given (positive) number of qubits.
+         */
+        ClassicalShadow(int numQubits);
+
+        /** Getters
+         */
+        int getNumQubits() const { return numQubits; };
+        long getNumSamples() const { return numSamples; };
+
+        /** Validates and appends numNewSamples samples, where the basis codes
+         * and outcomes of sample s upon qubit q are at index s*numQubits + q
+         * of sampleBases and sampleOutcomes. Uses multithreading.
+         * @throws QuESTException if any code or outcome is invalid, without
+         *      modifying the shadow
+         */
+        void addSamples(int* sampleBases, int* sampleOutcomes, long numNewSamples); // throws
+
+        /** Returns the expected value of each given Pauli product, as prescribed
+         * by the shadow. The samples are divided into numBatches near-equal
+         * contiguous batches, and the median of the batch estimates is returned.
+         * Products of a common support share an index of the samples by their
+         * projected bases, so that each product visits only its matching samples.
+         * Uses multithreading.
+         * @precondition 1 <= numBatches <= getNumSamples()
+         * @throws QuESTException if any product contains an invalid Pauli code or
+         *      targets a qubit outside the shadow
+         */
+        std::vector<qreal> calcExpecPauliProds(
+            int* pauliCodes, int* pauliTargs, int* numPaulisPerProd, long numProds, int numBatches) const; // throws
+
+        /** Sends the shadow to Mathematica as List[numQubits, sampleBases,
+         * sampleOutcomes], where the latter are flat lists of the per-qubit
+         * codes and outcomes of every sample, in the format of addSamples().
+         */
+        void sendToMMA() const;
+};
+
+
+
+#endif // SHADOWS_H
@@ -215,6 +215,33 @@
 :End:
 :Evaluate: QuEST`Private`SetAmpInternal::usage = "SetAmpInternal[qureg, ampRe, ampIm, row, col] modifies the amplitude with index [row] in a statevector qureg, or index [row][col] of a density matrix, to amplitude (ampRe + i*ampIm)."
 
+:Begin:
+:Function:       internal_getAmps
+:Pattern:        QuEST`Private`GetAmpsInternal[qureg_Integer, rows_List, cols_List]
+:Arguments:      { qureg, rows, cols }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetAmpsInternal::usage = "GetAmpsInternal[qureg, rows, cols] returns a {numAmps, 2} real array of the {re, im} components of the amplitudes with the given indices [row] in a statevector qureg (where cols is empty), or indices [row][col] of a density matrix."
+
+:Begin:
+:Function:       internal_setAmps
+:Pattern:        QuEST`Private`SetAmpsInternal[qureg_Integer, rows_List, cols_List, ampsRe_List, ampsIm_List]
+:Arguments:      { qureg, rows, cols, ampsRe, ampsIm }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`SetAmpsInternal::usage = "SetAmpsInternal[qureg, rows, cols, ampsRe, ampsIm] modifies the amplitudes with the given indices [row] in a statevector qureg (where cols is empty), or indices [row][col] of a density matrix, to amplitudes (ampsRe + i*ampsIm). Runs of consecutive indices are set together."
+
+:Begin:
+:Function:       internal_getTopAmplitudes
+:Pattern:        QuEST`Private`GetTopAmplitudesInternal[qureg_Integer, maxNumAmps_Integer, minProb_Real]
+:Arguments:      { qureg, maxNumAmps, minProb }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetTopAmplitudesInternal::usage = "GetTopAmplitudesInternal[qureg, maxNumAmps, minProb] returns {indices, amps} (where amps is a {numAmps, 2} real array of {re, im} components) of the (at most maxNumAmps, or unlimited when -1) most probable amplitudes with probability at least minProb, in order of decreasing probability. For density matrices, the diagonal is considered, and the row indices returned."
+
 
 :Begin:
 :Function:       callable_isDensityMatrix
@@ -292,10 +319,28 @@
 :ReturnType:     Manual
 :End:
 :Evaluate: 
-    QuEST`CalcProbOfAllOutcomes::usage = "CalcProbOfAllOutcomes[qureg, qubits] returns the probabilities of every classical substate of the given list of qubits. The probabilities are ordered by their corresponding classical value (increasing), assuming qubits is given least to most significant.";
+    QuEST`CalcProbOfAllOutcomes::usage = "CalcProbOfAllOutcomes[qureg, qubits] returns the probabilities of every classical substate of the given list of qubits. The probabilities are ordered by their corresponding classical value (increasing), assuming qubits is given least to most significant.\nCalcProbOfAllOutcomes[qureg, {qubits1, qubits2, ...}] returns a list of the probabilities of every classical substate of each given list of qubits, computed together in a single pass over the qureg.";
     QuEST`CalcProbOfAllOutcomes::error = "`1`";
     QuEST`CalcProbOfAllOutcomes[___] := QuEST`Private`invalidArgError[CalcProbOfAllOutcomes];
 
+:Begin:
+:Function:       internal_calcProbOfAllOutcomesOfSubsets
+:Pattern:        QuEST`Private`CalcProbOfAllOutcomesOfSubsetsInternal[qureg_Integer, subsetQubits_List, numQubitsPerSubset_List]
+:Arguments:      { qureg, subsetQubits, numQubitsPerSubset }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CalcProbOfAllOutcomesOfSubsetsInternal::usage = "CalcProbOfAllOutcomesOfSubsetsInternal[qureg, subsetQubits, numQubitsPerSubset] returns the concatenated outcome probabilities of every subset of qubits (given flattened), computed in a single pass over the qureg."
+
+:Begin:
+:Function:       internal_calcReducedDensityMatrix
+:Pattern:        QuEST`Private`CalcReducedDensityMatrixInternal[qureg_Integer, createQureg_Integer, keptQubits_List]
+:Arguments:      { qureg, createQureg, keptQubits }
+:ArgumentTypes:  { Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CalcReducedDensityMatrixInternal::usage = "CalcReducedDensityMatrixInternal[qureg, createQureg, keptQubits] computes the reduced density matrix of the kept qubits, returning {numKept, elems} where elems is a {dim, dim, 2} real array of the {re, im} components of its transpose, or (if createQureg=1) the id of a new density qureg populated with it."
+
 :Begin:
 :Function:       wrapper_calcFidelity
 :Pattern:        QuEST`CalcFidelity[qureg1_Integer, qureg2_Integer]
@@ -370,39 +415,39 @@
 
 :Begin:
 :Function:       internal_applyCircuitDerivs
-:Pattern:        QuEST`Private`ApplyCircuitDerivsInternal[initStateId_Integer, workspaceId_Integer, quregIds_List, opcodes_List, ctrls_List, numCtrlsPerOp_List, targs_List, numTargsPerOp_List, params_List, numParamsPerOp_List, derivOpInds_List, derivVarInds_List, derivParams_List, numDerivParamsPerDerivOp_List]
-:Arguments:      { initStateId, workspaceId, quregIds, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp }
+:Pattern:        QuEST`Private`ApplyCircuitDerivsInternal[initStateId_Integer, workspaceId_Integer, quregIds_List, circuit_List, derivTerms_List]
+:Arguments:      { initStateId, workspaceId, quregIds, circuit, derivTerms }
 :ArgumentTypes:  { Integer, Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`ApplyCircuitDerivsInternal::usage = "ApplyCircuitDerivsInternal[initStateId, workspaceId, quregIds, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp] accepts a circuit (complete with rotation angles) and a nominated set of gates (by indices), sets each qureg to be the result of applying the derivative of the circuit w.r.t the nominated gates, upon the initial state. workspaceId = -1 will force internal temporary workspace creation."
+:Evaluate: QuEST`Private`ApplyCircuitDerivsInternal::usage = "ApplyCircuitDerivsInternal[initStateId, workspaceId, quregIds, circuit, derivTerms] accepts a circuit (complete with rotation angles) and a nominated set of gates (by indices), sets each qureg to be the result of applying the derivative of the circuit w.r.t the nominated gates, upon the initial state. workspaceId = -1 will force internal temporary workspace creation."
 
 :Begin:
 :Function:       internal_calcExpecPauliStringDerivs
-:Pattern:        QuEST`Private`CalcExpecPauliStringDerivsInternal[initStateId_Integer, workspaces_List, opcodes_List, ctrls_List, numCtrlsPerOp_List, targs_List, numTargsPerOp_List, params_List, numParamsPerOp_List, derivOpInds_List, derivVarInds_List, derivParams_List, numDerivParamsPerDerivOp_List, termCoeffs_List, allPauliCodes_List, allPauliTargets_List, numPaulisPerTerm_List]
-:Arguments:      { initStateId, workspaces, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm }
+:Pattern:        QuEST`Private`CalcExpecPauliStringDerivsInternal[initStateId_Integer, workspaces_List, circuit_List, derivTerms_List, termCoeffs_List, allPauliCodes_List, allPauliTargets_List, numPaulisPerTerm_List]
+:Arguments:      { initStateId, workspaces, circuit, derivTerms, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm }
 :ArgumentTypes:  { Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcExpecPauliStringDerivsInternal::usage = "CalcExpecPauliStringDerivsInternal[initStateId, workspaces, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] accepts a circuit (complete with rotation angles), a derivative specification, and a Hamiltonian, and returns the energy gradient. workspaces can be a list of any length"
+:Evaluate: QuEST`Private`CalcExpecPauliStringDerivsInternal::usage = "CalcExpecPauliStringDerivsInternal[initStateId, workspaces, circuit, derivTerms, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] accepts a circuit (complete with rotation angles), a derivative specification, and a Hamiltonian, and returns the energy gradient. workspaces can be a list of any length"
 
 :Begin:
 :Function:       internal_calcExpecPauliStringDerivsDenseHamil
-:Pattern:        QuEST`Private`CalcExpecPauliStringDerivsDenseHamilInternal[initStateId_Integer, hamilQuregId_Integer, workspaces_List, opcodes_List, ctrls_List, numCtrlsPerOp_List, targs_List, numTargsPerOp_List, params_List, numParamsPerOp_List, derivOpInds_List, derivVarInds_List, derivParams_List, numDerivParamsPerDerivOp_List]
-:Arguments:      { initStateId, hamilQuregId, workspaces, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp }
+:Pattern:        QuEST`Private`CalcExpecPauliStringDerivsDenseHamilInternal[initStateId_Integer, hamilQuregId_Integer, workspaces_List, circuit_List, derivTerms_List]
+:Arguments:      { initStateId, hamilQuregId, workspaces, circuit, derivTerms }
 :ArgumentTypes:  { Integer, Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcExpecPauliStringDerivsDenseHamilInternal::usage = "CalcExpecPauliStringDerivsDenseHamilInternal[initStateId, hamilQuregId, workspaces, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp] is similar to CalcExpecPauliStringDerivsInternal[], but accepts a pre-populated qureg in lieu of a Pauli Hamiltonian."
+:Evaluate: QuEST`Private`CalcExpecPauliStringDerivsDenseHamilInternal::usage = "CalcExpecPauliStringDerivsDenseHamilInternal[initStateId, hamilQuregId, workspaces, circuit, derivTerms] is similar to CalcExpecPauliStringDerivsInternal[], but accepts a pre-populated qureg in lieu of a Pauli Hamiltonian."
 
 :Begin:
 :Function:       internal_calcMetricTensor
-:Pattern:        QuEST`Private`CalcMetricTensorInternal[initStateId_Integer, workspaces_List, opcodes_List, ctrls_List, numCtrlsPerOp_List, targs_List, numTargsPerOp_List, params_List, numParamsPerOp_List, derivOpInds_List, derivVarInds_List, derivParams_List, numDerivParamsPerDerivOp_List]
-:Arguments:      { initStateId, workspaces, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp }
-:ArgumentTypes:  { Integer, Manual }
+:Pattern:        QuEST`Private`CalcMetricTensorInternal[initStateId_Integer, async_Integer, workspaces_List, circuit_List, derivTerms_List]
+:Arguments:      { initStateId, async, workspaces, circuit, derivTerms }
+:ArgumentTypes:  { Integer, Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcMetricTensorInternal::usage = "CalcMetricTensor[initStateId, workspaces, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, derivOpInds, derivVarInds, derivParams, numDerivParamsPerDerivOp] accepts a circuit and derivative terms and returns the corresponding geometric tensor."
+:Evaluate: QuEST`Private`CalcMetricTensorInternal::usage = "CalcMetricTensor[initStateId, async, workspaces, circuit, derivTerms] accepts a circuit and derivative terms and returns the corresponding geometric tensor as a {len, len, 2} real array of {re, im} components, or (if async=1) the id of a job which will compute it."
 
 :Begin:
 :Function:       internal_calcInnerProductsMatrix
@@ -411,7 +456,7 @@
 :ArgumentTypes:  { IntegerList }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcInnerProductsMatrixInternal::usage = "CalcInnerProductsMatrixInternal[quregIds] returns seperate 1D (appending rows) lists for the real and imag components of the matrix with ith-jth element CalcInnerProduct[quregIds[i], quregIds[j]]."
+:Evaluate: QuEST`Private`CalcInnerProductsMatrixInternal::usage = "CalcInnerProductsMatrixInternal[quregIds] returns a {len, len, 2} real array of the {re, im} components of the matrix with ith-jth element CalcInnerProduct[quregIds[i], quregIds[j]]."
 
 :Begin:
 :Function:       internal_calcInnerProductsVector
@@ -420,7 +465,7 @@
 :ArgumentTypes:  { Integer, IntegerList }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcInnerProductsVectorInternal::usage = "CalcInnerProductsVectorInternal[braId, ketIds] returns a vector with jth element CalcInnerProduct[braId, ketIds[j]]."
+:Evaluate: QuEST`Private`CalcInnerProductsVectorInternal::usage = "CalcInnerProductsVectorInternal[braId, ketIds] returns a {len, 2} real array of the {re, im} components of the vector with jth element CalcInnerProduct[braId, ketIds[j]]."
 
 :Begin:
 :Function:       internal_calcDensityInnerProductsMatrix
@@ -429,7 +474,7 @@
 :ArgumentTypes:  { IntegerList }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcDensityInnerProductsMatrixInternal::usage = "CalcDensityInnerProductsMatrixInternal[quregIds] returns a flattened real matrix (appending rows) with ith-jth element CalcDensityInnerProduct[quregIds[i], quregIds[j]]."
+:Evaluate: QuEST`Private`CalcDensityInnerProductsMatrixInternal::usage = "CalcDensityInnerProductsMatrixInternal[quregIds] returns a {len, len, 2} real array of the {re, im} components of the matrix with ith-jth element CalcDensityInnerProduct[quregIds[i], quregIds[j]]."
 
 :Begin:
 :Function:       internal_calcDensityInnerProductsVector
@@ -438,19 +483,19 @@
 :ArgumentTypes:  { Integer, IntegerList }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcDensityInnerProductsVectorInternal::usage = "CalcDensityInnerProductsVectorInternal[rhoId, omegaIds] returns a vector with jth element CalcDensityInnerProduct[braId, ketIds[j]]."
+:Evaluate: QuEST`Private`CalcDensityInnerProductsVectorInternal::usage = "CalcDensityInnerProductsVectorInternal[rhoId, omegaIds] returns a {len, 2} real array of the {re, im} components of the vector with jth element CalcDensityInnerProduct[braId, ketIds[j]]."
 
 
 
 
 :Begin:
 :Function:       internal_applyCircuit
-:Pattern:        QuEST`Private`ApplyCircuitInternal[qureg_Integer, storeBackup_Integer, showProgress_Integer, opcodes_List, ctrls_List, numCtrlsPerOp_List, targs_List, numTargsPerOp_List, params_List, numParamsPerOp_List]
-:Arguments:      { qureg, storeBackup, showProgress, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp }
-:ArgumentTypes:  { Integer, Integer, Integer, Manual }
+:Pattern:        QuEST`Private`ApplyCircuitInternal[qureg_Integer, storeBackup_Integer, showProgress_Integer, async_Integer, circuit_List]
+:Arguments:      { qureg, storeBackup, showProgress, async, circuit }
+:ArgumentTypes:  { Integer, Integer, Integer, Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`ApplyCircuitInternal::usage = "ApplyCircuitInternal[qureg, storeBackup, showProgress, opcodes, ctrls, numCtrlsPerOps, targs, numTargsPerOp, params, numParamsPerOps] applies a circuit (decomposed into codes) to the given qureg."
+:Evaluate: QuEST`Private`ApplyCircuitInternal::usage = "ApplyCircuitInternal[qureg, storeBackup, showProgress, async, circuit] applies a circuit (packed into a flat list of reals) to the given qureg, or (if async=1) returns the id of a job which will do so."
 
 :Begin:
 :Function:       internal_calcExpecPauliString
@@ -461,6 +506,15 @@
 :End:
 :Evaluate: QuEST`Private`CalcExpecPauliStringInternal::usage = "CalcExpecPauliStringInternal[qureg, workspace, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] returns the expected value of the qureg under the given sum of Pauli products, specified as flat lists. workspace must be a Qureg of equal dimensions to qureg."
 
+:Begin:
+:Function:       internal_calcExpecPauliStringFromShots
+:Pattern:        QuEST`Private`CalcExpecPauliStringFromShotsInternal[qureg_Integer, workspace_Integer, weightShots_Integer, numShots_Integer, termCoeffs_List, allPauliCodes_List, allPauliTargets_List, numPaulisPerTerm_List]
+:Arguments:      { qureg, workspace, weightShots, numShots, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm }
+:ArgumentTypes:  { Integer, Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CalcExpecPauliStringFromShotsInternal::usage = "CalcExpecPauliStringFromShotsInternal[qureg, workspace, weightShots, numShots, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] returns {estimate, variance} of the expected value of the given sum of Pauli products, from numShots simulated measurements per qubit-wise commuting group of terms (or from the same total shots divided proportional to the groups' coefficient magnitudes when weightShots=1). workspace is a Qureg of equal dimensions to qureg, or -1 to create one internally."
+
 :Begin:
 :Function:       internal_applyPauliString
 :Pattern:        QuEST`Private`ApplyPauliStringInternal[inQureg_Integer, outQureg_Integer, termCoeffs_List, allPauliCodes_List, allPauliTargets_List, numPaulisPerTerm_List]
@@ -477,25 +531,34 @@
 :ArgumentTypes:  { Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`CalcPauliStringMatrixInternal::usage = "CalcPauliStringMatrixInternal[numQubits, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] returns the action of applying the given sum of Pauli products (specified as flat lists) to every basis state."
+:Evaluate: QuEST`Private`CalcPauliStringMatrixInternal::usage = "CalcPauliStringMatrixInternal[numQubits, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] returns the action of applying the given sum of Pauli products (specified as flat lists) to every basis state, as a list of {dim, 2} real arrays of {re, im} components."
 
 :Begin:
 :Function:       internal_sampleExpecPauliString
-:Pattern:        QuEST`Private`SampleExpecPauliStringInternal[showProgress_Integer, initQuregId_Integer, workId1_Integer, workId2_Integer, numSamples_Integer, opcodes_List, ctrls_List, numCtrlsPerOp_List, targs_List, numTargsPerOp_List, params_List, numParamsPerOp_List, termCoeffs_List, allPauliCodes_List, allPauliTargets_List, numPaulisPerTerm_List]
-:Arguments:      { showProgress, initQuregId, workId1, workId2, numSamples, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm }
-:ArgumentTypes:  { Integer, Integer, Integer, Integer, Manual }
+:Pattern:        QuEST`Private`SampleExpecPauliStringInternal[showProgress_Integer, async_Integer, initQuregId_Integer, workId1_Integer, workId2_Integer, numSamples_Integer, circuit_List, termCoeffs_List, allPauliCodes_List, allPauliTargets_List, numPaulisPerTerm_List]
+:Arguments:      { showProgress, async, initQuregId, workId1, workId2, numSamples, circuit, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm }
+:ArgumentTypes:  { Integer, Integer, Integer, Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`SampleExpecPauliStringInternal::usage = "SampleExpecPauliStringInternal[showProgress, async, initQuregId, workId1, workId2, numSamples, circuit, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] estimates the expectation value of the given Hamiltonian and noisy channel through repeated sampling via state-vector simulation, or (if async=1) returns the id of a job which will do so."
+
+:Begin:
+:Function:       internal_sampleQuregOutcomes
+:Pattern:        QuEST`Private`SampleQuregOutcomesInternal[quregId_Integer, returnCounts_Integer, qubits_List, numShots_Integer]
+:Arguments:      { quregId, returnCounts, qubits, numShots }
+:ArgumentTypes:  { Integer, Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`SampleExpecPauliStringInternal::usage = "SampleExpecPauliStringInternal[showProgress, initQuregId, workId1, workId2, numSamples, opcodes, ctrls, numCtrlsPerOp, targs, numTargsPerOp, params, numParamsPerOp, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] estimates the expectation value of the given Hamiltonian and noisy channel through repeated sampling via state-vector simulation."
+:Evaluate: QuEST`Private`SampleQuregOutcomesInternal::usage = "SampleQuregOutcomesInternal[quregId, returnCounts, qubits, numShots] draws numShots measurement outcomes of the given qubits from the qureg's marginal distribution, without modifying it, returning every outcome or (if returnCounts=1) the observed outcomes and their counts."
 
 :Begin:
 :Function:       internal_sampleClassicalShadow
-:Pattern:        QuEST`Private`SampleClassicalShadowStateInternal[quregId_Integer, numSamples_Integer]
-:Arguments:      { quregId, numSamples }
-:ArgumentTypes:  { Integer, Manual }
+:Pattern:        QuEST`Private`SampleClassicalShadowStateInternal[quregId_Integer, shadowId_Integer, numSamples_Integer]
+:Arguments:      { quregId, shadowId, numSamples }
+:ArgumentTypes:  { Integer, Integer, Manual }
 :ReturnType:     Manual
 :End:
-:Evaluate: QuEST`Private`SampleClassicalShadowStateInternal::usage = "SampleClassicalShadowStateInternal[quregId, numSamples] repeatedly measures a state in order to populate a classical shadow."
+:Evaluate: QuEST`Private`SampleClassicalShadowStateInternal::usage = "SampleClassicalShadowStateInternal[quregId, shadowId, numSamples] repeatedly measures a state in order to populate a classical shadow, which is appended to the persistent shadow of the given id (returning the id), or returned when shadowId=-1."
 
 :Begin:
 :Function:       internal_calcExpecPauliProdsFromClassicalShadow
@@ -506,6 +569,42 @@
 :End:
 :Evaluate: QuEST`Private`CalcExpecPauliProdsFromClassicalShadowInternal::usage = "CalcExpecPauliProdsFromClassicalShadowInternal[numQb, numBatches, numSamples, sampleBases, sampleOutcomes, pauliCodes, pauliTargs, numPaulisPerProd] calculates the expected value of each Pauli product as prescribed by a classical shadow."
 
+:Begin:
+:Function:       internal_calcExpecPauliProdsFromStoredClassicalShadow
+:Pattern:        QuEST`Private`CalcExpecPauliProdsFromStoredClassicalShadowInternal[shadowId_Integer, numBatches_Integer, pauliCodes_List, pauliTargs_List, numPaulisPerProd_List]
+:Arguments:      { shadowId, numBatches, pauliCodes, pauliTargs, numPaulisPerProd }
+:ArgumentTypes:  { Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CalcExpecPauliProdsFromStoredClassicalShadowInternal::usage = "CalcExpecPauliProdsFromStoredClassicalShadowInternal[shadowId, numBatches, pauliCodes, pauliTargs, numPaulisPerProd] calculates the expected value of each Pauli product as prescribed by the persistent classical shadow of the given id."
+
+:Begin:
+:Function:       internal_createClassicalShadow
+:Pattern:        QuEST`Private`CreateClassicalShadowInternal[numQb_Integer, numSamples_Integer, sampleBases_List, sampleOutcomes_List]
+:Arguments:      { numQb, numSamples, sampleBases, sampleOutcomes }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CreateClassicalShadowInternal::usage = "CreateClassicalShadowInternal[numQb, numSamples, sampleBases, sampleOutcomes] validates and persistently stores a (possibly empty) classical shadow, returning its id."
+
+:Begin:
+:Function:       internal_destroyClassicalShadow
+:Pattern:        QuEST`Private`DestroyClassicalShadowInternal[shadowId_Integer]
+:Arguments:      { shadowId }
+:ArgumentTypes:  { Integer }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`DestroyClassicalShadowInternal::usage = "DestroyClassicalShadowInternal[shadowId] frees the persistent classical shadow of the given id."
+
+:Begin:
+:Function:       internal_getClassicalShadow
+:Pattern:        QuEST`Private`GetClassicalShadowInternal[shadowId_Integer]
+:Arguments:      { shadowId }
+:ArgumentTypes:  { Integer }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetClassicalShadowInternal::usage = "GetClassicalShadowInternal[shadowId] returns the persistent classical shadow of the given id, in the format of SampleClassicalShadowStateInternal."
+
 
 
 
@@ -518,6 +617,15 @@
 :End:
 :Evaluate: QuEST`Private`GetQuregMatrixInternal::usage = "GetQuregMatrixInternal[qureg] returns the underlying statevector associated with the given qureg (flat, even for density matrices)."
 
+:Begin:
+:Function:       internal_getQuregStateInChunks
+:Pattern:        QuEST`Private`GetQuregStateInChunksInternal[qureg_Integer, startInd_Integer, numAmps_Integer, chunkSize_Integer]
+:Arguments:      { qureg, startInd, numAmps, chunkSize }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetQuregStateInChunksInternal::usage = "GetQuregStateInChunksInternal[qureg, startInd, numAmps, chunkSize] sends the numAmps (or all, when -1) flat amplitudes of the qureg from startInd, in chunks of at most chunkSize, to QuEST`Private`receiveQuregStateChunk[offset, amps] (where amps is a {len, 2} real array of {re, im} components), after calling QuEST`Private`initQuregStateBuffer[numAmps]. Returns {numQubits, isDensityMatrix}."
+
 :Begin:
 :Function:       internal_setWeightedQureg
 :Pattern:        QuEST`Private`SetWeightedQuregInternal[qureg1_Integer,qureg2_Integer,quregOut_Integer, facRe1_Real,facIm1_Real, facRe2_Real,facIm2_Real, facReOut_Real,facImOut_Real]
@@ -548,6 +656,115 @@
 :End:
 :Evaluate: QuEST`Private`SetQuregToPauliStringInternal::usage = "SetQuregToPauliStringInternal[qureg, termCoeffs, allPauliCodes, allPauliTargets, numPaulisPerTerm] modifies density-matrix qureg to become the Hamiltonian as a matrix."
 
+:Begin:
+:Function:       internal_saveQureg
+:Pattern:        QuEST`Private`SaveQuregInternal[qureg_Integer, path_String]
+:Arguments:      { qureg, path }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`SaveQuregInternal::usage = "SaveQuregInternal[qureg, path] writes the qureg to a binary checkpoint file at the given absolute path, returning the qureg."
+
+:Begin:
+:Function:       internal_loadQureg
+:Pattern:        QuEST`Private`LoadQuregInternal[path_String]
+:Arguments:      { path }
+:ArgumentTypes:  { Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`LoadQuregInternal::usage = "LoadQuregInternal[path] returns the id of a newly created qureg, populated from the binary checkpoint file at the given absolute path."
+
+:Begin:
+:Function:       internal_getJobStatus
+:Pattern:        QuEST`Private`JobStatusInternal[jobId_Integer]
+:Arguments:      { jobId }
+:ArgumentTypes:  { Integer }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`JobStatusInternal::usage = "JobStatusInternal[jobId] returns {status, progress} of the job, where status is 0 (queued), 1 (running), 2 (succeeded), 3 (failed) or 4 (cancelled), and progress lies in [0, 1]."
+
+:Begin:
+:Function:       internal_getJobResult
+:Pattern:        QuEST`Private`JobResultInternal[jobId_Integer]
+:Arguments:      { jobId }
+:ArgumentTypes:  { Integer }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`JobResultInternal::usage = "JobResultInternal[jobId] waits for the job to finish, then returns its result (or reports its error) as would the function which submitted it, and releases its quregs."
+
+:Begin:
+:Function:       internal_cancelJob
+:Pattern:        QuEST`Private`CancelJobInternal[jobId_Integer]
+:Arguments:      { jobId }
+:ArgumentTypes:  { Integer }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CancelJobInternal::usage = "CancelJobInternal[jobId] requests the job be cancelled, which is immediate if it has not yet begun, or else occurs when it next polls for aborts."
+
+
+
+:Begin:
+:Function:       internal_simplifyPaulis
+:Pattern:        QuEST`Private`SimplifyPaulisInternal[numQubits_Integer, instrs_List, paulis_List, scalarsRe_List, scalarsIm_List]
+:Arguments:      { numQubits, instrs, paulis, scalarsRe, scalarsIm }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`SimplifyPaulisInternal::usage = "SimplifyPaulisInternal[numQubits, instrs, paulis, scalarsRe, scalarsIm] evaluates a numerical Pauli expression, encoded as a flat postfix list of {opcode, arg} instructions operating upon flat {opcode, target} Pauli operators and complex scalars, returning {coeffsRe, coeffsIm, pauliCodes, pauliTargets, numPaulisPerTerm} of the simplified Pauli string."
+
+
+
+:Begin:
+:Function:       internal_getPauliStringFromMatrix
+:Pattern:        QuEST`Private`GetPauliStringFromMatrixInternal[numQubits_Integer, minCoeff_Real, matrRe_List, matrIm_List]
+:Arguments:      { numQubits, minCoeff, matrRe, matrIm }
+:ArgumentTypes:  { Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetPauliStringFromMatrixInternal::usage = "GetPauliStringFromMatrixInternal[numQubits, minCoeff, matrRe, matrIm] decomposes the given flattened (row-major) numerical matrix into the Pauli basis, returning {coeffsRe, coeffsIm, pauliInds} of only the coefficients with magnitudes exceeding minCoeff."
+
+:Begin:
+:Function:       internal_applyPauliTransferMaps
+:Pattern:        QuEST`Private`ApplyPauliTransferMapsInternal[numQubits_Integer, maxWeight_Integer, minCoeff_Real, instrs_List, paulis_List, scalarsRe_List, scalarsIm_List, mapTargs_List, numTargsPerMap_List, numOutsPerIn_List, outInds_List, outCoeffs_List]
+:Arguments:      { numQubits, maxWeight, minCoeff, instrs, paulis, scalarsRe, scalarsIm, mapTargs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs }
+:ArgumentTypes:  { Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`ApplyPauliTransferMapsInternal::usage = "ApplyPauliTransferMapsInternal[numQubits, maxWeight, minCoeff, instrs, paulis, scalarsRe, scalarsIm, mapTargs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs] propagates a numerical Pauli string (encoded as per SimplifyPaulisInternal) through the given flattened numerical PTMaps, discarding products with more than maxWeight (if non-negative) Paulis or with coefficients not exceeding minCoeff, returning the result encoded as per SimplifyPaulisInternal."
+
+
+
+:Begin:
+:Function:       internal_applyCachedPauliTransferMaps
+:Pattern:        QuEST`Private`ApplyCachedPauliTransferMapsInternal[numQubits_Integer, maxWeight_Integer, minCoeff_Real, instrs_List, paulis_List, scalarsRe_List, scalarsIm_List, keys_List, gateKeyInds_List, gateQubits_List, numQubitsPerGate_List, givenKeyInds_List, mapTargs_List, numTargsPerMap_List, numOutsPerIn_List, outInds_List, outCoeffs_List]
+:Arguments:      { numQubits, maxWeight, minCoeff, instrs, paulis, scalarsRe, scalarsIm, keys, gateKeyInds, gateQubits, numQubitsPerGate, givenKeyInds, mapTargs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs }
+:ArgumentTypes:  { Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`ApplyCachedPauliTransferMapsInternal::usage = "ApplyCachedPauliTransferMapsInternal[numQubits, maxWeight, minCoeff, instrs, paulis, scalarsRe, scalarsIm, keys, gateKeyInds, gateQubits, numQubitsPerGate, givenKeyInds, mapTargs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs] propagates a numerical Pauli string (encoded as per SimplifyPaulisInternal) through a sequence of gates, each of which is identified by a string key (of its compacted form) and its ordered qubits. The gates' PTMaps (upon compacted qubits) are fetched from a persistent cache in the backend, into which the given maps (flattened and of the given key indices) are added after the others are fetched. Returns Missing[\"Uncached\", keyInds] if some keys' maps are not cached nor given, otherwise the result encoded as per SimplifyPaulisInternal."
+
+
+
+:Begin:
+:Function:       internal_clearCachedPauliTransferMaps
+:Pattern:        QuEST`Private`ClearCachedPauliTransferMapsInternal[]
+:Arguments:      { }
+:ArgumentTypes:  { }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`ClearCachedPauliTransferMapsInternal::usage = "ClearCachedPauliTransferMapsInternal[] discards all PTMaps persistently cached by the backend."
+
+
+
+:Begin:
+:Function:       internal_calcPauliTransferEval
+:Pattern:        QuEST`Private`CalcPauliTransferEvalInternal[numQubits_Integer, combineStrs_Integer, maxWeight_Integer, minCoeff_Real, instrs_List, paulis_List, scalarsRe_List, scalarsIm_List, mapTargs_List, numTargsPerMap_List, numOutsPerIn_List, outInds_List, outCoeffs_List]
+:Arguments:      { numQubits, combineStrs, maxWeight, minCoeff, instrs, paulis, scalarsRe, scalarsIm, mapTargs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs }
+:ArgumentTypes:  { Integer, Integer, Integer, Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`CalcPauliTransferEvalInternal::usage = "CalcPauliTransferEvalInternal[numQubits, combineStrs, maxWeight, minCoeff, instrs, paulis, scalarsRe, scalarsIm, mapTargs, numTargsPerMap, numOutsPerIn, outInds, outCoeffs] computes the evaluation graph of a numerical Pauli string (encoded as per SimplifyPaulisInternal) under the given flattened numerical PTMaps, merging identical strings in each layer when combineStrs=1, and pruning nodes with more than maxWeight (if non-negative) Paulis or with coefficients not exceeding a positive minCoeff. Each layer is streamed to appendPTEvalLayer[] as it is computed, and the number of layers is returned."
+
 
 
 :Begin:
@@ -583,6 +800,54 @@
     QuEST`DestroyAllQuregs::error = "`1`";
     QuEST`DestroyAllQuregs[___] := QuEST`Private`invalidArgError[DestroyAllQuregs];
 
+:Begin:
+:Function:       callable_trimQuregPool
+:Pattern:        QuEST`TrimQuregPool[]
+:Arguments:      { }
+:ArgumentTypes:  { }
+:ReturnType:     Manual
+:End:
+:Evaluate: 
+    QuEST`TrimQuregPool::usage = "TrimQuregPool[] frees the memory of all destroyed quregs retained (for reuse by new quregs of the same size and type) in the qureg pool, returning the number of bytes freed. See SetQuregPoolCapacity[].";
+    QuEST`TrimQuregPool::error = "`1`";
+    QuEST`TrimQuregPool[___] := QuEST`Private`invalidArgError[TrimQuregPool];
+
+:Begin:
+:Function:       internal_setQuregPoolCapacity
+:Pattern:        QuEST`Private`SetQuregPoolCapacityInternal[numBytes_Integer]
+:Arguments:      { numBytes }
+:ArgumentTypes:  { Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`SetQuregPoolCapacityInternal::usage = "SetQuregPoolCapacityInternal[numBytes] sets the maximum total memory of destroyed quregs retained for reuse, freeing any excess."
+
+:Begin:
+:Function:       callable_getQuregPoolUsage
+:Pattern:        QuEST`Private`GetQuregPoolUsageInternal[]
+:Arguments:      { }
+:ArgumentTypes:  { }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetQuregPoolUsageInternal::usage = "GetQuregPoolUsageInternal[] returns {numBytes, capacity} of the pool of destroyed quregs retained for reuse."
+
+:Begin:
+:Function:       internal_setQuESTMemoryBudget
+:Pattern:        QuEST`Private`SetQuESTMemoryBudgetInternal[numBytes_Integer]
+:Arguments:      { numBytes }
+:ArgumentTypes:  { Manual }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`SetQuESTMemoryBudgetInternal::usage = "SetQuESTMemoryBudgetInternal[numBytes] sets the maximum total memory of quregs, pooled quregs and temporary buffers, where -1 indicates no budget."
+
+:Begin:
+:Function:       callable_getQuESTMemoryUsage
+:Pattern:        QuEST`Private`GetQuESTMemoryUsageInternal[]
+:Arguments:      { }
+:ArgumentTypes:  { }
+:ReturnType:     Manual
+:End:
+:Evaluate: QuEST`Private`GetQuESTMemoryUsageInternal::usage = "GetQuESTMemoryUsageInternal[] returns {quregsNumBytes, poolNumBytes, tempNumBytes, budget} where budget is -1 if unlimited."
+
 :Begin:
 :Function:       callable_getAllQuregs
 :Pattern:        QuEST`GetAllQuregs[]
@@ -1,5 +1,6 @@
 
 #include <random>
+#include <algorithm>
 
 #include "QuEST_precision.h"
 #include "QuEST_complex.h"
@@ -11,14 +12,22 @@
 
 #define MIN_NON_ZERO_EPS_FAC 1E4
 
+/* The maximum condition number of an operator deemed invertible, so that undoing it
+ * amplifies the numerical error in a state by at most 1/sqrt(REAL_EPS)
+ */
+#define MAX_INVERTIBLE_CONDITION_NUMBER (1 / sqrt(REAL_EPS))
+
 
 
 /* 
  * RNG 
  */
  
-std::mt19937 randGen(std::random_device{}()); // auto-seeds
-std::uniform_real_distribution<qreal> randDist(0,1);
+/* Each thread (the main thread, and the worker computing asynchronous jobs) draws from 
+ * its own generator, auto-seeded upon its first use, so that jobs never race the main thread
+ */
+thread_local std::mt19937 randGen(std::random_device{}());
+thread_local std::uniform_real_distribution<qreal> randDist(0,1);
  
 int local_getRandomIndex(qreal* weights, int numInds) {
     
@@ -57,6 +66,18 @@ int local_getRandomIndex(int numInds) {
     return numInds-1;
 }
 
+long long int local_getRandomIndexFromCumulative(qreal* cumWeights, long long int numInds) {
+    
+    // cumWeights are assumed non-decreasing, ending at (approximately) 1, so that an 
+    // index can be drawn in O(log numInds) time by bisection
+    
+    qreal r = randDist(randGen) * cumWeights[numInds-1];
+    long long int ind = std::upper_bound(cumWeights, cumWeights + numInds, r) - cumWeights;
+    
+    // this can only exceed the bounds when r precisely equals the final weight
+    return (ind < numInds)? ind : numInds-1;
+}
+
 void local_lazyShuffle(std::vector<int> &array) {
     
     // this is a monstrously poor shuffle; merely swapping random elements a
@@ -299,11 +320,17 @@ qvector local_getQvectorFromFlatList(qreal* flatElems, int dim) {
 
 bool local_isInvertible(qvector diagonal) {
     
-    for (size_t i=0; i<diagonal.size(); i++)
+    qreal minAbs = abs(diagonal[0]);
+    qreal maxAbs = minAbs;
+    for (size_t i=0; i<diagonal.size(); i++) {
         if (! local_isNonZero(diagonal[i]) )
             return false;
-            
-    return true;
+        minAbs = std::min(minAbs, (qreal) abs(diagonal[i]));
+        maxAbs = std::max(maxAbs, (qreal) abs(diagonal[i]));
+    }
+    
+    // reject ill-conditioned operators
+    return maxAbs <= MAX_INVERTIBLE_CONDITION_NUMBER * minAbs;
 }
 
 qvector local_getInverse(qvector diagonal) {
@@ -418,6 +445,24 @@ bool local_isNonZero(qcomp scalar) {
     return local_isNonZero(abs(scalar));
 }
 
+bool local_isInvertibleFactor(qreal fac) {
+    
+    return abs(fac) * MAX_INVERTIBLE_CONDITION_NUMBER >= 1;
+}
+
+qreal local_getOneNorm(qmatrix matr) {
+    
+    // the maximum absolute column sum
+    qreal norm = 0;
+    for (size_t j=0; j<matr.size(); j++) {
+        qreal sum = 0;
+        for (size_t i=0; i<matr.size(); i++)
+            sum += abs(matr[i][j]);
+        norm = std::max(norm, sum);
+    }
+    return norm;
+}
+
 qmatrix local_decomposeLU(qmatrix matr, std::vector<int>& pivots, int *numPivots) {
     
     size_t dim = matr.size();
@@ -509,8 +554,11 @@ bool local_isInvertible(qmatrix matr) {
       */
 
     try {
-        local_getInverse(matr); // throws
-        return true;
+        qmatrix inv = local_getInverse(matr); // throws
+        
+        // reject ill-conditioned (though non-singular) matrices
+        return local_getOneNorm(matr) * local_getOneNorm(inv) <= MAX_INVERTIBLE_CONDITION_NUMBER;
+        
     } catch (QuESTException& err) {
         return false;
     }
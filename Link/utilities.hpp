@@ -17,6 +17,7 @@
     #define WSGetQrealList WSGetReal32List
     #define WSPutQrealList WSPutReal32List
     #define WSReleaseQrealList WSReleaseReal32List
+    #define WSPutQrealArray WSPutReal32Array
 #elif QuEST_PREC==2
     #define WSGetQreal WSGetReal64
     #define WSPutQreal WSPutReal64
@@ -24,6 +25,7 @@
     #define WSGetQrealList WSGetReal64List
     #define WSPutQrealList WSPutReal64List
     #define WSReleaseQrealList WSReleaseReal64List
+    #define WSPutQrealArray WSPutReal64Array
 #elif QuEST_PREC==4
     #define WSGetQreal WSGetReal128
     #define WSPutQreal WSPutReal128
@@ -31,6 +33,17 @@
     #define WSGetQrealList WSGetReal128List
     #define WSPutQrealList WSPutReal128List
     #define WSReleaseQrealList WSReleaseReal128List
+    #define WSPutQrealArray WSPutReal128Array
+#endif
+
+
+
+// portable count of the set bits of a 64-bit word
+#ifdef _MSC_VER
+    #include <intrin.h>
+    #define local_popcount(word) ((int) __popcnt64(word))
+#else
+    #define local_popcount(word) __builtin_popcountll(word)
 #endif
 
 
@@ -39,6 +52,8 @@ int local_getRandomIndex(qreal* weights, int numInds);
 
 int local_getRandomIndex(int numInds);
 
+long long int local_getRandomIndexFromCumulative(qreal* cumWeights, long long int numInds);
+
 void local_lazyShuffle(std::vector<int> &array);
 
 
@@ -102,10 +117,20 @@ void local_setComplexMatrixToRealFactor(ComplexMatrixN matr, qreal fac);
 void local_setFlatListToDiagonalMatrixDagger(qreal* list, int numQubits);
 
 
+/** Returns whether the matrix is invertible and well-conditioned, such that 
+ * its inverse can be applied to undo the matrix to within numerical precision.
+ */
 bool local_isInvertible(qmatrix matr);
 
+/** Returns whether the diagonal matrix is invertible and well-conditioned.
+ */
 bool local_isInvertible(qvector diag);
 
+/** Returns whether an operator whose spectrum is at most unit-sized, and contains 
+ * fac, can be stably inverted.
+ */
+bool local_isInvertibleFactor(qreal fac);
+
 bool local_isNonZero(qreal scalar);
 
 bool local_isNonZero(qcomp scalar);